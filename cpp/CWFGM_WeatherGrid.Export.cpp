@@ -0,0 +1,166 @@
+/**
+ * WISE_Weather_Module: CWFGM_WeatherGrid.Export.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "angles.h"
+#include "propsysreplacement.h"
+#include "WeatherCom_ext.h"
+#include "CWFGM_WeatherGrid.h"
+#include "GridCom_ext.h"
+#include "GDALExporter.h"
+#include "gdalclient.h"
+#include "str_printf.h"
+
+#include <ctime>
+#include <future>
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+static const char *export_names[CWFGM_WEATHER_EXPORT_VARIABLES] = { "temp", "dewpt", "rh", "precip", "ws", "wd", "gust", "ffmc", "isi", "fwi", "dmc", "dc", "bui" };
+
+#endif
+
+
+HRESULT CCWFGM_WeatherGrid::ExportRasters(Layer *layerThread, const HSS_Time::WTime &start_time, const HSS_Time::WTime &end_time, std::uint64_t interpolate_method, const std::vector<std::uint16_t> &variables, const std::string &file_prefix) {
+	if ((!variables.size()) || (!file_prefix.length()))		return E_INVALIDARG;
+	if (end_time < start_time)					return E_INVALIDARG;
+	for (std::uint16_t v : variables)
+		if (v >= CWFGM_WEATHER_EXPORT_VARIABLES)		return E_INVALIDARG;
+
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_FALSE);
+
+	if (!m_gridEngine(layerThread))					{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	std::vector<double> current, next;
+	HRESULT hr = exportFrame(layerThread, start_time, interpolate_method, variables, &current);
+	if (FAILED(hr))
+		return hr;
+
+	const WTimeSpan hour(0, 1, 0, 0);
+	for (WTime t(start_time, m_timeManager); t <= end_time; t += hour) {
+		const WTime t1(t + hour);
+		const bool more = (t1 <= end_time);
+
+		// calculate the next hour while this hour is written out
+		std::future<HRESULT> calc;
+		if (more) {
+			try {
+				calc = std::async(std::launch::async, [this, layerThread, t1, interpolate_method, &variables, &next]() { return exportFrame(layerThread, t1, interpolate_method, variables, &next); });
+			} catch (std::system_error &) {
+			}
+		}
+
+		HRESULT hrw = writeFrame(t, variables, current, file_prefix);
+
+		HRESULT hrc = S_OK;
+		if (more) {
+			if (calc.valid())	hrc = calc.get();
+			else			hrc = exportFrame(layerThread, t1, interpolate_method, variables, &next);
+		}
+
+		if (FAILED(hrw))
+			return hrw;
+		if (FAILED(hrc))
+			return hrc;
+		current.swap(next);
+	}
+	return S_OK;
+}
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+// calculates the requested variables over the whole grid at 'time', one plane per variable in the order given, each plane laid out north row first as GDALExporter expects
+HRESULT CCWFGM_WeatherGrid::exportFrame(Layer *layerThread, const HSS_Time::WTime &time, std::uint64_t interpolate_method, const std::vector<std::uint16_t> &variables, std::vector<double> *planes) {
+	XY_Point min_pt, max_pt;
+	min_pt.x = invertX(0.5);
+	min_pt.y = invertY(0.5);
+	max_pt.x = invertX(((double)m_xsize) - 0.5);
+	max_pt.y = invertY(((double)m_ysize) - 0.5);
+
+	HRESULT hr = GetWeatherDataPlanes(layerThread, min_pt, max_pt, m_converter.resolution(), time, interpolate_method, variables, planes);
+	if (FAILED(hr))
+		return hr;
+
+	std::vector<double> row(m_xsize);				// planes come back south row first
+	for (std::size_t i = 0; i < variables.size(); i++) {
+		double *plane = planes->data() + i * (std::size_t)m_xsize * (std::size_t)m_ysize;
+		for (std::uint16_t y = 0; y < m_ysize / 2; y++) {
+			double *south = plane + (std::size_t)y * m_xsize, *north = plane + (std::size_t)(m_ysize - 1 - y) * m_xsize;
+			memcpy(row.data(), south, sizeof(double) * m_xsize);
+			memcpy(south, north, sizeof(double) * m_xsize);
+			memcpy(north, row.data(), sizeof(double) * m_xsize);
+		}
+	}
+	return hr;
+}
+
+
+// writes one GeoTIFF per variable for the hour at 'time'
+HRESULT CCWFGM_WeatherGrid::writeFrame(const HSS_Time::WTime &time, const std::vector<std::uint16_t> &variables, const std::vector<double> &planes, const std::string &file_prefix) {
+	boost::intrusive_ptr<ICWFGM_GridEngine> engine;
+	if (!(engine = m_gridEngine(nullptr)))				{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	PolymorphicAttribute v;
+	HRESULT hr;
+	if (FAILED(hr = engine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_SPATIALREFERENCE, &v)))
+		return hr;
+
+	std::string ref;
+	try { ref = std::get<std::string>(v); } catch (std::bad_variant_access&) { weak_assert(false); return ERROR_PROJECTION_UNKNOWN; };
+
+	// local standard time, so the hour repeated when daylight savings ends doesn't overwrite the first one's files
+	const std::string stamp = strprintf("%04d%02d%02d%02d", (int)time.GetYear(WTIME_FORMAT_AS_LOCAL), (int)time.GetMonth(WTIME_FORMAT_AS_LOCAL),
+		(int)time.GetDay(WTIME_FORMAT_AS_LOCAL), (int)time.GetHour(WTIME_FORMAT_AS_LOCAL));
+	char mbstr[100];
+	std::time_t t = std::time(nullptr);
+	std::tm now;
+#if defined(_MSC_VER)
+	localtime_s(&now, &t);						// std::localtime() returns a shared buffer that other threads may be using
+#else
+	localtime_r(&t, &now);
+#endif
+	std::strftime(mbstr, sizeof(mbstr), "%Y-%m-%d %H:%M:%S %Z", &now);
+
+	const std::uint32_t cnt = (std::uint32_t)m_xsize * (std::uint32_t)m_ysize;
+
+	CSemaphoreEngage lock(GDALClient::GDALClient::getGDALMutex(), true);
+
+	for (std::size_t i = 0; i < variables.size(); i++) {
+		GDALExporter exporter;
+		exporter.AddTag("TIFFTAG_SOFTWARE", "W.I.S.E.");
+		exporter.AddTag("TIFFTAG_GDAL_NODATA", "-9999");
+		exporter.AddTag("TIFFTAG_DATETIME", mbstr);
+		exporter.setProjection(ref.c_str());
+		exporter.setSize(m_xsize, m_ysize);
+		exporter.setPrecision(2);
+		exporter.setWidth(9);
+		exporter.setPixelResolution(m_converter.resolution(), m_converter.resolution());
+		exporter.setLowerLeft(m_converter.xllcorner(), m_converter.yllcorner());
+
+		const std::string filename = file_prefix + "_" + export_names[variables[i]] + "_" + stamp + ".tif";
+		GDALExporter::ExportResult res = exporter.Export((double *)planes.data() + i * cnt, filename.c_str(), export_names[variables[i]]);
+		if (res == GDALExporter::ExportResult::ERROR_ACCESS)
+			return E_ACCESSDENIED;
+		if (res != GDALExporter::ExportResult::OK)
+			return E_FAIL;
+	}
+	return S_OK;
+}
+
+#endif
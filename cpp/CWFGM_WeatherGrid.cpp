@@ -25,7 +25,11 @@
 #include "convert.h"
 #include "limits.h"
 #include "vectors.h"
+#include "str_printf.h"
 #include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 
 #ifndef DOXYGEN_IGNORE_CODE
@@ -39,6 +43,20 @@ CCWFGM_WeatherGrid::CCWFGM_WeatherGrid() : WeatherUtilities(nullptr), m_timeMana
 
 	m_xsize = m_ysize = (std::uint16_t)-1;
 	m_converter.setGrid(-1.0, -1.0, -1.0);
+	m_elevationTiles = nullptr;
+	m_elevationXTiles = 0;
+	m_elevationTileCount = 0;
+	m_lattice = nullptr;
+	m_latticeBlocks = 0;
+	m_hourlyBlend = false;
+	m_latticeSpacing = 0;
+	m_latticeTolerance = 0.1;
+	m_latticeToleranceWind = 0.5;
+	m_latticeTolerancePrecip = 0.05;
+	m_cacheEviction = CWFGM_WEATHER_CACHE_EVICT_FIFO;
+	m_cacheBudget = 0;
+	m_cacheStats = false;
+	m_diskCache = nullptr;
 }
 
 
@@ -55,6 +73,21 @@ CCWFGM_WeatherGrid::CCWFGM_WeatherGrid(const CCWFGM_WeatherGrid &toCopy) : Weath
 	m_converter.setGrid(toCopy.m_converter.resolution(), toCopy.m_converter.xllcorner(), toCopy.m_converter.yllcorner());
 	m_xsize = toCopy.m_xsize;
 	m_ysize = toCopy.m_ysize;
+	m_elevationTiles = nullptr;
+	m_elevationXTiles = 0;
+	m_elevationTileCount = 0;
+	m_lattice = nullptr;
+	m_latticeBlocks = 0;
+	m_hourlyBlend = toCopy.m_hourlyBlend;
+	m_latticeSpacing = toCopy.m_latticeSpacing;
+	m_latticeTolerance = toCopy.m_latticeTolerance;
+	m_latticeToleranceWind = toCopy.m_latticeToleranceWind;
+	m_latticeTolerancePrecip = toCopy.m_latticeTolerancePrecip;
+	m_cacheEviction = toCopy.m_cacheEviction;
+	m_cacheBudget = toCopy.m_cacheBudget;
+	m_cacheStats = toCopy.m_cacheStats;
+	m_diskCachePath = toCopy.m_diskCachePath;
+	m_diskCache = nullptr;
 
 	GStreamNode *n = toCopy.m_streamList.LH_Head();
 	while (n->LN_Succ()) {
@@ -77,6 +110,10 @@ CCWFGM_WeatherGrid::~CCWFGM_WeatherGrid() {
 
 	RemoveCache((Layer *)-1, 0);
 	RemoveCache((Layer *)-1, 1);
+	clearElevationCache();
+	clearEventTimeline();
+	clearDiskCache();
+	clearLattice();
 }
 
 #endif
@@ -85,6 +122,803 @@ CCWFGM_WeatherGrid::~CCWFGM_WeatherGrid() {
 IMPLEMENT_OBJECT_CACHE_MT_NO_TEMPLATE(GStreamNode, GStreamNode, 512 * 1024 / sizeof(GStreamNode), true, 16)
 
 
+#ifndef DOXYGEN_IGNORE_CODE
+
+// this routine returns the station's weather for the specified time, with the lapse rates and sea level adjusted (dew point) temperature
+// these terms only depend on the station, so they are computed once per time and shared by every grid cell
+HRESULT GStreamNode::GetStationValues(const HSS_Time::WTime &time, std::uint64_t interpolate_method, GStreamWxData *data) {
+	WeatherKeyBase key(time);
+	key.interpolate_method = interpolate_method & CWFGM_GETWEATHER_INTERPOLATE_TEMPORAL;	// same key as the stream uses for its own cache
+
+	m_wxLock.Lock();
+	checkGeneration();
+	GStreamWxData *result = m_wxCache.Retrieve(&key);
+	if (result) {
+		*data = *result;
+		m_wxLock.Unlock();
+		return data->hr;
+	}
+	m_wxLock.Unlock();
+
+	data->hr = m_stream->GetInstantaneousValues(time, interpolate_method, &data->wx, NULL, NULL);
+	if (SUCCEEDED(data->hr)) {
+		double VPs = 0.6112 * pow(10.0, 7.5 * data->wx.Temperature / (237.7 + data->wx.Temperature));
+		double VP = data->wx.RH * VPs;
+
+		double Rv = 0.622 * VP / (m_Pe - VP);
+		double Rvs = 0.622 * VPs / (m_Pe - VPs);
+
+		const double Lv = 2501000.0;
+		const double R = 287.0;
+		const double g = -9.80665;
+		const double Cpd = 1005.7;
+		const double e = 0.621885157;
+		double temp_kelvin = UnitConvert::convertUnit(data->wx.Temperature, STORAGE_FORMAT_KELVIN, STORAGE_FORMAT_CELSIUS);
+		double numerator = 1.0 + (Lv * Rv) / (R * temp_kelvin);
+		double denominator = Cpd + (Lv * Lv * Rv * e) / (R * (temp_kelvin * temp_kelvin));
+		data->UALR = g * numerator / denominator;
+
+		numerator = 1.0 + (Lv * Rvs) / (R * temp_kelvin);
+		denominator = Cpd + (Lv * Lv * Rvs * e) / (R * (temp_kelvin * temp_kelvin));
+		data->SALR = g * numerator / denominator;
+
+		data->wx.Temperature -= (data->UALR * m_elevation);
+		data->wx.DewPointTemperature -= (data->SALR * m_elevation);	// new math from Neal is K/m not K/km
+
+		double sin_wd, cos_wd;
+		::sincos(data->wx.WindDirection, &sin_wd, &cos_wd);
+		data->ws_u = cos_wd * data->wx.WindSpeed;
+		data->ws_v = sin_wd * data->wx.WindSpeed;
+		if (data->wx.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
+			data->gust_u = cos_wd * data->wx.WindGust;
+			data->gust_v = sin_wd * data->wx.WindGust;
+		} else
+			data->gust_u = data->gust_v = 0.0;
+	} else {
+		data->UALR = data->SALR = 0.0;
+		data->ws_u = data->ws_v = data->gust_u = data->gust_v = 0.0;
+		return data->hr;					// don't remember failures, the stream may be fixed up before the next request
+	}
+
+	m_wxLock.Lock();
+	m_wxCache.Store(&key, data);
+	m_wxLock.Unlock();
+	return data->hr;
+}
+
+
+// this routine returns this station's rain over the 23 hours before todayStart, the rest of the FWI day's rain comes from the grid's weather
+// at todayStart.  Hours where the primary stream has no data are skipped since the grid only reports the primary stream's (empty) values for
+// those times.
+HRESULT GStreamNode::GetStationDailyRain(const HSS_Time::WTime &todayStart, std::uint64_t interpolate_method, CCWFGM_WeatherStream *primary, double *rain) {
+	WeatherKeyBase key(todayStart);
+	key.interpolate_method = interpolate_method & CWFGM_GETWEATHER_INTERPOLATE_TEMPORAL;
+
+	m_wxLock.Lock();
+	checkGeneration();
+	const std::uint32_t primaryGeneration = primary->CacheGeneration();
+	if ((primary != m_primary) || (primaryGeneration != m_primaryGeneration)) {	// totals also depend on which hours the primary stream has
+		m_rainCache.Clear();
+		m_primary = primary;
+		m_primaryGeneration = primaryGeneration;
+	}
+	double *result = m_rainCache.Retrieve(&key);
+	if (result) {
+		*rain = *result;
+		m_wxLock.Unlock();
+		return S_OK;
+	}
+	m_wxLock.Unlock();
+
+	HRESULT hr;
+	IWXData pwx;
+	GStreamWxData sw;
+	double r = 0.0;
+	WTime loop(todayStart);
+	loop -= WTimeSpan(0, 1, 0, 0);
+	for (std::uint16_t i = 0; i < 23; i++, loop -= WTimeSpan(0, 1, 0, 0)) {
+		if (primary != m_stream.get()) {
+			if (FAILED(hr = primary->GetInstantaneousValues(loop, interpolate_method, &pwx, NULL, NULL)))
+				return hr;
+			if (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY)
+				continue;
+		}
+		if (FAILED(hr = GetStationValues(loop, interpolate_method, &sw)))
+			return hr;
+		if ((primary == m_stream.get()) && (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY))
+			continue;
+		r += sw.wx.Precipitation;
+	}
+
+	m_wxLock.Lock();
+	m_rainCache.Store(&key, &r);
+	m_wxLock.Unlock();
+	*rain = r;
+	return S_OK;
+}
+
+
+// drops the cached values if the stream has been edited since they were calculated, the same times the stream drops its own cache, m_wxLock must be held
+void GStreamNode::checkGeneration() {
+	const std::uint32_t generation = m_stream->CacheGeneration();
+	if (generation != m_generation) {
+		m_wxCache.Clear();
+		m_rainCache.Clear();
+		m_generation = generation;
+	}
+}
+
+
+void GStreamNode::ClearStationValues() {
+	m_wxLock.Lock();
+	m_wxCache.Clear();
+	m_rainCache.Clear();
+	m_wxLock.Unlock();
+}
+
+
+#define ELEVATION_TILE	64		// cells along each side of an elevation cache tile
+#define LATTICE_SETS	4		// hours of lattice kept at once, consecutive hours go to consecutive sets
+
+
+// sets up the elevation cache, elevation doesn't change during a simulation so this saves a trip down the layer chain for every cell
+// query.  Only the table of tiles is allocated here, tiles are filled in as the cells in them are first asked for, so memory (and start
+// up time) follow the fire rather than the size of the grid.
+void CCWFGM_WeatherGrid::buildElevationCache() {
+	CRWThreadSemaphoreEngage engage(m_elevationLock, SEM_TRUE);
+	if ((!m_elevationTiles) && (m_xsize != (std::uint16_t)-1) && (m_ysize != (std::uint16_t)-1) && (m_rootEngine)) {
+		m_elevationXTiles = (std::uint16_t)((((std::uint32_t)m_xsize) + ELEVATION_TILE - 1) / ELEVATION_TILE);
+		m_elevationTileCount = (size_t)m_elevationXTiles * (size_t)((((std::uint32_t)m_ysize) + ELEVATION_TILE - 1) / ELEVATION_TILE);
+		try {
+			m_elevationTiles = new std::atomic<float *>[m_elevationTileCount];
+			for (size_t i = 0; i < m_elevationTileCount; i++)
+				m_elevationTiles[i] = nullptr;
+		} catch (std::bad_alloc &) {
+			m_elevationTiles = nullptr;
+		}
+	}
+}
+
+
+// the most memory the elevation cache can grow to, every tile filled in.  It's shared by every layer, but any one simulation can fill it, so
+// it's charged against each cache's budget
+std::uint64_t CCWFGM_WeatherGrid::elevationCacheBytes() const {
+	if ((m_xsize == (std::uint16_t)-1) || (m_ysize == (std::uint16_t)-1))
+		return 0;
+	const std::uint64_t tiles = ((((std::uint64_t)m_xsize) + ELEVATION_TILE - 1) / ELEVATION_TILE) * ((((std::uint64_t)m_ysize) + ELEVATION_TILE - 1) / ELEVATION_TILE);
+	return tiles * (sizeof(std::atomic<float *>) + ELEVATION_TILE * ELEVATION_TILE * sizeof(float));
+}
+
+
+void CCWFGM_WeatherGrid::clearElevationCache() {
+	CRWThreadSemaphoreEngage engage(m_elevationLock, SEM_TRUE);
+	if (m_elevationTiles) {
+		for (size_t i = 0; i < m_elevationTileCount; i++)
+			free(m_elevationTiles[i].load());
+		delete [] m_elevationTiles;
+		m_elevationTiles = nullptr;
+	}
+}
+
+
+// returns the elevation tile holding cell (x, y), filling it in if this is the first time it's been asked for, m_elevationLock must be held
+// (shared is enough: if two threads fill the same tile at once, the second one just throws its copy away)
+float *CCWFGM_WeatherGrid::elevationTile(std::uint16_t x, std::uint16_t y) {
+	std::atomic<float *> *slot = &m_elevationTiles[(size_t)(y / ELEVATION_TILE) * (size_t)m_elevationXTiles + (size_t)(x / ELEVATION_TILE)];
+	float *tile = slot->load(std::memory_order_acquire);
+	if (tile)
+		return tile;
+
+	float *t = (float *)malloc(ELEVATION_TILE * ELEVATION_TILE * sizeof(float));
+	if (!t)
+		return nullptr;
+
+	double elev, slope_factor, slope_azimuth;		// slope_factor, slope_azimuth are unused
+	grid::TerrainValue elev_valid, terrain_valid;
+	XY_Point pt;
+	const std::uint16_t x0 = x - (x % ELEVATION_TILE), y0 = y - (y % ELEVATION_TILE);
+	float *c = t;
+	for (std::uint16_t j = 0; j < ELEVATION_TILE; j++) {
+		pt.y = invertY(((double)(y0 + j)) + 0.5);
+		for (std::uint16_t i = 0; i < ELEVATION_TILE; i++, c++) {
+			pt.x = invertX(((double)(x0 + i)) + 0.5);
+			if (((x0 + i) >= m_xsize) || ((y0 + j) >= m_ysize) ||
+			    FAILED(this->GetElevationData(0, pt, true, &elev, &slope_factor, &slope_azimuth, &elev_valid, &terrain_valid, nullptr)) ||
+			    (elev_valid == grid::TerrainValue::NOT_SET) || (terrain_valid == grid::TerrainValue::NOT_SET))
+				*c = std::numeric_limits<float>::quiet_NaN();	// let the query go through the grid so the error is reported the same way
+			else
+				*c = (float)elev;
+		}
+	}
+
+	if (slot->compare_exchange_strong(tile, t, std::memory_order_acq_rel))
+		return t;
+	free(t);
+	return tile;
+}
+
+
+HRESULT CCWFGM_WeatherGrid::getElevation(const XY_Point &pt, std::uint16_t x, std::uint16_t y, double *elev, bool *elev_valid) {
+	if ((x < m_xsize) && (y < m_ysize)) {
+		CRWThreadSemaphoreEngage engage(m_elevationLock, SEM_FALSE);
+		float *tile;
+		if ((m_elevationTiles) && (tile = elevationTile(x, y))) {
+			float e = tile[(y % ELEVATION_TILE) * ELEVATION_TILE + (x % ELEVATION_TILE)];
+			if (!std::isnan(e)) {
+				*elev = e;
+				*elev_valid = true;
+				return S_OK;
+			}
+		}
+	}
+
+	double slope_factor, slope_azimuth;		// slope_factor, slope_azimuth are unused
+	grid::TerrainValue e_valid, terrain_valid;
+	HRESULT hr = this->GetElevationData(0, pt, true, elev, &slope_factor, &slope_azimuth, &e_valid, &terrain_valid, nullptr);
+	*elev_valid = (e_valid != grid::TerrainValue::NOT_SET) && (terrain_valid != grid::TerrainValue::NOT_SET);
+	return hr;
+}
+
+
+// walks a stream's events from one end of its data to the other, in both directions, recording every time it reports
+static bool streamEventTimes(CCWFGM_WeatherStream *stream, WTimeManager *tm, std::vector<std::uint64_t> &forward, std::vector<std::uint64_t> &backward, std::uint64_t *start, std::uint64_t *end) {
+	WTime s(tm);
+	WTimeSpan duration;
+	if (FAILED(stream->GetValidTimeRange(&s, &duration)))
+		return false;
+	WTime e(s + duration);
+	if (e <= s)
+		return false;
+
+	WTime from(s), limit(e + WTimeSpan(1, 0, 0, 0));
+	while (from < e) {
+		WTime next(limit);
+		stream->GetEventTime(CWFGM_GETEVENTTIME_FLAG_SEARCH_FORWARD, from, &next);
+		if ((next >= limit) || (next <= from))
+			break;
+		forward.push_back(next.GetTotalMicroSeconds());
+		from = next;
+	}
+
+	from = e - WTimeSpan(0, 0, 0, 1);				// e itself is past the end of the data
+	limit = s - WTimeSpan(1, 0, 0, 0);
+	while (from > s) {
+		WTime next(limit);
+		stream->GetEventTime(CWFGM_GETEVENTTIME_FLAG_SEARCH_BACKWARD, from, &next);
+		if ((next <= limit) || (next >= from))
+			break;
+		backward.push_back(next.GetTotalMicroSeconds());
+		from = next;
+	}
+
+	*start = s.GetTotalMicroSeconds();
+	*end = e.GetTotalMicroSeconds();
+	return true;
+}
+
+
+static void sortEventTimes(std::vector<std::uint64_t> &events) {
+	std::sort(events.begin(), events.end());
+	events.erase(std::unique(events.begin(), events.end()), events.end());
+}
+
+
+// merges the events for every stream into one sorted list so GetEventTime doesn't have to ask every stream on every call,
+// if any stream can't report its events then we don't build it and GetEventTime asks the streams directly
+void CCWFGM_WeatherGrid::buildEventTimeline() {
+	m_timelineLock.Lock();
+	if ((!m_timeline) && (m_streamList.GetCount())) {
+		std::shared_ptr<GEventTimeline> tl = std::make_shared<GEventTimeline>();
+		tl->start = tl->primaryStart = 0;
+		tl->generation = streamGeneration();
+		tl->end = tl->primaryEnd = 0;
+		bool first = true, success = true;
+		GStreamNode *node = m_streamList.LH_Head();
+		while (node->LN_Succ()) {
+			std::vector<std::uint64_t> forward, backward;
+			std::uint64_t start, end;
+			if (!streamEventTimes(node->m_stream.get(), m_timeManager, forward, backward, &start, &end)) {
+				success = false;
+				break;
+			}
+			if (node->m_stream == m_primaryStream) {
+				tl->primaryForward = forward;
+				tl->primaryBackward = backward;
+				tl->primaryStart = start;
+				tl->primaryEnd = end;
+			}
+			tl->forward.insert(tl->forward.end(), forward.begin(), forward.end());
+			tl->backward.insert(tl->backward.end(), backward.begin(), backward.end());
+			if (first) {
+				tl->start = start;
+				tl->end = end;
+				first = false;
+			} else {
+				if (start > tl->start)
+					tl->start = start;
+				if (end < tl->end)
+					tl->end = end;
+			}
+			node = (GStreamNode *)node->LN_Succ();
+		}
+		if (success) {
+			sortEventTimes(tl->forward);
+			sortEventTimes(tl->backward);
+			sortEventTimes(tl->primaryForward);
+			sortEventTimes(tl->primaryBackward);
+			m_timeline = tl;
+		}
+	}
+	m_timelineLock.Unlock();
+}
+
+
+void CCWFGM_WeatherGrid::clearEventTimeline() {
+	m_timelineLock.Lock();
+	m_timeline.reset();
+	m_timelineLock.Unlock();
+}
+
+
+// sum of every stream's cache generation, which changes whenever any stream's data is edited
+std::uint64_t CCWFGM_WeatherGrid::streamGeneration() {
+	std::uint64_t generation = 0;
+	GStreamNode *node = m_streamList.LH_Head();
+	while (node->LN_Succ()) {
+		generation += node->m_stream->CacheGeneration();
+		node = (GStreamNode *)node->LN_Succ();
+	}
+	return generation;
+}
+
+
+// answers a stream event query from the merged timeline, returns false if the query has to go to the streams because
+// some stream doesn't have data for from_time
+bool CCWFGM_WeatherGrid::timelineEventTime(std::uint32_t flags, const WTime &from_time, WTime *next_event) {
+	m_timelineLock.Lock();
+	std::shared_ptr<const GEventTimeline> tl = m_timeline;	// our own reference, so it can be dropped while we're using it
+	m_timelineLock.Unlock();
+	if (!tl)
+		return false;
+	if (tl->generation != streamGeneration()) {
+		clearEventTimeline();					// a stream has been edited since it was built
+		return false;
+	}
+
+	const bool primary = (flags & CWFGM_GETEVENTTIME_QUERY_PRIMARY_WX_STREAM) ? true : false;
+	if ((primary) && (tl->primaryStart == tl->primaryEnd))
+		return false;						// no primary stream
+	const std::uint64_t from = from_time.GetTotalMicroSeconds();
+	if ((from < (primary ? tl->primaryStart : tl->start)) || (from >= (primary ? tl->primaryEnd : tl->end)))
+		return false;
+	if ((flags & CWFGM_GETEVENTTIME_FLAG_SEARCH_BACKWARD) && (from == (primary ? tl->primaryStart : tl->start)))
+		return false;						// nothing earlier in the timeline, leave the edge to the streams
+
+	if (flags & CWFGM_GETEVENTTIME_FLAG_SEARCH_BACKWARD) {
+		const std::vector<std::uint64_t> &events = primary ? tl->primaryBackward : tl->backward;
+		auto it = std::lower_bound(events.begin(), events.end(), from);
+		if (it != events.begin()) {
+			WTime event(*(--it), m_timeManager, false);
+			if (event > *next_event)
+				next_event->SetTime(event);
+		}
+	} else {
+		const std::vector<std::uint64_t> &events = primary ? tl->primaryForward : tl->forward;
+		auto it = std::upper_bound(events.begin(), events.end(), from);
+		if (it != events.end()) {
+			WTime event(*it, m_timeManager, false);
+			if (event < *next_event)
+				next_event->SetTime(event);
+		}
+	}
+	return true;
+}
+
+
+// opens the disk cache on first use, cell elevations aren't part of the hash since they're checked record by record.  The caller has to hold
+// m_diskLock shared for as long as it uses what's returned.
+WeatherDiskCache *CCWFGM_WeatherGrid::diskCache() {
+	WeatherDiskCache *disk = m_diskCache.load(std::memory_order_acquire);
+	if (disk)
+		return disk;
+	if (!m_diskCachePath.length())
+		return nullptr;
+
+	m_diskOpenLock.Lock();
+	if (!(disk = m_diskCache.load(std::memory_order_relaxed))) {
+		std::uint64_t h = WeatherDiskCache::HashSeed;
+		h = WeatherDiskCache::Hash(h, (std::uint64_t)m_xsize);
+		h = WeatherDiskCache::Hash(h, (std::uint64_t)m_ysize);
+		h = WeatherDiskCache::Hash(h, m_converter.resolution());
+		h = WeatherDiskCache::Hash(h, m_converter.xllcorner());
+		h = WeatherDiskCache::Hash(h, m_converter.yllcorner());
+		h = WeatherDiskCache::Hash(h, m_idwExponentTemp);
+		h = WeatherDiskCache::Hash(h, m_idwExponentWS);
+		h = WeatherDiskCache::Hash(h, m_idwExponentPrecip);
+		h = WeatherDiskCache::Hash(h, (std::uint64_t)m_latticeSpacing);
+		h = WeatherDiskCache::Hash(h, m_latticeTolerance);
+		h = WeatherDiskCache::Hash(h, m_latticeToleranceWind);
+		h = WeatherDiskCache::Hash(h, m_latticeTolerancePrecip);
+		GStreamNode *node = m_streamList.LH_Head();
+		while (node->LN_Succ()) {
+			h = WeatherDiskCache::Hash(h, node->m_location.x);
+			h = WeatherDiskCache::Hash(h, node->m_location.y);
+			h = WeatherDiskCache::Hash(h, node->m_elevation);
+			node = (GStreamNode *)node->LN_Succ();
+		}
+
+		try {
+			disk = new WeatherDiskCache(m_diskCachePath, h, m_xsize, m_ysize,
+				[this](const WTime &time, std::uint64_t interpolate_method) { return diskContentHash(time, interpolate_method); });
+			m_diskCache.store(disk, std::memory_order_release);
+		} catch (std::bad_alloc &) {
+		}
+	}
+	m_diskOpenLock.Unlock();
+	return disk;
+}
+
+
+// hashes what changes from one time to the next in the disk cache key: the primary stream's values, and each station's values
+// (which are all the kernels read from the streams)
+std::uint64_t CCWFGM_WeatherGrid::diskContentHash(const HSS_Time::WTime &time, std::uint64_t interpolate_method) {
+	std::uint64_t h = WeatherDiskCache::Hash(WeatherDiskCache::HashSeed, interpolate_method);
+
+	IWXData wx;
+	HRESULT hr = m_primaryStream->GetInstantaneousValues(time, interpolate_method, &wx, NULL, NULL);
+	h = WeatherDiskCache::Hash(h, (std::uint64_t)hr);
+	if (SUCCEEDED(hr))
+		h = WeatherDiskCache::Hash(h, wx);
+
+	GStreamNode *node = m_streamList.LH_Head();
+	while (node->LN_Succ()) {
+		GStreamWxData data;
+		hr = node->GetStationValues(time, interpolate_method, &data);
+		h = WeatherDiskCache::Hash(h, (std::uint64_t)hr);
+		if (SUCCEEDED(hr))
+			h = WeatherDiskCache::Hash(h, data.wx);
+		node = (GStreamNode *)node->LN_Succ();
+	}
+	return h;
+}
+
+
+// waits for anyone still using the disk cache before closing it
+void CCWFGM_WeatherGrid::clearDiskCache() {
+	CRWThreadSemaphoreEngage engage(m_diskLock, SEM_TRUE);
+	delete m_diskCache.exchange(nullptr);
+}
+
+
+#define STATION_KEY_MASK	(CWFGM_GETWEATHER_INTERPOLATE_TEMPORAL | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL) | \
+			 (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND) | \
+			 (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP))	// what stationWx() and the station kernels depend on
+#define HOURLY_KEY_TAG	(1ull << 63)		// not a scenario option, marks layer cache entries holding hourlyStationWx() values
+
+
+// relative humidity from temperature and dew point temperature, clipped to [0, 1], as GetRawWxValues calculates it
+static double dewPointRH(double temperature, double dewPointTemperature) {
+	double VP  = 0.6112 * pow(10.0, 7.5 * dewPointTemperature / (237.7 + dewPointTemperature));
+	double VPs = 0.6112 * pow(10.0, 7.5 * temperature / (237.7 + temperature));
+	double rh = VP / VPs;
+	return (rh < 0.0) ? 0.0 : (rh > 1.0) ? 1.0 : rh;
+}
+
+
+// blends the weather at the start of two consecutive hours the same way WeatherCondition::GetInstantaneousValues blends hourly
+// station observations
+static void blendHourlyWeather(const IWXData &wx1, const IWXData &wx2, double perc2, bool first_half, IWXData *wx) {
+	const double perc1 = 1.0 - perc2;
+
+	wx->Temperature = wx1.Temperature * perc1 + wx2.Temperature * perc2;
+	wx->DewPointTemperature = wx1.DewPointTemperature * perc1 + wx2.DewPointTemperature * perc2;
+	wx->RH = wx1.RH * perc1 + wx2.RH * perc2;
+	wx->Precipitation = wx2.Precipitation * perc2;
+
+	const bool bb1 = ((wx1.WindSpeed < 0.0001) && (wx1.WindDirection < 0.0001));
+	const bool bb2 = ((wx2.WindSpeed < 0.0001) && (wx2.WindDirection < 0.0001));
+	double wd_diff = NORMALIZE_ANGLE_RADIAN(wx2.WindDirection - wx1.WindDirection);
+	const bool opposed = ((wx1.WindSpeed >= 0.0001) && (wx2.WindSpeed >= 0.0001) && ((wd_diff < DEGREE_TO_RADIAN(181.0)) && (wd_diff > DEGREE_TO_RADIAN(179.0))));
+
+	if (bb1)		wx->WindDirection = wx2.WindDirection;	// dead calm at the start of the hour so no interp on wd
+	else if (bb2)		wx->WindDirection = wx1.WindDirection;
+	else if (opposed)	wx->WindDirection = first_half ? wx1.WindDirection : wx2.WindDirection;
+	else {
+		if (wd_diff > CONSTANTS_NAMESPACE::Pi<double>())
+			wd_diff -= CONSTANTS_NAMESPACE::TwoPi<double>();
+		wx->WindDirection = NORMALIZE_ANGLE_RADIAN(wx2.WindDirection - perc1 * wd_diff);
+	}
+
+	if (opposed)		wx->WindSpeed = first_half ? wx1.WindSpeed : wx2.WindSpeed;
+	else			wx->WindSpeed = wx1.WindSpeed * perc1 + wx2.WindSpeed * perc2;
+
+	wx->SpecifiedBits = (wx1.SpecifiedBits | wx2.SpecifiedBits) & (IWXDATA_SPECIFIED_INTERPOLATED | IWXDATA_OVERRODE_ALL | IWXDATA_OVERRODEHISTORY_ALL);
+	if ((wx1.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) && (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST)) {
+		wx->WindGust = wx1.WindGust * perc1 + wx2.WindGust * perc2;
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_WINDGUST;
+	}
+	else
+		wx->WindGust = -1.0;
+}
+
+
+// finds the station nearest to pt and records its values, the nearest station values are what's used for voronoi
+// interpolation so they can't be upsampled from a lattice
+HRESULT CCWFGM_WeatherGrid::nearestStation(const WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, GStationSums *sums) {
+	XY_Point pt2(pt.x, pt.y);
+	GStreamNode *sn = m_streamList.LH_Head(), *nearest = nullptr;
+	while (sn->LN_Succ()) {
+		double d = sn->m_location.DistanceToSquared(pt2);
+		if (d < sums->nearest_d) {
+			sums->nearest_d = d;
+			nearest = sn;
+		}
+		sn = (GStreamNode *)sn->LN_Succ();
+	}
+	if (!nearest)
+		return S_OK;
+
+	GStreamWxData sw;
+	HRESULT hr = nearest->GetStationValues(time, interpolate_method, &sw);
+	if (FAILED(hr))
+		return hr;
+	sums->nearest_precip = sw.wx.Precipitation;
+	sums->nearest_wd = sw.wx.WindDirection;
+	sums->nearest_ws = sw.wx.WindSpeed;
+	if (sw.wx.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST)
+		sums->nearest_gust = sw.wx.WindGust;
+	return hr;
+}
+
+
+// IDW normalized station values at a lattice node
+HRESULT CCWFGM_WeatherGrid::latticeNode(const WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t kernel, GLatticeValues *lv) {
+	IWXData wx;
+	wx.Temperature = wx.DewPointTemperature = wx.Precipitation = 0.0;
+	GStationSums sums;
+	HRESULT hr = (this->*m_stationKernels[kernel])(time, pt, interpolate_method, &wx, &sums);
+	if (FAILED(hr))
+		return hr;
+
+	const double wt = (sums.weight_temp != 0.0) ? sums.weight_temp : 1.0;
+	const double wws = (sums.weight_ws != 0.0) ? sums.weight_ws : 1.0;
+	const double wgust = (sums.weight_gust != 0.0) ? sums.weight_gust : 1.0;
+	const double wprecip = (sums.weight_precip != 0.0) ? sums.weight_precip : 1.0;
+	lv->temperature = wx.Temperature / wt;
+	lv->dewPointTemperature = wx.DewPointTemperature / wt;
+	lv->UALR = sums.wx__UALR / wt;
+	lv->SALR = sums.wx__SALR / wt;
+	lv->ws = sums.wx_WindSpeed / wws;
+	lv->wind_u = sums.wind_vector.x / wws;
+	lv->wind_v = sums.wind_vector.y / wws;
+	lv->gust = sums.wx_WindGust / wgust;
+	lv->gust_u = sums.gust_vector.x / wgust;
+	lv->gust_v = sums.gust_vector.y / wgust;
+	lv->precipitation = wx.Precipitation / wprecip;
+	lv->wind_cnt = sums.wind_cnt;
+	lv->gust_cnt = sums.gust_cnt;
+	return hr;
+}
+
+
+static void bilinearLattice(const GLatticeBlock *block, double fx, double fy, GLatticeValues *lv) {
+	const double w0 = (1.0 - fx) * (1.0 - fy), w1 = fx * (1.0 - fy), w2 = (1.0 - fx) * fy, w3 = fx * fy;
+	const GLatticeValues *c = block->corner;
+	#define BILINEAR(f)	lv->f = c[0].f * w0 + c[1].f * w1 + c[2].f * w2 + c[3].f * w3
+	BILINEAR(temperature);
+	BILINEAR(dewPointTemperature);
+	BILINEAR(UALR);
+	BILINEAR(SALR);
+	BILINEAR(ws);
+	BILINEAR(gust);
+	BILINEAR(wind_u);
+	BILINEAR(wind_v);
+	BILINEAR(gust_u);
+	BILINEAR(gust_v);
+	BILINEAR(precipitation);
+	#undef BILINEAR
+	lv->wind_cnt = c[0].wind_cnt;				// same at every point, they only depend on which stations report
+	lv->gust_cnt = c[0].gust_cnt;
+}
+
+
+// whether the upsampled values at a point are within tolerance of the values interpolated directly there, each variable against
+// the tolerance for its units
+static bool latticeWithinTolerance(const GLatticeValues &exact, const GLatticeValues &upsampled, double tolTemp, double tolWind, double tolPrecip) {
+	if ((fabs(exact.temperature - upsampled.temperature) > tolTemp) ||
+	    (fabs(exact.dewPointTemperature - upsampled.dewPointTemperature) > tolTemp))
+		return false;
+	if ((fabs(exact.ws - upsampled.ws) > tolWind) ||
+	    (fabs(exact.gust - upsampled.gust) > tolWind) ||
+	    (fabs(exact.wind_u - upsampled.wind_u) > tolWind) ||
+	    (fabs(exact.wind_v - upsampled.wind_v) > tolWind) ||
+	    (fabs(exact.gust_u - upsampled.gust_u) > tolWind) ||
+	    (fabs(exact.gust_v - upsampled.gust_v) > tolWind))
+		return false;
+	return (fabs(exact.precipitation - upsampled.precipitation) <= tolPrecip);
+}
+
+
+// calculates the corners of a lattice block, then decides whether the block can be upsampled.  IDW peaks at the stations, so a block
+// holding a station is always calculated per cell.  Otherwise the upsampled values at the block's center and edge midpoints are checked
+// against the values interpolated directly there, and if any are further apart than the tolerances then the block is calculated per cell.
+HRESULT CCWFGM_WeatherGrid::latticeBlock(const WTime &time, std::uint16_t bx, std::uint16_t by, std::uint64_t interpolate_method, std::uint32_t kernel, GLatticeBlock *block) {
+	const double s = (double)m_latticeSpacing;
+	HRESULT hr;
+	for (std::uint16_t i = 0; i < 4; i++) {
+		XY_Point node(invertX(((double)(bx + (i & 1))) * s + 0.5), invertY(((double)(by + (i >> 1))) * s + 0.5));
+		if (FAILED(hr = latticeNode(time, node, interpolate_method, kernel, &block->corner[i])))
+			return hr;
+	}
+
+	const double x0 = invertX((double)bx * s), x1 = invertX((double)(bx + 1) * s);
+	const double y0 = invertY((double)by * s), y1 = invertY((double)(by + 1) * s);
+	GStreamNode *sn = m_streamList.LH_Head();
+	while (sn->LN_Succ()) {
+		if ((sn->m_location.x >= x0) && (sn->m_location.x < x1) && (sn->m_location.y >= y0) && (sn->m_location.y < y1)) {
+			block->refined = true;
+			return S_OK;
+		}
+		sn = (GStreamNode *)sn->LN_Succ();
+	}
+
+	static const double samples[5][2] = { { 0.5, 0.5 }, { 0.5, 0.0 }, { 0.0, 0.5 }, { 1.0, 0.5 }, { 0.5, 1.0 } };
+	for (std::uint16_t i = 0; i < 5; i++) {
+		GLatticeValues exact, upsampled;
+		XY_Point sample(invertX(((double)bx + samples[i][0]) * s + 0.5), invertY(((double)by + samples[i][1]) * s + 0.5));
+		if (FAILED(hr = latticeNode(time, sample, interpolate_method, kernel, &exact)))
+			return hr;
+		bilinearLattice(block, samples[i][0], samples[i][1], &upsampled);
+		if (!latticeWithinTolerance(exact, upsampled, m_latticeTolerance, m_latticeToleranceWind, m_latticeTolerancePrecip)) {
+			block->refined = true;
+			return hr;
+		}
+	}
+	block->refined = false;
+	return S_OK;
+}
+
+
+// fills the IDW sums for pt by bilinearly upsampling the lattice block containing it, or directly for blocks that have been
+// refined, the sums are left normalized (weights of 1) so GetRawWxValues finishes them exactly as it would otherwise.  Sets are picked
+// by the hour so the last few hours are kept without searching, and a set is only used while no stream has been edited since it was
+// handed to its hour.  Blocks are published lock-free while m_latticeLock is held shared, the same as the elevation tiles.
+HRESULT CCWFGM_WeatherGrid::latticeSums(const WTime &time, const XY_Point &pt, std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, std::uint32_t kernel, IWXData *wx, GStationSums *sums) {
+	const std::uint16_t bx = x / m_latticeSpacing, by = y / m_latticeSpacing;
+	const std::uint32_t xblocks = ((std::uint32_t)m_xsize + m_latticeSpacing - 1) / m_latticeSpacing;
+	const std::uint32_t index = (std::uint32_t)by * xblocks + bx;
+	const std::uint64_t t = time.GetTotalMicroSeconds();
+	const std::uint64_t method = interpolate_method & STATION_KEY_MASK;	// FWI, history and cache options don't change the station sums
+	const std::uint64_t generation = streamGeneration();
+	const std::uint32_t slot = (std::uint32_t)((t / (60ull * 60ull * 1000000ull)) % LATTICE_SETS);
+
+	GLatticeBlock block;
+	HRESULT hr;
+	for (;;) {
+		{
+			CRWThreadSemaphoreEngage engage(m_latticeLock, SEM_FALSE);
+			const GLatticeSet *set = (m_lattice) ? &m_lattice[slot] : nullptr;
+			if ((set) && (set->time == t) && (set->interpolate_method == method) && (set->generation == generation)) {
+				std::atomic<GLatticeBlock *> *b = &set->blocks[index];
+				GLatticeBlock *p = b->load(std::memory_order_acquire);
+				if (!p) {				// if two threads calculate the same block at once, the second one just throws its copy away
+					GLatticeBlock *nb = new GLatticeBlock;
+					if (FAILED(hr = latticeBlock(time, bx, by, interpolate_method, kernel, nb))) {
+						delete nb;
+						return hr;
+					}
+					if (b->compare_exchange_strong(p, nb, std::memory_order_acq_rel))
+						p = nb;
+					else
+						delete nb;
+				}
+				block = *p;
+				break;
+			}
+		}
+		claimLatticeSet(slot, t, method, generation);
+	}
+
+	if (block.refined)
+		return (this->*m_stationKernels[kernel])(time, pt, interpolate_method, wx, sums);
+
+	const double s = (double)m_latticeSpacing;
+	const double x0 = invertX((double)bx * s + 0.5), x1 = invertX((double)(bx + 1) * s + 0.5);
+	const double y0 = invertY((double)by * s + 0.5), y1 = invertY((double)(by + 1) * s + 0.5);
+	GLatticeValues lv;
+	bilinearLattice(&block, (pt.x - x0) / (x1 - x0), (pt.y - y0) / (y1 - y0), &lv);
+
+	if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) {
+		wx->Temperature = lv.temperature;
+		wx->DewPointTemperature = lv.dewPointTemperature;
+		sums->wx__UALR = lv.UALR;
+		sums->wx__SALR = lv.SALR;
+		sums->weight_temp = 1.0;
+	}
+	if ((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) && (m_idwExponentWS != 0.0)) {
+		sums->wx_WindSpeed = lv.ws;
+		sums->wind_vector.x = lv.wind_u;
+		sums->wind_vector.y = lv.wind_v;
+		sums->weight_ws = 1.0;
+		sums->wind_cnt = lv.wind_cnt;
+		if (lv.gust_cnt) {
+			sums->wx_WindGust = lv.gust;
+			sums->gust_vector.x = lv.gust_u;
+			sums->gust_vector.y = lv.gust_v;
+			sums->weight_gust = 1.0;
+			sums->gust_cnt = lv.gust_cnt;
+		}
+	}
+	if ((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) && (m_idwExponentPrecip != 0.0)) {
+		wx->Precipitation = lv.precipitation;
+		sums->weight_precip = 1.0;
+	}
+	return nearestStation(time, pt, interpolate_method, sums);
+}
+
+
+// hands a lattice set to another hour (or interpolation method, or stream edit), dropping the blocks it had, allocating the sets the first time
+void CCWFGM_WeatherGrid::claimLatticeSet(std::uint32_t slot, std::uint64_t time, std::uint64_t interpolate_method, std::uint64_t generation) {
+	CRWThreadSemaphoreEngage engage(m_latticeLock, SEM_TRUE);
+	if (!m_lattice) {
+		const std::uint32_t xblocks = ((std::uint32_t)m_xsize + m_latticeSpacing - 1) / m_latticeSpacing;
+		const std::uint32_t yblocks = ((std::uint32_t)m_ysize + m_latticeSpacing - 1) / m_latticeSpacing;
+		m_latticeBlocks = xblocks * yblocks;
+		m_lattice = new GLatticeSet[LATTICE_SETS];
+		for (std::uint32_t i = 0; i < LATTICE_SETS; i++) {
+			m_lattice[i].time = m_lattice[i].interpolate_method = m_lattice[i].generation = (std::uint64_t)-1;
+			m_lattice[i].blocks = new std::atomic<GLatticeBlock *>[m_latticeBlocks];
+			for (std::uint32_t j = 0; j < m_latticeBlocks; j++)
+				m_lattice[i].blocks[j].store(nullptr, std::memory_order_relaxed);
+		}
+	}
+
+	GLatticeSet *set = &m_lattice[slot];
+	if ((set->time == time) && (set->interpolate_method == interpolate_method) && (set->generation == generation))
+		return;						// another thread got here first
+	for (std::uint32_t j = 0; j < m_latticeBlocks; j++)
+		delete set->blocks[j].exchange(nullptr, std::memory_order_relaxed);
+	set->time = time;
+	set->interpolate_method = interpolate_method;
+	set->generation = generation;
+}
+
+
+void CCWFGM_WeatherGrid::clearLattice() {
+	CRWThreadSemaphoreEngage engage(m_latticeLock, SEM_TRUE);
+	if (m_lattice) {
+		for (std::uint32_t i = 0; i < LATTICE_SETS; i++) {
+			for (std::uint32_t j = 0; j < m_latticeBlocks; j++)
+				delete m_lattice[i].blocks[j].load(std::memory_order_relaxed);
+			delete [] m_lattice[i].blocks;
+		}
+		delete [] m_lattice;
+		m_lattice = nullptr;
+		m_latticeBlocks = 0;
+	}
+}
+
+
+// the most the lattice can hold, every block of every set, which is what's charged against a cache budget
+std::uint64_t CCWFGM_WeatherGrid::latticeCacheBytes() const {
+	if ((m_latticeSpacing <= 1) || (m_xsize == (std::uint16_t)-1) || (m_ysize == (std::uint16_t)-1))
+		return 0;
+	const std::uint64_t blocks = ((((std::uint64_t)m_xsize) + m_latticeSpacing - 1) / m_latticeSpacing) * ((((std::uint64_t)m_ysize) + m_latticeSpacing - 1) / m_latticeSpacing);
+	return LATTICE_SETS * (sizeof(GLatticeSet) + blocks * (sizeof(std::atomic<GLatticeBlock *>) + sizeof(GLatticeBlock)));
+}
+
+
+void CCWFGM_WeatherGrid::clearStationValues() {
+	GStreamNode *node = m_streamList.LH_Head();
+	while (node->LN_Succ()) {
+		node->ClearStationValues();
+		node = (GStreamNode *)node->LN_Succ();
+	}
+}
+
+#endif
+
+
 HRESULT CCWFGM_WeatherGrid::MT_Lock(Layer *layerThread, bool exclusive, std::uint16_t obtain) {
 	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
 	if (!gridEngine)	{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
@@ -145,6 +979,9 @@ HRESULT CCWFGM_WeatherGrid::PutGridEngine(Layer *layerThread, ICWFGM_GridEngine
 			boost::intrusive_ptr<ICWFGM_GridEngine> pGridEngine;
 			pGridEngine = dynamic_cast<ICWFGM_GridEngine *>(const_cast<ICWFGM_GridEngine *>(newVal));
 			if (pGridEngine.get()) {
+				clearElevationCache();
+				clearDiskCache();
+				clearLattice();				// sized for the old grid
 				m_rootEngine = pGridEngine;
 				fixResolution();
 				pGridEngine->GetDimensions(0, &m_xsize, &m_ysize);
@@ -152,6 +989,9 @@ HRESULT CCWFGM_WeatherGrid::PutGridEngine(Layer *layerThread, ICWFGM_GridEngine
 			}
 			return E_FAIL;
 		} else {
+			clearElevationCache();
+			clearDiskCache();
+			clearLattice();
 			m_rootEngine = NULL;
 			return S_OK;
 		}
@@ -210,6 +1050,10 @@ HRESULT CCWFGM_WeatherGrid::put_PrimaryStream(CCWFGM_WeatherStream *stream) {
 			return ERROR_WEATHER_STREAM_UNKNOWN;
 	}
 	m_primaryStream = stream;
+	clearStationValues();				// daily rain totals depend on the primary stream
+	clearEventTimeline();
+	clearDiskCache();
+	clearLattice();
 	return S_OK;
 }
 
@@ -244,6 +1088,9 @@ HRESULT CCWFGM_WeatherGrid::AddStream(CCWFGM_WeatherStream *stream) {
 		} catch (std::bad_alloc& cme) {
 			return E_OUTOFMEMORY;
 		}
+		clearEventTimeline();
+		clearDiskCache();
+		clearLattice();
 
 		return S_OK;
 	}
@@ -266,6 +1113,9 @@ HRESULT CCWFGM_WeatherGrid::RemoveStream(CCWFGM_WeatherStream *stream) {
 				m_primaryStream = NULL;
 			m_streamList.Remove(node);
 			delete node;
+			clearEventTimeline();
+			clearDiskCache();
+			clearLattice();
 			return S_OK;
 		}
 		node = (GStreamNode *)node->LN_Succ();
@@ -274,6 +1124,15 @@ HRESULT CCWFGM_WeatherGrid::RemoveStream(CCWFGM_WeatherStream *stream) {
 }
 
 
+HRESULT CCWFGM_WeatherGrid::GetTooCloseStreams(std::vector<std::pair<std::uint32_t, std::uint32_t>> *pairs) {
+	if (!pairs)									return E_POINTER;
+
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_FALSE);
+	*pairs = m_tooClose;
+	return S_OK;
+}
+
+
 HRESULT CCWFGM_WeatherGrid::StreamAtIndex(std::uint32_t index, boost::intrusive_ptr<CCWFGM_WeatherStream> *stream) {
 	if (!stream)									return E_POINTER;
 
@@ -340,6 +1199,13 @@ HRESULT CCWFGM_WeatherGrid::Valid(Layer *layerThread, const HSS_Time::WTime &sta
 										// check here but only here) - we can't try to be smart and just
 										// compare against (e.g.) a flags field
 		}
+		if (m_lock.CurrentState() < 1000000LL) {
+			clearElevationCache();					// no simulation is using the snapshot and the underlying grid may have changed
+			clearEventTimeline();					// nor the timeline, and stream data may have been edited
+			clearStationValues();
+			clearDiskCache();
+			clearLattice();
+		}
 
 		if ((hr == ERROR_GRID_WEATHER_NOT_IMPLEMENTED) || (hr == ERROR_GRID_WEATHER_INVALID_DATES)) {
 
@@ -432,29 +1298,52 @@ HSS_PRAGMA_GCC(GCC diagnostic ignored "-Wunused-but-set-variable")
 				if (node->m_elevation == 0.0)
 					node->m_Pe = P0;
 				else	node->m_Pe = P0 * pow(T0 / (T0 + L0 * node->m_elevation), power);	// equation 10 from Neal's document
+				node->ClearStationValues();							// lapse rates depend on m_Pe, m_elevation
 
 				node = (GStreamNode *)node->LN_Succ();
 			}
 
-			node = m_streamList.LH_Head();
-			while (node->LN_Succ()) {
-				boost::intrusive_ptr<CCWFGM_WeatherStation> station = nullptr;
-				node->m_stream->get_WeatherStation(&station);
-				boost::intrusive_ptr<CCWFGM_WeatherStation> st = station;
-				n2 = (GStreamNode *)node->LN_Succ();
-				while (n2->LN_Succ()) {
-					boost::intrusive_ptr<CCWFGM_WeatherStation> station2;
-					n2->m_stream->get_WeatherStation(&station2);
-					if (st == station2)
-						return ERROR_GRID_WEATHER_STATION_ALREADY_PRESENT;
-					weak_assert(m_converter.resolution() > 0.0);
-					double dist = n2->m_location.DistanceTo(node->m_location) * m_converter.resolution();
-					if (dist <= 100.0) {
-						return ERROR_GRID_WEATHERSTATIONS_TOO_CLOSE;
-					}
-					n2 = (GStreamNode *)n2->LN_Succ();
+			// bucket the stations into squares of 100m so each station only has to be compared against the stations in its own
+			// and the neighbouring squares
+			{
+				weak_assert(m_converter.resolution() > 0.0);
+				const double bucket = 100.0 / m_converter.resolution();
+				std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> buckets;
+				std::vector<GStreamNode *> nodes;
+				nodes.reserve(m_streamList.GetCount());
+				m_tooClose.clear();
+
+				node = m_streamList.LH_Head();
+				while (node->LN_Succ()) {
+					boost::intrusive_ptr<CCWFGM_WeatherStation> station;
+					node->m_stream->get_WeatherStation(&station);
+					const std::int32_t bx = (std::int32_t)floor(node->m_location.x / bucket);
+					const std::int32_t by = (std::int32_t)floor(node->m_location.y / bucket);
+					const std::uint32_t i = (std::uint32_t)nodes.size();
+
+					for (std::int32_t yy = by - 1; yy <= by + 1; yy++)
+						for (std::int32_t xx = bx - 1; xx <= bx + 1; xx++) {
+							auto it = buckets.find((((std::uint64_t)(std::uint32_t)xx) << 32) | (std::uint32_t)yy);
+							if (it == buckets.end())
+								continue;
+							for (std::uint32_t j : it->second) {
+								n2 = nodes[j];
+								boost::intrusive_ptr<CCWFGM_WeatherStation> station2;
+								n2->m_stream->get_WeatherStation(&station2);
+								if (station == station2)
+									return ERROR_GRID_WEATHER_STATION_ALREADY_PRESENT;
+								double dist = n2->m_location.DistanceTo(node->m_location) * m_converter.resolution();
+								if (dist <= 100.0)
+									m_tooClose.emplace_back(j, i);
+							}
+						}
+
+					buckets[(((std::uint64_t)(std::uint32_t)bx) << 32) | (std::uint32_t)by].push_back(i);
+					nodes.push_back(node);
+					node = (GStreamNode *)node->LN_Succ();
 				}
-				node = (GStreamNode *)node->LN_Succ();
+				if (m_tooClose.size())
+					return ERROR_GRID_WEATHERSTATIONS_TOO_CLOSE;
 			}
 
 			HSS_Time::WTime l_start_time(start_time, m_timeManager);
@@ -536,6 +1425,9 @@ HRESULT CCWFGM_WeatherGrid::GetEventTime(Layer *layerThread, const XY_Point& pt,
 	if (!(flags & (CWFGM_GETEVENTTIME_QUERY_PRIMARY_WX_STREAM | CWFGM_GETEVENTTIME_QUERY_ANY_WX_STREAM)))
 		hr = gridEngine->GetEventTime(layerThread, pt, flags, from_time, next_event, event_valid);
 
+	if (timelineEventTime(flags, from_time, next_event))
+		return hr;
+
 	WTime next_event1(m_timeManager);
 	std::uint32_t cnt = 0;
 	GStreamNode *node = m_streamList.LH_Head();
@@ -582,8 +1474,12 @@ HRESULT CCWFGM_WeatherGrid::PreCalculationEvent(Layer *layerThread, const HSS_Ti
 	}
 	else {
 		ClearCache(layerThread, (mode & (1 << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? true : false);
+		clearStationValues();
+		clearLattice();						// streams may have been edited since the last simulation
 	}
 	HRESULT hr = gridEngine->PreCalculationEvent(layerThread, time, mode, parms);
+	buildElevationCache();						// after the lower layers have had a chance to get themselves ready
+	buildEventTimeline();
 	return hr;
 }
 
@@ -601,6 +1497,7 @@ HRESULT CCWFGM_WeatherGrid::PostCalculationEvent(Layer *layerThread, const HSS_T
 	} else {
 		CRWThreadSemaphoreEngage engage(m_cacheLock, SEM_FALSE);
 		ClearCache(layerThread, (mode & (1 << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? true : false);
+		clearEventTimeline();					// streams may be edited before the next simulation
 	}
 
 	HRESULT hr = gridEngine->PostCalculationEvent(layerThread, time, mode, parms);
@@ -609,6 +1506,12 @@ HRESULT CCWFGM_WeatherGrid::PostCalculationEvent(Layer *layerThread, const HSS_T
 
 
 HRESULT CCWFGM_WeatherGrid::GetAttribute(Layer *layerThread, std::uint16_t option, /*unsigned*/ PolymorphicAttribute *value) {
+	if (option == CWFGM_WEATHER_OPTION_CACHE_STATS_REPORT) {
+		if (!value)							return E_POINTER;
+		*value = cacheStatsReport(layerThread);
+		return S_OK;
+	}
+
 	HRESULT hr = GetAttribute(option, value);
 	if (SUCCEEDED(hr))
 		return hr;
@@ -619,6 +1522,46 @@ HRESULT CCWFGM_WeatherGrid::GetAttribute(Layer *layerThread, std::uint16_t optio
 }
 
 
+// summarizes the statistics kept by this layer's caches, only listing the data types and tiers that have been used
+std::string CCWFGM_WeatherGrid::cacheStatsReport(Layer *layerThread) {
+	static const char *types[4] = { "WeatherData", "HIWXData", "HIFWIData", "HDFWIData" };
+	static const char *tiers[4] = { "day", "noon", "hour", "second" };
+
+	CRWThreadSemaphoreEngage engage(m_cacheLock, SEM_FALSE);
+
+	std::string report;
+	for (std::uint16_t cache = 0; cache < 2; cache++) {
+		WeatherCacheStats stats;
+		if (!CacheStats(layerThread, cache, &stats))
+			continue;
+		report += strprintf("cache %d: %llu evictions, %llu purges\n", (int)cache, (unsigned long long)stats.evictions, (unsigned long long)stats.purges);
+		for (std::uint16_t i = 0; i < 4; i++)
+			for (std::uint16_t j = 0; j < 4; j++)
+				if (stats.hits[i][j] || stats.misses[i][j] || stats.stores[i][j])
+					report += strprintf("  %s %s: %llu hits, %llu misses, %llu stores\n", types[i], tiers[j],
+						(unsigned long long)stats.hits[i][j], (unsigned long long)stats.misses[i][j], (unsigned long long)stats.stores[i][j]);
+		for (std::uint16_t i = 0; i < 4; i++)
+			if (stats.front[i])
+				report += strprintf("  %s: %llu front cache hits\n", types[i], (unsigned long long)stats.front[i]);
+	}
+
+	std::uint32_t index = 0;					// the streams' own caches are shared by every layer, and always counted
+	GStreamNode *node = m_streamList.LH_Head();
+	while (node->LN_Succ()) {
+		WeatherCacheStats stats;
+		node->m_stream->CacheStats(&stats);
+		for (std::uint16_t i = 0; i < 4; i++)
+			for (std::uint16_t j = 0; j < 4; j++)
+				if (stats.hits[i][j] || stats.misses[i][j] || stats.stores[i][j])
+					report += strprintf("stream %u: %s %s: %llu hits, %llu misses, %llu stores\n", index, types[i], tiers[j],
+						(unsigned long long)stats.hits[i][j], (unsigned long long)stats.misses[i][j], (unsigned long long)stats.stores[i][j]);
+		index++;
+		node = (GStreamNode *)node->LN_Succ();
+	}
+	return report;
+}
+
+
 HRESULT CCWFGM_WeatherGrid::GetAttributeData(Layer* layerThread, const XY_Point& pt, const HSS_Time::WTime& time, const HSS_Time::WTimeSpan& timeSpan, std::uint16_t option,
 	std::uint64_t optionFlags, NumericVariant* attribute, grid::AttributeValue* attribute_valid, XY_Rectangle* cache_bbox) {
 	if (option == CWFGM_WEATHER_OPTION_CUMULATIVE_RAIN) {
@@ -661,6 +1604,33 @@ HRESULT CCWFGM_WeatherGrid::GetAttribute(std::uint16_t option, PolymorphicAttrib
 		case CWFGM_WEATHER_OPTION_IDW_EXPONENT_FWI:
 			*var = m_idwExponentFWI;
 			return S_OK;
+		case CWFGM_WEATHER_OPTION_HOURLY_BLEND:
+			*var = m_hourlyBlend;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_SPACING:
+			*var = (double)m_latticeSpacing;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE:
+			*var = m_latticeTolerance;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_WIND:
+			*var = m_latticeToleranceWind;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_PRECIP:
+			*var = m_latticeTolerancePrecip;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_CACHE_EVICTION:
+			*var = (double)m_cacheEviction;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_CACHE_BUDGET:
+			*var = (double)m_cacheBudget;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_CACHE_STATS:
+			*var = m_cacheStats;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_DISK_CACHE:
+			*var = m_diskCachePath;
+			return S_OK;
 		case CWFGM_WEATHER_OPTION_FFMC_VANWAGNER:
 		case CWFGM_WEATHER_OPTION_FFMC_LAWSON:
 			{
@@ -691,24 +1661,102 @@ HRESULT CCWFGM_WeatherGrid::SetAttribute(std::uint16_t option, const Polymorphic
 			if ((dValue <= 0.0) || (dValue > 10.0))
 				return ERROR_INVALID_PARAMETER;
 			this->m_idwExponentTemp = dValue;
+			clearDiskCache();
 			return S_OK;
 		case CWFGM_WEATHER_OPTION_IDW_EXPONENT_WS:
 			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
 			if ((dValue < 0.0) || (dValue > 10.0))
 				return ERROR_INVALID_PARAMETER;
 			this->m_idwExponentWS = dValue;
+			clearDiskCache();
 			return S_OK;
 		case CWFGM_WEATHER_OPTION_IDW_EXPONENT_PRECIP:
 			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
 			if ((dValue < 0.0) || (dValue > 10.0))
 				return ERROR_INVALID_PARAMETER;
 			this->m_idwExponentPrecip = dValue;
+			clearDiskCache();
 			return S_OK;
 		case CWFGM_WEATHER_OPTION_IDW_EXPONENT_FWI:
 			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
 			if ((dValue <= 0.0) || (dValue > 10.0))
 				return ERROR_INVALID_PARAMETER;
 			this->m_idwExponentFWI = dValue;
+			clearDiskCache();
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_HOURLY_BLEND:
+			{
+				bool bValue;
+				if (FAILED(hr = VariantToBoolean_(var, &bValue)))				break;
+				m_hourlyBlend = bValue;
+			}
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_SPACING:
+			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
+			if ((dValue < 0.0) || (dValue > 1000.0) || (dValue != floor(dValue)))
+				return ERROR_INVALID_PARAMETER;
+			this->m_latticeSpacing = (std::uint16_t)dValue;
+			clearLattice();
+			clearDiskCache();
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE:
+			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
+			if (dValue < 0.0)
+				return ERROR_INVALID_PARAMETER;
+			this->m_latticeTolerance = dValue;
+			clearLattice();
+			clearDiskCache();
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_WIND:
+			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
+			if (dValue < 0.0)
+				return ERROR_INVALID_PARAMETER;
+			this->m_latticeToleranceWind = dValue;
+			clearLattice();
+			clearDiskCache();
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_PRECIP:
+			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
+			if (dValue < 0.0)
+				return ERROR_INVALID_PARAMETER;
+			this->m_latticeTolerancePrecip = dValue;
+			clearLattice();
+			clearDiskCache();
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_CACHE_EVICTION:
+			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
+			if ((dValue != (double)CWFGM_WEATHER_CACHE_EVICT_FIFO) && (dValue != (double)CWFGM_WEATHER_CACHE_EVICT_CLOCK))
+				return ERROR_INVALID_PARAMETER;
+			this->m_cacheEviction = (std::uint16_t)dValue;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_CACHE_BUDGET:
+			if (FAILED(hr = VariantToDouble_(var, &dValue)))					break;
+			if ((dValue < 0.0) || (dValue > 9007199254740992.0) || (dValue != floor(dValue)))
+				return ERROR_INVALID_PARAMETER;
+			this->m_cacheBudget = (std::uint64_t)dValue;
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_CACHE_STATS:
+			{
+				bool bValue;
+				if (FAILED(hr = VariantToBoolean_(var, &bValue)))				break;
+				m_cacheStats = bValue;
+				CRWThreadSemaphoreEngage cengage(m_cacheLock, SEM_TRUE);
+				ResetCacheStats();
+				GStreamNode *node = m_streamList.LH_Head();
+				while (node->LN_Succ()) {
+					node->m_stream->ResetCacheStats();
+					node = (GStreamNode *)node->LN_Succ();
+				}
+			}
+			return S_OK;
+		case CWFGM_WEATHER_OPTION_DISK_CACHE:
+			{
+				std::string path;
+				try { path = std::get<std::string>(var); } catch (std::bad_variant_access&) { weak_assert(false); return E_INVALIDARG; };
+				CRWThreadSemaphoreEngage dengage(m_diskLock, SEM_TRUE);
+				m_diskCachePath = path;
+			}
+			clearDiskCache();
 			return S_OK;
 	}
 
@@ -729,7 +1777,12 @@ HRESULT CCWFGM_WeatherGrid::SetCache(Layer *layerThread, unsigned short cache, b
 				IncrementCache(layerThread, cache);
 				return SUCCESS_CACHE_ALREADY_EXISTS;
 			}
-			AddCache(layerThread, cache, m_xsize, m_ysize);
+			std::uint64_t budget = m_cacheBudget;
+			if ((budget) && (!m_cache.CacheEntries())) {		// the elevation cache and lattice are shared by every cache on this grid, so only the first pays for them
+				const std::uint64_t grid = elevationCacheBytes() + latticeCacheBytes();
+				budget = (budget > grid) ? (budget - grid) : 1;	// still a budget, just the smallest caches possible
+			}
+			AddCache(layerThread, cache, m_xsize, m_ysize, m_cacheEviction, budget, m_cacheStats);
 			IncrementCache(layerThread, cache);
 		}
 	}
@@ -774,7 +1827,7 @@ HRESULT CCWFGM_WeatherGrid::GetWeatherData(Layer *layerThread, const XY_Point &p
 		*wx_valid = SUCCEEDED(hr);
 	} else {		// if spatial interpolating is enabled
 		WTime tm(time, m_timeManager);
-		WeatherKey key(x, y, tm, interpolate_method, layerThread);
+		WeatherKey key(x, y, tm, interpolate_method, layerThread, CacheHandle(layerThread, interpolate_method));
 		WeatherData data = {0};
 		XY_Point p(pt);
 		p.x = invertX(((double)x) + 0.5);
@@ -790,6 +1843,67 @@ HRESULT CCWFGM_WeatherGrid::GetWeatherData(Layer *layerThread, const XY_Point &p
 }
 
 
+// spreads the bits of a cell index apart so two of them can be interleaved into a Morton (Z-order) code
+static std::uint32_t mortonSpread(std::uint16_t v) {
+	std::uint32_t m = v;
+	m = (m | (m << 8)) & 0x00ff00ff;
+	m = (m | (m << 4)) & 0x0f0f0f0f;
+	m = (m | (m << 2)) & 0x33333333;
+	m = (m | (m << 1)) & 0x55555555;
+	return m;
+}
+
+
+HRESULT CCWFGM_WeatherGrid::GetWeatherDataBatch(Layer *layerThread, const std::vector<WeatherBatchQuery> &queries, std::vector<WeatherBatchResult> *results) {
+	if (!results)								return E_POINTER;
+
+	struct plan_entry {
+		std::uint64_t time;
+		std::uint64_t interpolate_method;
+		std::uint32_t morton;
+		size_t index;
+	};
+
+	std::vector<plan_entry> plan;
+	try {
+		results->resize(queries.size());
+		plan.resize(queries.size());
+	} catch (std::bad_alloc& cme) {
+		return E_OUTOFMEMORY;
+	}
+
+	for (size_t i = 0; i < queries.size(); i++) {
+		const WeatherBatchQuery &q = queries[i];
+		std::uint16_t x = convertX(q.pt.x, nullptr);
+		std::uint16_t y = convertY(q.pt.y, nullptr);
+		plan[i].time = q.time.GetTotalMicroSeconds();
+		plan[i].interpolate_method = q.interpolate_method;
+		plan[i].morton = mortonSpread(x) | (mortonSpread(y) << 1);
+		plan[i].index = i;
+	}
+	std::sort(plan.begin(), plan.end(), [](const plan_entry &a, const plan_entry &b) {
+		if (a.time != b.time)
+			return a.time < b.time;
+		if (a.interpolate_method != b.interpolate_method)
+			return a.interpolate_method < b.interpolate_method;
+		if (a.morton != b.morton)
+			return a.morton < b.morton;
+		return a.index < b.index;
+	});
+
+	for (const plan_entry &p : plan) {
+		const WeatherBatchQuery &q = queries[p.index];
+		WeatherBatchResult &r = (*results)[p.index];
+		r.hr = GetWeatherData(layerThread, q.pt, q.time, q.interpolate_method, &r.wx, &r.ifwi, &r.dfwi, &r.wx_valid, nullptr);
+	}
+
+	for (const WeatherBatchResult &r : *results)
+		if (FAILED(r.hr))
+			return r.hr;
+	return S_OK;
+}
+
+
 HRESULT CCWFGM_WeatherGrid::GetWeatherDataArray(Layer *layerThread, const XY_Point &min_pt, const XY_Point &max_pt, double scale, const HSS_Time::WTime &time, std::uint64_t interpolate_method, 
     IWXData_2d *wx, IFWIData_2d *ifwi, DFWIData_2d *dfwi, bool_2d *wx_valid) {
 
@@ -859,6 +1973,7 @@ HRESULT CCWFGM_WeatherGrid::GetWeatherDataArray(Layer *layerThread, const XY_Poi
 		}
 	} else {
 		// interpolation is turned on - we must compute each point individually
+		WeatherLayerCache *handle = CacheHandle(layerThread, interpolate_method);
 		for (y = y_min; y <= y_max; y++)	// for every point that was requested...
 		{
 			for (x = x_min; x <= x_max; x++, i++)
@@ -867,7 +1982,7 @@ HRESULT CCWFGM_WeatherGrid::GetWeatherDataArray(Layer *layerThread, const XY_Poi
 				XY_Point pt;
 				pt.x = invertX(((double)x) + 0.5);
 				pt.y = invertY(((double)y) + 0.5);
-				WeatherKey key(x, y, time, interpolate_method, layerThread);
+				WeatherKey key(x, y, time, interpolate_method, layerThread, handle);
 				WeatherData data = {0};
 				hr = GetCalculatedValues(this, layerThread, pt, key, data);
 				if (FAILED(hr))
@@ -889,263 +2004,457 @@ HRESULT CCWFGM_WeatherGrid::GetWeatherDataArray(Layer *layerThread, const XY_Poi
 }
 
 
-#ifndef DOXYGEN_IGNORE_CODE
+HRESULT CCWFGM_WeatherGrid::GetWeatherDataPlanes(Layer *layerThread, const XY_Point &min_pt, const XY_Point &max_pt, double scale, const HSS_Time::WTime &time, std::uint64_t interpolate_method,
+    const std::vector<std::uint16_t> &variables, std::vector<double> *planes) {
+	if (!planes)									return E_POINTER;
 
-// this routine returns spatially interpolated weather data for the specified time and location
-HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid) {
-	std:uint16_t const alternate = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? 1 : 0;
-	const bool use_cache = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE) ? false : true);
+	std::uint16_t x_min = convertX(min_pt.x, nullptr), y_min = convertY(min_pt.y, nullptr);
+	std::uint16_t x_max = convertX(max_pt.x, nullptr), y_max = convertY(max_pt.y, nullptr);
+	if (x_min >= m_xsize)								return ERROR_GRID_LOCATION_OUT_OF_RANGE;
+	if (y_min >= m_ysize)								return ERROR_GRID_LOCATION_OUT_OF_RANGE;
+	if (x_max >= m_xsize)								return ERROR_GRID_LOCATION_OUT_OF_RANGE;
+	if (y_max >= m_ysize)								return ERROR_GRID_LOCATION_OUT_OF_RANGE;
+	if (min_pt.x > max_pt.x)							return E_INVALIDARG;
+	if (min_pt.y > max_pt.y)							return E_INVALIDARG;
 
-    #ifdef DEBUG
-	WTime t(time);
-	std::string theTime = t.ToString(WTIME_FORMAT_AS_LOCAL | WTIME_FORMAT_WITHDST | WTIME_FORMAT_ABBREV | WTIME_FORMAT_DATE | WTIME_FORMAT_TIME);
-    #endif
+	bool wx_only = true;
+	for (std::uint16_t v : variables) {
+		if (v >= CWFGM_WEATHER_EXPORT_VARIABLES)				return E_INVALIDARG;
+		if (v > CWFGM_WEATHER_EXPORT_WINDGUST)
+			wx_only = false;
+	}
 
-	std::uint16_t x = convertX(pt.x, nullptr);
-	std::uint16_t y = convertY(pt.y, nullptr);
-	WeatherKey key(x, y, time, interpolate_method, layerThread);
+	GStreamNode *sn = m_streamList.LH_Head();
+	if (!sn->LN_Succ())							return ERROR_INVALID_STATE | ERROR_SEVERITY_WARNING;
 
-	HIWXData iwx;
-	if ((use_cache) && (m_cache.Retrieve(alternate, &key, &iwx, m_timeManager))) {
-		*wx = iwx.wx;
-		*wx_valid = iwx.wx_valid;
-		return iwx.hr;
+	const std::uint32_t xdim = x_max - x_min + 1;
+	const std::uint32_t cnt = xdim * (y_max - y_min + 1);
+	try {
+		planes->resize(variables.size() * cnt);
+	} catch (std::bad_alloc& cme) {
+		return E_OUTOFMEMORY;
 	}
 
+	WTime wx_time(time, m_timeManager);			// as GetCalculatedValues() does for the weather it calculates
+	if (!(interpolate_method & CWFGM_GETWEATHER_INTERPOLATE_TEMPORAL))
+		wx_time.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
+
 	HRESULT hr = S_OK;
+	WeatherData data = { 0 };
+	if (interpolate_method & (CWFGM_GETEVENTTIME_QUERY_PRIMARY_WX_STREAM)) {
+		boost::intrusive_ptr<CCWFGM_WeatherStream> s = m_primaryStream;
+		if (!s) {
+			if (m_streamList.GetCount() != 1) {
+				weak_assert(false);
+				return ERROR_INVALID_STATE | ERROR_SEVERITY_WARNING;	// there's no primary weather stream!
+			}
+			s = m_streamList.LH_Head()->m_stream;
+		}
+		if (FAILED(hr = s->GetInstantaneousValues(time, interpolate_method, &data.wx, &data.ifwi, &data.dfwi)))
+			return hr;
+		data.wx_valid = true;
+	}
 
-	double nearest_d = DBL_MAX; // the distance to the active weather station nearest this point
-	double nearest_precip = 0.0; // the active weather station nearest this point
-	double nearest_wd = 0.0, nearest_ws = 0.0, nearest_gust = 0.0;
-	double elev = 0, slope_factor, slope_azimuth; // slope_factor, slope_azimuth are unused
-	grid::TerrainValue elev_valid, terrain_valid;
-	double weight_temp = 0.0, weight_ws = 0.0, weight_gust = 0.0, weight_precip = 0.0, d, ww; // the cumulative weight, and individual weights, and distances for each weather station, respectively
-	XY_Vector wind_vector(0.0, 0.0), gust_vector(0.0, 0.0);
+	WeatherLayerCache *handle = CacheHandle(layerThread, interpolate_method);
+	for (std::uint16_t y = y_min; y <= y_max; y++) {
+		for (std::uint16_t x = x_min; x <= x_max; x++) {
+			if (!(interpolate_method & (CWFGM_GETEVENTTIME_QUERY_PRIMARY_WX_STREAM))) {
+				XY_Point pt;
+				pt.x = invertX(((double)x) + 0.5);
+				pt.y = invertY(((double)y) + 0.5);
+				if (wx_only) {			// no FWI requested, so stop at the (cached) interpolated weather
+					if (FAILED(hr = GetRawWxValues(this, layerThread, handle, wx_time, pt, interpolate_method, &data.wx, &data.wx_valid)))
+						return hr;
+				} else {
+					WeatherKey key(x, y, time, interpolate_method, layerThread, handle);
+					if (FAILED(hr = GetCalculatedValues(this, layerThread, pt, key, data)))
+						return hr;
+				}
+			}
 
+			const std::uint32_t i = (y - y_min) * xdim + (x - x_min);
+			double *p = planes->data() + i;
+			for (std::uint16_t v : variables) {
+				if (!data.wx_valid)
+					*p = -9999.0;
+				else switch (v) {
+					case CWFGM_WEATHER_EXPORT_TEMPERATURE:		*p = data.wx.Temperature; break;
+					case CWFGM_WEATHER_EXPORT_DEWPOINT:		*p = data.wx.DewPointTemperature; break;
+					case CWFGM_WEATHER_EXPORT_RH:			*p = data.wx.RH * 100.0; break;
+					case CWFGM_WEATHER_EXPORT_PRECIPITATION:	*p = data.wx.Precipitation; break;
+					case CWFGM_WEATHER_EXPORT_WINDSPEED:		*p = data.wx.WindSpeed; break;
+					case CWFGM_WEATHER_EXPORT_WINDDIRECTION:	*p = CARTESIAN_TO_COMPASS_DEGREE(RADIAN_TO_DEGREE(data.wx.WindDirection)); break;
+					case CWFGM_WEATHER_EXPORT_WINDGUST:		*p = (data.wx.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) ? data.wx.WindGust : -9999.0; break;
+					case CWFGM_WEATHER_EXPORT_FFMC:			*p = data.ifwi.FFMC; break;
+					case CWFGM_WEATHER_EXPORT_ISI:			*p = data.ifwi.ISI; break;
+					case CWFGM_WEATHER_EXPORT_FWI:			*p = data.ifwi.FWI; break;
+					case CWFGM_WEATHER_EXPORT_DMC:			*p = data.dfwi.dDMC; break;
+					case CWFGM_WEATHER_EXPORT_DC:			*p = data.dfwi.dDC; break;
+					case CWFGM_WEATHER_EXPORT_BUI:			*p = data.dfwi.dBUI; break;
+				}
+				p += cnt;
+			}
+		}
+	}
+	return hr;
+}
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+// accumulates the IDW sums for every station, specialized for each combination of values being spatially interpolated so
+// the per-station loop doesn't keep testing interpolate_method
+template<bool TEMP_RH, bool WIND, bool WIND_VECTOR, bool PRECIP>
+HRESULT CCWFGM_WeatherGrid::accumulateStations(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums) {
+	HRESULT hr = S_OK;
+	double d, ww;
 	XY_Point pt2(pt.x, pt.y);
-	IWXData wx2;
 	GStreamNode *sn = m_streamList.LH_Head();
 
-	if (!m_primaryStream) {
-		weak_assert(false);
-		hr = ERROR_INVALID_STATE | ERROR_SEVERITY_WARNING;	// there's no primary weather stream!
-		iwx.hr = hr;
-		if (use_cache)
-			m_cache.Store(alternate, &key, &iwx, m_timeManager);
-
-		*wx_valid = false;
-		return hr;
-	}
+	while (sn->LN_Succ()) {
+		d = sn->m_location.DistanceToSquared(pt2);	// we use DistanceToSquared so need to halve the power in the pow() calls below
+		ww = (d > 1.0) ? (1.0 / d) : 5.0;
 
-	hr = m_primaryStream->GetInstantaneousValues(time, interpolate_method, wx, NULL, NULL);
-	if ((FAILED(hr) || (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY))) {
-		weak_assert(SUCCEEDED(hr));
-		iwx.wx = *wx;
-		iwx.wx_valid = SUCCEEDED(hr);
-		iwx.hr = hr;
-		if (use_cache)
-			m_cache.Store(alternate, &key, &iwx, m_timeManager);
+		// Lookup instantaneous weather conditions at this weather station, along with its (per time) lapse rates
+		GStreamWxData sw;
+		if (FAILED(hr = sn->GetStationValues(time, interpolate_method, &sw)))
+		{
+			weak_assert(false);
+			return hr;
+		}
+		const IWXData &wx2 = sw.wx;
 
-		*wx_valid = iwx.wx_valid;
-		return hr;
-	}
+		if constexpr (TEMP_RH) {
+			// Accumulate value for numerator and denominator used in IDW interpolation
+			double ww_temp;		// if distance > 1.0 meter then IDW, if it's <= 1m, then bias (arbitrarily) hugely to this point
+			if (m_idwExponentTemp != 0.0) {
+				if (m_idwExponentTemp != 2.0)
+					ww_temp = pow(ww, m_idwExponentTemp * 0.5);
+				else
+					ww_temp = ww;
+			} else		ww_temp = 0.0;
+			
+			wx->Temperature += ww_temp * wx2.Temperature;
+			wx->DewPointTemperature += ww_temp * wx2.DewPointTemperature;
 
-	if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL)) {
-		double wx_WindSpeed, wx_WindGust;
-		std::uint32_t wind_cnt = 0, gust_cnt = 0;
+			sums->wx__UALR += ww_temp * sw.UALR;
+			sums->wx__SALR += ww_temp * sw.SALR;
 
-		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) {
-			wx->Temperature = 0.0;
-			wx->DewPointTemperature = 0.0;
+			sums->weight_temp += ww_temp;
 		}
 
-		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) {
-			weak_assert(m_idwExponentWS == 2.0);			// RWB: for testing changes in #811 for Prometheus only, 2013/12/10
-
+		if constexpr (WIND) {
+			double ww_ws;
+			if (m_idwExponentWS != 0.0) {
+				if (m_idwExponentWS != 2.0)
+					ww_ws = pow(ww, m_idwExponentWS * 0.5);
+				else
+					ww_ws = ww;
+			} else
+				ww_ws = 0.0;
+		
 			if (m_idwExponentWS != 0.0) {
-				wx_WindSpeed = 0.0;
-				wx_WindGust = 0.0;
+				if constexpr (WIND_VECTOR) {
+					sums->wind_vector.x += sw.ws_u * ww_ws;
+					sums->wind_vector.y += sw.ws_v * ww_ws;
+					if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
+						sums->gust_vector.x += sw.gust_u * ww_ws;
+						sums->gust_vector.y += sw.gust_v * ww_ws;
+						sums->gust_cnt++;
+						sums->weight_gust += ww_ws;
+					}
+				}
+				else {
+					if (wx2.WindSpeed != 0.0)
+						sums->wx_WindSpeed += ww_ws * wx2.WindSpeed;
+					if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
+						weak_assert(wx2.WindGust > 0.0);
+						sums->wx_WindGust += ww_ws * wx2.WindGust;
+						sums->gust_cnt++;
+						sums->weight_gust += ww_ws;
+					}
+				}
+				sums->weight_ws += ww_ws;
+				sums->wind_cnt++;
 			}
 		}
 
-		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) {
-			weak_assert(m_idwExponentPrecip == 2.0);		// RWB: for testing changes in #811 for Prometheus only, 2013/12/10
+		if constexpr (PRECIP) {
+			double ww_precip;
+			if (m_idwExponentPrecip != 0.0) {
+				if (m_idwExponentPrecip != 2.0)
+					ww_precip = pow(ww, m_idwExponentPrecip * 0.5);
+				else
+					ww_precip = ww;
+			} else		ww_precip = 0.0;
 
-			if (m_idwExponentPrecip != 0.0)
-				wx->Precipitation = 0.0;
+			if (m_idwExponentPrecip != 0.0) {
+				if (wx2.Precipitation != 0.0)
+					wx->Precipitation += ww_precip * wx2.Precipitation;
+				sums->weight_precip += ww_precip;
+			}
+		}
+
+		// Keep track of the nearest weather station so that we can use it for precipitation data later on
+		if (d < sums->nearest_d) // note: w = (1000000.0 / distance squared); hence, smaller distances yield larger values of w.
+		{
+			sums->nearest_d = d;
+			sums->nearest_precip = wx2.Precipitation;
+			sums->nearest_wd = wx2.WindDirection;
+			sums->nearest_ws = wx2.WindSpeed;
+			if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST)
+				sums->nearest_gust = wx2.WindGust;
 		}
+	
+		sn = (GStreamNode*)sn->LN_Succ();
+	}
+	return hr;
+}
 
-		double wx__UALR = 0.0, wx__SALR = 0.0;
 
-		while (sn->LN_Succ()) {
-			d = sn->m_location.DistanceToSquared(pt2);	// we use DistanceToSquared so need to halve the power in the pow() calls below
-			ww = (d > 1.0) ? (1.0 / d) : 5.0;
+const CCWFGM_WeatherGrid::StationKernel CCWFGM_WeatherGrid::m_stationKernels[16] = {
+	&CCWFGM_WeatherGrid::accumulateStations<false, false, false, false>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  false, false, false>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, true,  false, false>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  true,  false, false>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, false, true,  false>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  false, true,  false>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, true,  true,  false>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  true,  true,  false>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, false, false, true>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  false, false, true>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, true,  false, true>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  true,  false, true>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, false, true,  true>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  false, true,  true>,
+	&CCWFGM_WeatherGrid::accumulateStations<false, true,  true,  true>,
+	&CCWFGM_WeatherGrid::accumulateStations<true,  true,  true,  true>
+};
 
-			// Lookup instantaneous weather conditions at this weather station
-			if (FAILED(hr = sn->m_stream->GetInstantaneousValues(time, interpolate_method, &wx2, NULL, NULL)))
-			{
-				weak_assert(false);
-				iwx.wx = *wx;
-				iwx.wx_valid = false;
-				iwx.hr = hr;
-				if (use_cache)
-					m_cache.Store(alternate, &key, &iwx, m_timeManager);
 
-				*wx_valid = iwx.wx_valid;
-				return hr;
+// the station loop without specialization, testing interpolate_method for every station, to check the kernels against (in debug builds,
+// and in the tests)
+HRESULT CCWFGM_WeatherGrid::accumulateStationsGeneric(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums) {
+	HRESULT hr = S_OK;
+	double d, ww;
+	XY_Point pt2(pt.x, pt.y);
+	GStreamNode *sn = m_streamList.LH_Head();
+
+	while (sn->LN_Succ()) {
+		d = sn->m_location.DistanceToSquared(pt2);
+		ww = (d > 1.0) ? (1.0 / d) : 5.0;
+
+		GStreamWxData sw;
+		if (FAILED(hr = sn->GetStationValues(time, interpolate_method, &sw)))
+			return hr;
+		const IWXData &wx2 = sw.wx;
+
+		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) {
+			double ww_temp;
+			if (m_idwExponentTemp != 0.0) {
+				if (m_idwExponentTemp != 2.0)
+					ww_temp = pow(ww, m_idwExponentTemp * 0.5);
+				else
+					ww_temp = ww;
+			} else		ww_temp = 0.0;
+
+			wx->Temperature += ww_temp * wx2.Temperature;
+			wx->DewPointTemperature += ww_temp * wx2.DewPointTemperature;
+			sums->wx__UALR += ww_temp * sw.UALR;
+			sums->wx__SALR += ww_temp * sw.SALR;
+			sums->weight_temp += ww_temp;
+		}
+
+		if ((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) && (m_idwExponentWS != 0.0)) {
+			double ww_ws;
+			if (m_idwExponentWS != 2.0)
+				ww_ws = pow(ww, m_idwExponentWS * 0.5);
+			else
+				ww_ws = ww;
+
+			if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR)) {
+				sums->wind_vector.x += sw.ws_u * ww_ws;
+				sums->wind_vector.y += sw.ws_v * ww_ws;
+				if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
+					sums->gust_vector.x += sw.gust_u * ww_ws;
+					sums->gust_vector.y += sw.gust_v * ww_ws;
+					sums->gust_cnt++;
+					sums->weight_gust += ww_ws;
+				}
 			}
+			else {
+				if (wx2.WindSpeed != 0.0)
+					sums->wx_WindSpeed += ww_ws * wx2.WindSpeed;
+				if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
+					sums->wx_WindGust += ww_ws * wx2.WindGust;
+					sums->gust_cnt++;
+					sums->weight_gust += ww_ws;
+				}
+			}
+			sums->weight_ws += ww_ws;
+			sums->wind_cnt++;
+		}
 
-			if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) {
+		if ((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) && (m_idwExponentPrecip != 0.0)) {
+			double ww_precip;
+			if (m_idwExponentPrecip != 2.0)
+				ww_precip = pow(ww, m_idwExponentPrecip * 0.5);
+			else
+				ww_precip = ww;
+			if (wx2.Precipitation != 0.0)
+				wx->Precipitation += ww_precip * wx2.Precipitation;
+			sums->weight_precip += ww_precip;
+		}
 
-				double VPs = 0.6112 * pow(10.0, 7.5 * wx2.Temperature / (237.7 + wx2.Temperature));
-				double VP = wx2.RH * VPs;
+		if (d < sums->nearest_d) {
+			sums->nearest_d = d;
+			sums->nearest_precip = wx2.Precipitation;
+			sums->nearest_wd = wx2.WindDirection;
+			sums->nearest_ws = wx2.WindSpeed;
+			if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST)
+				sums->nearest_gust = wx2.WindGust;
+		}
 
-				double Rv = 0.622 * VP / (sn->m_Pe - VP);
-				double Rvs = 0.622 * VPs / (sn->m_Pe - VPs);
+		sn = (GStreamNode*)sn->LN_Succ();
+	}
+	return hr;
+}
 
-				const double Lv = 2501000.0;
-				const double R = 287.0;
-				const double g = -9.80665;
-				const double Cpd = 1005.7;
-				const double e = 0.621885157;
-				double temp_kelvin = UnitConvert::convertUnit(wx2.Temperature, STORAGE_FORMAT_KELVIN, STORAGE_FORMAT_CELSIUS);
-				double numerator = 1.0 + (Lv * Rv) / (R * temp_kelvin);
-				double denominator = Cpd + (Lv * Lv * Rv * e) / (R * (temp_kelvin * temp_kelvin));
-				double UALR = g * numerator / denominator;
 
-				numerator = 1.0 + (Lv * Rvs) / (R * temp_kelvin);
-				denominator = Cpd + (Lv * Lv * Rvs * e) / (R * (temp_kelvin * temp_kelvin));
-				double SALR = g * numerator / denominator;
+#ifdef _DEBUG
+// same operations in the same order, so the kernel's results have to match the generic loop's exactly
+static bool sameStationSums(const IWXData &wx1, const GStationSums &s1, const IWXData &wx2, const GStationSums &s2) {
+	return (wx1.Temperature == wx2.Temperature) && (wx1.DewPointTemperature == wx2.DewPointTemperature) && (wx1.Precipitation == wx2.Precipitation) &&
+	    (s1.wx__UALR == s2.wx__UALR) && (s1.wx__SALR == s2.wx__SALR) && (s1.wx_WindSpeed == s2.wx_WindSpeed) && (s1.wx_WindGust == s2.wx_WindGust) &&
+	    (s1.weight_temp == s2.weight_temp) && (s1.weight_ws == s2.weight_ws) && (s1.weight_gust == s2.weight_gust) && (s1.weight_precip == s2.weight_precip) &&
+	    (s1.wind_vector.x == s2.wind_vector.x) && (s1.wind_vector.y == s2.wind_vector.y) && (s1.gust_vector.x == s2.gust_vector.x) && (s1.gust_vector.y == s2.gust_vector.y) &&
+	    (s1.wind_cnt == s2.wind_cnt) && (s1.gust_cnt == s2.gust_cnt) && (s1.nearest_d == s2.nearest_d) && (s1.nearest_precip == s2.nearest_precip) &&
+	    (s1.nearest_wd == s2.nearest_wd) && (s1.nearest_ws == s2.nearest_ws) && (s1.nearest_gust == s2.nearest_gust);
+}
+#endif
 
-				wx2.Temperature -= (UALR * sn->m_elevation);
-				wx2.DewPointTemperature -= (SALR * sn->m_elevation);	// new math from Neal is K/m not K/km
 
-				// Accumulate value for numerator and denominator used in IDW interpolation
-				double ww_temp;		// if distance > 1.0 meter then IDW, if it's <= 1m, then bias (arbitrarily) hugely to this point
-				if (m_idwExponentTemp != 0.0) {
-					if (m_idwExponentTemp != 2.0)
-						ww_temp = pow(ww, m_idwExponentTemp * 0.5);
-					else
-						ww_temp = ww;
-				} else		ww_temp = 0.0;
-				
-				wx->Temperature += ww_temp * wx2.Temperature;
-				wx->DewPointTemperature += ww_temp * wx2.DewPointTemperature;
+// this layer's own answer: the primary stream's weather with the spatially interpolated values (and the disk cache) applied, but none of
+// the lower layers.  Errors come back with *wx_valid set the way GetRawWxValues caches them.
+HRESULT CCWFGM_WeatherGrid::stationWx(const HSS_Time::WTime &time, const XY_Point &pt, std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, bool use_cache, IWXData *wx, bool *wx_valid) {
+	HRESULT hr = S_OK;
+	double elev = 0;
+	GStationSums sums;
 
-				wx__UALR += ww_temp * UALR;
-				wx__SALR += ww_temp * SALR;
+	if (!m_primaryStream) {
+		weak_assert(false);
+		hr = ERROR_INVALID_STATE | ERROR_SEVERITY_WARNING;	// there's no primary weather stream!
+		*wx_valid = false;
+		return hr;
+	}
 
-				weight_temp += ww_temp;
-			}
+	// whole hours of spatially interpolated weather may be on disk from an earlier run, only this layer's part of the answer is kept
+	// there since the layers below (e.g. wind grids) aren't part of what it's keyed on
+	CRWThreadSemaphoreEngage diskEngage(m_diskLock, SEM_FALSE);	// held until the Store below, so the disk cache can't be closed under us
+	WeatherDiskCache *disk = nullptr;
+	bool from_disk = false;
+	if ((use_cache) && (x < m_xsize) && (y < m_ysize) &&
+	    (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL)) &&
+	    (disk = diskCache())) {
+		WTime h1(time);
+		h1.PurgeToHour(WTIME_FORMAT_AS_LOCAL | WTIME_FORMAT_WITHDST);
+		bool elev_valid;
+		if ((h1 == time) && (SUCCEEDED(getElevation(pt, x, y, &elev, &elev_valid))) && (elev_valid))
+			from_disk = disk->Retrieve(time, interpolate_method, x, y, elev, wx);
+		else
+			disk = nullptr;
+	}
 
-			if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) {
-				double ww_ws;
-				if (m_idwExponentWS != 0.0) {
-					if (m_idwExponentWS != 2.0)
-						ww_ws = pow(ww, m_idwExponentWS * 0.5);
-					else
-						ww_ws = ww;
-				} else
-					ww_ws = 0.0;
-			
-				if (m_idwExponentWS != 0.0) {
-					if (interpolate_method & (1ull << (CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR))) {
-						double sin_wd, cos_wd;
-						::sincos(wx2.WindDirection, &sin_wd, &cos_wd);
-						wind_vector.x += cos_wd * wx2.WindSpeed * ww_ws;
-						wind_vector.y += sin_wd * wx2.WindSpeed * ww_ws;
-						if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
-							gust_vector.x += cos_wd * wx2.WindGust * ww_ws;
-							gust_vector.y += sin_wd * wx2.WindGust * ww_ws;
-							gust_cnt++;
-							weight_gust += ww_ws;
-						}
-					}
-					else {
-						if (wx2.WindSpeed != 0.0)
-							wx_WindSpeed += ww_ws * wx2.WindSpeed;
-						if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST) {
-							weak_assert(wx2.WindGust > 0.0);
-							wx_WindGust += ww_ws * wx2.WindGust;
-							gust_cnt++;
-							weight_gust += ww_ws;
-						}
-					}
-					weight_ws += ww_ws;
-					wind_cnt++;
-				}
-			}
+	hr = (from_disk) ? S_OK : m_primaryStream->GetInstantaneousValues(time, interpolate_method, wx, NULL, NULL);
+	if ((FAILED(hr) || (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY))) {
+		weak_assert(SUCCEEDED(hr));
+		*wx_valid = SUCCEEDED(hr);
+		return hr;
+	}
 
-			if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) {
-				double ww_precip;
-				if (m_idwExponentPrecip != 0.0) {
-					if (m_idwExponentPrecip != 2.0)
-						ww_precip = pow(ww, m_idwExponentPrecip * 0.5);
-					else
-						ww_precip = ww;
-				} else		ww_precip = 0.0;
+	if ((!from_disk) && (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL))) {
+		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) {
+			wx->Temperature = 0.0;
+			wx->DewPointTemperature = 0.0;
+		}
 
-				if (m_idwExponentPrecip != 0.0) {
-					if (wx2.Precipitation != 0.0)
-						wx->Precipitation += ww_precip * wx2.Precipitation;
-					weight_precip += ww_precip;
-				}
-			}
+		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) {
+			weak_assert(m_idwExponentWS == 2.0);			// RWB: for testing changes in #811 for Prometheus only, 2013/12/10
+		}
 
-			// Keep track of the nearest weather station so that we can use it for precipitation data later on
-			if (d < nearest_d) // note: w = (1000000.0 / distance squared); hence, smaller distances yield larger values of w.
-			{
-				nearest_d = d;
-				nearest_precip = wx2.Precipitation;
-				nearest_wd = wx2.WindDirection;
-				nearest_ws = wx2.WindSpeed;
-				if (wx2.SpecifiedBits & IWXDATA_SPECIFIED_WINDGUST)
-					nearest_gust = wx2.WindGust;
-			}
-		
-			sn = (GStreamNode*)sn->LN_Succ();
+		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) {
+			weak_assert(m_idwExponentPrecip == 2.0);		// RWB: for testing changes in #811 for Prometheus only, 2013/12/10
+
+			if (m_idwExponentPrecip != 0.0)
+				wx->Precipitation = 0.0;
+		}
+
+		// accumulate the IDW sums across the stations with the kernel built for this combination of interpolation options
+		const std::uint32_t kernel =
+			((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) ? 0x1 : 0) |
+			((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) ? 0x2 : 0) |
+			((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR)) ? 0x4 : 0) |
+			((interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) ? 0x8 : 0);
+		bool lattice = (m_latticeSpacing > 1) && (x < m_xsize) && (y < m_ysize);
+		if (lattice) {				// the lattice only keeps whole hours, anything between them is calculated directly (or blended)
+			WTime h(time);
+			h.PurgeToHour(WTIME_FORMAT_AS_LOCAL | WTIME_FORMAT_WITHDST);
+			lattice = (h == time);
+		}
+    #ifdef _DEBUG
+		IWXData wx_check = *wx;
+    #endif
+		if (lattice)
+			hr = latticeSums(time, pt, x, y, interpolate_method, kernel, wx, &sums);
+		else
+			hr = (this->*m_stationKernels[kernel])(time, pt, interpolate_method, wx, &sums);
+    #ifdef _DEBUG
+		if ((SUCCEEDED(hr)) && (!lattice)) {
+			GStationSums sums_check;
+			weak_assert(SUCCEEDED(accumulateStationsGeneric(time, pt, interpolate_method, &wx_check, &sums_check)));
+			weak_assert(sameStationSums(*wx, sums, wx_check, sums_check));
+		}
+    #endif
+		if (FAILED(hr))
+		{
+			*wx_valid = false;
+			return hr;
 		}
 
 		// Apply IDW to get (dew point) temperature normalized to sea level
 		// then use this coordinates' elevation and lapse rate to determine (dew point) temperature at the actual elevation
-		if (FAILED(hr = this->GetElevationData(0, pt, true, &elev, &slope_factor, &slope_azimuth, &elev_valid, &terrain_valid, nullptr)) ||
-			(elev_valid == grid::TerrainValue::NOT_SET) || (terrain_valid == grid::TerrainValue::NOT_SET))
+		bool elev_valid;
+		if (FAILED(hr = getElevation(pt, x, y, &elev, &elev_valid)) || (!elev_valid))
 		{
 			weak_assert(false);
-			iwx.wx = *wx;
-			iwx.wx_valid = false;
-			iwx.hr = hr;
-			if (use_cache)
-				m_cache.Store(alternate, &key, &iwx, m_timeManager);
-
-			*wx_valid = iwx.wx_valid;
+			*wx_valid = false;
 			return hr;
 		}
 
 		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH)) {
-			if (weight_temp != 0.0) {
-				wx->Temperature		/= weight_temp; // get normalized, interpolated temperature
-				wx->DewPointTemperature	/= weight_temp; // get normalized, interpolated dew point temperature
-				wx__UALR		/= weight_temp;
-				wx__SALR		/= weight_temp;
+			if (sums.weight_temp != 0.0) {
+				wx->Temperature		/= sums.weight_temp; // get normalized, interpolated temperature
+				wx->DewPointTemperature	/= sums.weight_temp; // get normalized, interpolated dew point temperature
+				sums.wx__UALR		/= sums.weight_temp;
+				sums.wx__SALR		/= sums.weight_temp;
 			}
-			wx->Temperature		+= (wx__UALR * elev /* / 1000.0 */ ); // adjust for adiabatic lapse rate
-			wx->DewPointTemperature	+= (wx__SALR * elev /* / 1000.0 */ ); // adjust for adiabatic lapse rate
+			wx->Temperature		+= (sums.wx__UALR * elev /* / 1000.0 */ ); // adjust for adiabatic lapse rate
+			wx->DewPointTemperature	+= (sums.wx__SALR * elev /* / 1000.0 */ ); // adjust for adiabatic lapse rate
 		}
 
 		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND)) {
 			bool set_wd = false;
-			if (wind_cnt > 1) {
+			if (sums.wind_cnt > 1) {
 				if (m_idwExponentWS != 0.0) {
 					if (interpolate_method & (1ull << (CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR))) {
-						double wd = wind_vector.atan();
-						double ws = wind_vector.Length() / weight_ws;
-						double gust = gust_vector.Length() / weight_gust;
+						double wd = sums.wind_vector.atan();
+						double ws = sums.wind_vector.Length() / sums.weight_ws;
+						double gust = sums.gust_vector.Length() / sums.weight_gust;
 						if (fabs(ws - wx->WindSpeed) > 1e-7) {
 							wx->WindSpeed = ws;
 							wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDSPEED;
 						}
-						if (gust_cnt > 0) {
+						if (sums.gust_cnt > 0) {
 							if (fabs(gust - wx->WindGust) > 1e-7) {
 								wx->WindGust = ws;
 								wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDGUST;
@@ -1158,26 +2467,26 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 						}
 					}
 					else {
-						if ((wx_WindSpeed != 0.0) && (weight_ws != 0.0))
-							wx_WindSpeed /= weight_ws;
-						if ((wx_WindGust != 0.0) && (weight_gust != 0.0))
-							wx_WindGust /= weight_gust;
-						if (fabs(wx_WindSpeed - wx->WindSpeed) > 1e-7) {
-							wx->WindSpeed = wx_WindSpeed;
+						if ((sums.wx_WindSpeed != 0.0) && (sums.weight_ws != 0.0))
+							sums.wx_WindSpeed /= sums.weight_ws;
+						if ((sums.wx_WindGust != 0.0) && (sums.weight_gust != 0.0))
+							sums.wx_WindGust /= sums.weight_gust;
+						if (fabs(sums.wx_WindSpeed - wx->WindSpeed) > 1e-7) {
+							wx->WindSpeed = sums.wx_WindSpeed;
 							wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDSPEED;
 						}
-						if (fabs(wx_WindGust - wx->WindGust) > 1e-7) {
-							wx->WindGust = wx_WindGust;
+						if (fabs(sums.wx_WindGust - wx->WindGust) > 1e-7) {
+							wx->WindGust = sums.wx_WindGust;
 							wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDGUST;
 						}
 					}
 				} else {
-					if (wx->WindSpeed != nearest_ws) {
-						wx->WindSpeed = nearest_ws;
+					if (wx->WindSpeed != sums.nearest_ws) {
+						wx->WindSpeed = sums.nearest_ws;
 						wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDSPEED;
 					}
-					if (wx->WindGust != nearest_gust) {
-						wx->WindGust = nearest_gust;
+					if (wx->WindGust != sums.nearest_gust) {
+						wx->WindGust = sums.nearest_gust;
 						wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDGUST;
 					}
 				}
@@ -1186,9 +2495,9 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 			} else {
 				if (m_idwExponentWS != 0.0) {
 					if (interpolate_method & (1ull << (CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR))) {
-						double wd = NORMALIZE_ANGLE_RADIAN(wind_vector.atan());
-						double ws = wind_vector.Length() / weight_ws;
-						double gust = gust_vector.Length() / weight_gust;
+						double wd = NORMALIZE_ANGLE_RADIAN(sums.wind_vector.atan());
+						double ws = sums.wind_vector.Length() / sums.weight_ws;
+						double gust = sums.gust_vector.Length() / sums.weight_gust;
 						if (fabs(ws - wx->WindSpeed) > 1e-7) {
 							weak_assert(false);
 							wx->WindSpeed = ws;
@@ -1207,29 +2516,29 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 						}
 					}
 					else {
-						if ((wx_WindSpeed != 0.0) && (weight_ws != 0.0))
-							wx_WindSpeed /= weight_ws;
-						if ((wx_WindGust != 0.0) && (weight_gust != 0.0))
-							wx_WindGust /= weight_gust;
-						if (fabs(wx_WindSpeed - wx->WindSpeed) > 1e-7) {
+						if ((sums.wx_WindSpeed != 0.0) && (sums.weight_ws != 0.0))
+							sums.wx_WindSpeed /= sums.weight_ws;
+						if ((sums.wx_WindGust != 0.0) && (sums.weight_gust != 0.0))
+							sums.wx_WindGust /= sums.weight_gust;
+						if (fabs(sums.wx_WindSpeed - wx->WindSpeed) > 1e-7) {
 							weak_assert(false);
-							wx->WindSpeed = wx_WindSpeed;
+							wx->WindSpeed = sums.wx_WindSpeed;
 							wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDSPEED;
 						}
-						if (fabs(wx_WindGust - wx->WindGust) > 1e-7) {
-							wx->WindGust = wx_WindGust;
+						if (fabs(sums.wx_WindGust - wx->WindGust) > 1e-7) {
+							wx->WindGust = sums.wx_WindGust;
 							wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDGUST;
 						}
 					}
 				} else {
-					if (wx->WindSpeed != nearest_ws) {
+					if (wx->WindSpeed != sums.nearest_ws) {
 						weak_assert(false);
-						wx->WindSpeed = nearest_ws;
+						wx->WindSpeed = sums.nearest_ws;
 						wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDSPEED;
 					}
-					if (wx->WindGust != nearest_gust) {
+					if (wx->WindGust != sums.nearest_gust) {
 						weak_assert(false);
-						wx->WindGust = nearest_gust;
+						wx->WindGust = sums.nearest_gust;
 						wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDGUST;
 					}
 				}
@@ -1238,9 +2547,9 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 			}
 
 			if (!set_wd) {
-				weak_assert(nearest_d != DBL_MAX);	// there is always at least one stream, so some stream must be nearest!
-				if (fabs(wx->WindDirection - nearest_wd) > 1e-7) {
-					wx->WindDirection = nearest_wd; // use instantaneous wd from the nearest wx stream
+				weak_assert(sums.nearest_d != DBL_MAX);	// there is always at least one stream, so some stream must be nearest!
+				if (fabs(wx->WindDirection - sums.nearest_wd) > 1e-7) {
+					wx->WindDirection = sums.nearest_wd; // use instantaneous wd from the nearest wx stream
 					wx->SpecifiedBits |= IWXDATA_OVERRODE_WINDDIRECTION;
 				}
 			}
@@ -1249,12 +2558,12 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 		if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) {
 			if (m_idwExponentPrecip != 0.0) {
 				if (wx->Precipitation != 0.0)
-					wx->Precipitation	/= weight_precip;
+					wx->Precipitation	/= sums.weight_precip;
 				wx->SpecifiedBits |= IWXDATA_OVERRODE_PRECIPITATION;
 			} else {
-				weak_assert(nearest_d != DBL_MAX); // there is always at least one stream, so some stream must be nearest!
-				if (fabs(wx->Precipitation - nearest_precip) > 1e-7) {
-					wx->Precipitation = nearest_precip; // use instantaneous precip from the nearest wx stream
+				weak_assert(sums.nearest_d != DBL_MAX); // there is always at least one stream, so some stream must be nearest!
+				if (fabs(wx->Precipitation - sums.nearest_precip) > 1e-7) {
+					wx->Precipitation = sums.nearest_precip; // use instantaneous precip from the nearest wx stream
 					wx->SpecifiedBits |= IWXDATA_OVERRODE_PRECIPITATION;
 				}
 			}
@@ -1281,6 +2590,91 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 		}			// these weather inputs have been changed now
 	}
 
+	if ((disk) && (!from_disk) && (hr == S_OK))
+		disk->Store(time, interpolate_method, x, y, elev, wx);
+	*wx_valid = true;
+	return hr;
+}
+
+
+// station weather at the start of an hour for a grid cell, used to blend sub-hour queries.  It's kept in the layer cache (so it's tiled,
+// sharded and budgeted like everything else) under a key holding just the bits the station interpolation depends on, plus a tag to keep it
+// apart from the full answers for that hour, which include the lower layers.
+HRESULT CCWFGM_WeatherGrid::hourlyStationWx(Layer *layerThread, WeatherLayerCache *layerCache, std::uint16_t alternate, const HSS_Time::WTime &hour, std::uint16_t x, std::uint16_t y, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid) {
+	WeatherKey key(x, y, hour, (interpolate_method & STATION_KEY_MASK) | HOURLY_KEY_TAG, layerThread, layerCache);
+	HIWXData iwx;
+	if (m_cache.Retrieve(alternate, &key, &iwx, m_timeManager)) {
+		*wx = iwx.wx;
+		*wx_valid = iwx.wx_valid;
+		return iwx.hr;
+	}
+
+	iwx.hr = stationWx(hour, pt, x, y, interpolate_method, true, &iwx.wx, &iwx.wx_valid);
+	m_cache.Store(alternate, &key, &iwx, m_timeManager);
+	*wx = iwx.wx;
+	*wx_valid = iwx.wx_valid;
+	return iwx.hr;
+}
+
+
+// this routine returns spatially interpolated weather data for the specified time and location
+HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid) {
+	std:uint16_t const alternate = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? 1 : 0;
+	const bool use_cache = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE) ? false : true);
+
+    #ifdef DEBUG
+	WTime t(time);
+	std::string theTime = t.ToString(WTIME_FORMAT_AS_LOCAL | WTIME_FORMAT_WITHDST | WTIME_FORMAT_ABBREV | WTIME_FORMAT_DATE | WTIME_FORMAT_TIME);
+    #endif
+
+	std::uint16_t x = convertX(pt.x, nullptr);
+	std::uint16_t y = convertY(pt.y, nullptr);
+	WeatherKey key(x, y, time, interpolate_method, layerThread, layerCache);
+
+	HIWXData iwx;
+	if ((use_cache) && (m_cache.Retrieve(alternate, &key, &iwx, m_timeManager))) {
+		*wx = iwx.wx;
+		*wx_valid = iwx.wx_valid;
+		return iwx.hr;
+	}
+
+	HRESULT hr;
+	bool blended = false;
+	if ((m_hourlyBlend) && (use_cache) && (x < m_xsize) && (y < m_ysize) &&
+	    (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL)) &&
+	    (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL))) {
+		WTime h1(time);
+		h1.PurgeToHour(WTIME_FORMAT_AS_LOCAL | WTIME_FORMAT_WITHDST);
+		if (h1 != time) {
+			WTime h2(h1);
+			h2 += WTimeSpan(0, 1, 0, 0);
+			IWXData wx1, wx2;
+			bool valid1, valid2;
+			HRESULT hr1 = hourlyStationWx(layerThread, layerCache, alternate, h1, x, y, pt, interpolate_method, &wx1, &valid1);
+			HRESULT hr2 = hourlyStationWx(layerThread, layerCache, alternate, h2, x, y, pt, interpolate_method, &wx2, &valid2);
+			if ((SUCCEEDED(hr1)) && (SUCCEEDED(hr2)) && (hr1 != CWFGM_WEATHER_INITIAL_VALUES_ONLY) && (hr2 != CWFGM_WEATHER_INITIAL_VALUES_ONLY) && (valid1) && (valid2)) {
+				const double perc2 = ((double)(time.GetTime(0) - h1.GetTime(0))) / 3600.0;
+				blendHourlyWeather(wx1, wx2, perc2, time <= (h1 + WTimeSpan(0, 0, 30, 0)), wx);
+				if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH))
+					wx->RH = dewPointRH(wx->Temperature, wx->DewPointTemperature);	// the same way the direct path gets it from interpolated temperatures
+				hr = hr1;
+				blended = true;
+			}					// otherwise calculate it directly so any error is reported the same way
+		}
+	}
+
+	if (!blended) {
+		hr = stationWx(time, pt, x, y, interpolate_method, use_cache, wx, wx_valid);
+		if ((FAILED(hr)) || (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY) || (!*wx_valid)) {
+			iwx.wx = *wx;
+			iwx.wx_valid = *wx_valid;
+			iwx.hr = hr;
+			if (use_cache)
+				m_cache.Store(alternate, &key, &iwx, m_timeManager);
+			return hr;
+		}
+	}
+
 	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
 	if (!gridEngine) {
 		weak_assert(false);
@@ -1334,12 +2728,93 @@ HRESULT CCWFGM_WeatherGrid::GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layer
 }
 
 
+// this routine returns the spatially interpolated rain over the 24 hours ending at todayStart.  Precipitation is interpolated linearly with
+// weights that only depend on location, so interpolating each station's total for the 23 earlier hours gives the same answer as totalling 23
+// interpolated hours, for the cost of one interpolation.  That's only true when nothing below this layer changes precipitation over those
+// hours (filters, rasters), otherwise the rain has to be built up hour by hour through the layers.
+HRESULT CCWFGM_WeatherGrid::GetRawDailyRain(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &todayStart, const HSS_Time::WTime &yesterday, const XY_Point &pt, std::uint64_t interpolate_method, const IWXData *wx1, double *rain) {
+	if ((!(interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL))) || (!m_primaryStream) || ((todayStart - yesterday) != WTimeSpan(1, 0, 0, 0)))
+		return WeatherUtilities::GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, rain);
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)
+		return WeatherUtilities::GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, rain);
+
+	const std::uint32_t precip_bits = IWXDATA_OVERRODE_PRECIPITATION | IWXDATA_OVERRODEHISTORY_PRECIPITATION;
+	if (wx1->SpecifiedBits & precip_bits)
+		return WeatherUtilities::GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, rain);
+
+	// filters and rasters hand E_NOTIMPL up even when they've changed the weather, and may only apply to part of the day, so every summed
+	// hour is checked by what the lower layers did to the weather rather than by what they returned
+	IWXData probe;
+	bool probe_valid;
+	WTime loop(todayStart);
+	for (loop -= WTimeSpan(0, 1, 0, 0); loop > yesterday; loop -= WTimeSpan(0, 1, 0, 0)) {
+		probe = *wx1;
+		probe.SpecifiedBits &= (~precip_bits);
+		HRESULT hr_probe = gridEngine->GetWeatherData(layerThread, pt, loop, interpolate_method, &probe, NULL, NULL, &probe_valid, nullptr);
+		if ((hr_probe != E_NOTIMPL) || (probe.SpecifiedBits & precip_bits) || (probe.Precipitation != wx1->Precipitation))
+			return WeatherUtilities::GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, rain);
+	}
+
+	double elev;
+	bool elev_valid;
+	std::uint16_t x = convertX(pt.x, nullptr);
+	std::uint16_t y = convertY(pt.y, nullptr);
+	if (FAILED(getElevation(pt, x, y, &elev, &elev_valid)) || (!elev_valid))	// leave odd cases to the hour by hour calculation
+		return WeatherUtilities::GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, rain);
+
+	HRESULT hr;
+	double r, nearest_d = DBL_MAX, nearest_precip = 0.0, primary_precip = 0.0;
+	double precip = 0.0, weight_precip = 0.0;
+	XY_Point pt2(pt.x, pt.y);
+	GStreamNode *sn = m_streamList.LH_Head();
+	while (sn->LN_Succ()) {
+		if (FAILED(hr = sn->GetStationDailyRain(todayStart, interpolate_method, m_primaryStream.get(), &r)))
+			return WeatherUtilities::GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, rain);
+
+		if (sn->m_stream == m_primaryStream)
+			primary_precip = r;
+
+		double d = sn->m_location.DistanceToSquared(pt2);
+		double ww = (d > 1.0) ? (1.0 / d) : 5.0;
+		if (m_idwExponentPrecip != 0.0) {
+			double ww_precip;
+			if (m_idwExponentPrecip != 2.0)
+				ww_precip = pow(ww, m_idwExponentPrecip * 0.5);
+			else
+				ww_precip = ww;
+			if (r != 0.0)
+				precip += ww_precip * r;
+			weight_precip += ww_precip;
+		}
+		if (d < nearest_d) {
+			nearest_d = d;
+			nearest_precip = r;
+		}
+		sn = (GStreamNode *)sn->LN_Succ();
+	}
+
+	if (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP)) {
+		if (m_idwExponentPrecip != 0.0) {
+			if (precip != 0.0)
+				precip /= weight_precip;
+			*rain = precip;
+		} else
+			*rain = nearest_precip;
+	} else
+		*rain = primary_precip;
+	*rain += wx1->Precipitation;
+	return S_OK;
+}
+
+
 // this routine gets spatially interpolated daily starting codes for the day specified by the parameter time.
 // it works as follows: user specifies a time - we find the previous day and the start of the current day
 // we lookup the daily starting codes from the previous day
 // we get the spatially interpolated local weather conditions for this location, at start of the current day.
 // we use yesterdays interpolated starting codes and todays interpolated weather to compute todays starting codes
-HRESULT CCWFGM_WeatherGrid::GetRawDFWIValues(ICWFGM_GridEngine * /*grid*/, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *p_dfwi, bool *wx_valid) {
+HRESULT CCWFGM_WeatherGrid::GetRawDFWIValues(ICWFGM_GridEngine * /*grid*/, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *p_dfwi, bool *wx_valid) {
 	const std::uint16_t alternate = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? true : false;
 	const bool use_cache = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE) ? false : true);
 
@@ -1361,7 +2836,7 @@ HRESULT CCWFGM_WeatherGrid::GetRawDFWIValues(ICWFGM_GridEngine * /*grid*/, Layer
 
 	std::uint16_t x = convertX(pt.x, nullptr);
 	std::uint16_t y = convertY(pt.y, nullptr);
-	WeatherKey key(x, y, time, interpolate_method, layerThread);
+	WeatherKey key(x, y, time, interpolate_method, layerThread, layerCache);
 
 	HDFWIData iwx;
 
@@ -1462,7 +2937,7 @@ HRESULT CCWFGM_WeatherGrid::GetRawDFWIValues(ICWFGM_GridEngine * /*grid*/, Layer
 }
 
 
-HRESULT CCWFGM_WeatherGrid::GetRawIFWIValues(ICWFGM_GridEngine * /*gridEngine*/, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, IFWIData *ifwi, bool *wx_valid) {
+HRESULT CCWFGM_WeatherGrid::GetRawIFWIValues(ICWFGM_GridEngine * /*gridEngine*/, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, IFWIData *ifwi, bool *wx_valid) {
 	const std::uint16_t alternate = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? true : false;
 	const bool use_cache = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE) ? false : true);
 
@@ -1477,7 +2952,7 @@ HRESULT CCWFGM_WeatherGrid::GetRawIFWIValues(ICWFGM_GridEngine * /*gridEngine*/,
 
 	std::uint16_t x = convertX(pt.x, nullptr);
 	std::uint16_t y = convertY(pt.y, nullptr);
-	WeatherKey key(x, y, time, interpolate_method, layerThread);
+	WeatherKey key(x, y, time, interpolate_method, layerThread, layerCache);
 
 	HIFWIData iwx;
 
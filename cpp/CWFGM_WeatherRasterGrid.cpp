@@ -0,0 +1,730 @@
+/**
+ * WISE_Weather_Module: CWFGM_WeatherRasterGrid.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "angles.h"
+#include "WeatherCom_ext.h"
+#include "FireEngine_ext.h"
+#include "propsysreplacement.h"
+#include "CWFGM_WeatherRasterGrid.h"
+#include <cpl_string.h>
+#include "CoordinateConverter.h"
+#include "GDALImporter.h"
+#include "gdalclient.h"
+#include "GDALextras.h"
+
+#include <algorithm>
+#include <climits>
+
+using namespace GDALExtras;
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+#define RASTER_NODATA	SHRT_MIN
+
+// fixed point scale, and valid range, of each variable as stored in a raster_frame
+static const double raster_scale[CWFGM_WEATHER_RASTER_VARIABLES] = { 0.01, 0.01, 0.01, 0.01, 0.1, 0.01 };
+static const double raster_min[CWFGM_WEATHER_RASTER_VARIABLES] = { -100.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+static const double raster_max[CWFGM_WEATHER_RASTER_VARIABLES] = { 100.0, 100.0, 300.0, 250.0, 360.0, 300.0 };
+
+
+raster_frame::raster_frame(const raster_frame &toCopy, std::uint32_t cnt) : m_time(toCopy.m_time) {
+	for (std::uint16_t i = 0; i < CWFGM_WEATHER_RASTER_VARIABLES; i++) {
+		m_filename[i] = toCopy.m_filename[i];
+		if (toCopy.m_data[i]) {
+			m_data[i] = new std::int16_t[cnt];
+			memcpy(m_data[i], toCopy.m_data[i], sizeof(std::int16_t) * cnt);
+		} else
+			m_data[i] = nullptr;
+	}
+}
+
+
+CCWFGM_WeatherRasterGrid::CCWFGM_WeatherRasterGrid() : m_timeManager(nullptr) {
+	m_xsize = m_ysize = (std::uint16_t)-1;
+	m_resolution = -1.0;
+	m_xllcorner = m_yllcorner = -999999999.0;
+}
+
+
+CCWFGM_WeatherRasterGrid::CCWFGM_WeatherRasterGrid(const CCWFGM_WeatherRasterGrid &toCopy) : m_timeManager(toCopy.m_timeManager) {
+	CRWThreadSemaphoreEngage engage(*(CRWThreadSemaphore *)&toCopy.m_lock, SEM_FALSE);
+
+	m_xsize = toCopy.m_xsize;
+	m_ysize = toCopy.m_ysize;
+	m_resolution = toCopy.m_resolution;
+	m_xllcorner = toCopy.m_xllcorner;
+	m_yllcorner = toCopy.m_yllcorner;
+
+	for (std::vector<raster_frame *>::const_iterator it = toCopy.m_frames.begin(); it != toCopy.m_frames.end(); it++)
+		m_frames.push_back(new raster_frame(**it, (std::uint32_t)m_xsize * (std::uint32_t)m_ysize));
+}
+
+
+CCWFGM_WeatherRasterGrid::~CCWFGM_WeatherRasterGrid() {
+	for (std::vector<raster_frame *>::iterator it = m_frames.begin(); it != m_frames.end(); it++)
+		delete *it;
+}
+
+#endif
+
+
+HRESULT CCWFGM_WeatherRasterGrid::Clone(boost::intrusive_ptr<ICWFGM_CommonBase> *newObject) const {
+	if (!newObject)							return E_POINTER;
+
+	CRWThreadSemaphoreEngage engage(*(CRWThreadSemaphore *)&m_lock, SEM_FALSE);
+
+	try {
+		CCWFGM_WeatherRasterGrid *f = new CCWFGM_WeatherRasterGrid(*this);
+		*newObject = f;
+		return S_OK;
+	}
+	catch (std::exception& e) {
+	}
+	return E_FAIL;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::Import(const HSS_Time::WTime &time, const std::uint16_t variable, const std::string &grid_file_name) {
+	HRESULT hr = S_OK;
+	if (!grid_file_name.length())						return E_INVALIDARG;
+	if (variable >= CWFGM_WEATHER_RASTER_VARIABLES)				return E_INVALIDARG;
+	SEM_BOOL engaged;
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_TRUE, &engaged, 1000000LL);
+	if (!engaged)								return ERROR_SCENARIO_SIMULATION_RUNNING;
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> engine;
+	if (!(engine = m_gridEngine(nullptr)))					{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	GDALImporter importer;
+	if (importer.Import(grid_file_name.c_str(), nullptr) != GDALImporter::ImportResult::OK)
+		return E_FAIL;
+
+	CSemaphoreEngage lock(GDALClient::GDALClient::getGDALMutex(), true);
+
+	if (strlen(importer.projection())) {
+		OGRSpatialReferenceH sourceSRS = CCoordinateConverter::CreateSpatialReferenceFromStr(importer.projection());
+
+		PolymorphicAttribute v;
+		if (FAILED(hr = engine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_SPATIALREFERENCE, &v))) {
+			if (sourceSRS)
+				OSRDestroySpatialReference(sourceSRS);
+			return hr;
+		}
+
+		std::string csProject;
+		try { csProject = std::get<std::string>(v); } catch (std::bad_variant_access&) { weak_assert(false); return ERROR_PROJECTION_UNKNOWN; };
+
+		OGRSpatialReferenceH gridSRS = CCoordinateConverter::CreateSpatialReferenceFromWkt(csProject.c_str());
+		bool same = (gridSRS) && (sourceSRS) && (OSRIsSame(gridSRS, sourceSRS, false));
+		if (sourceSRS)
+			OSRDestroySpatialReference(sourceSRS);
+		if (gridSRS)
+			OSRDestroySpatialReference(gridSRS);
+		else
+			return E_FAIL;
+		if (!same)
+			return ERROR_GRID_LOCATION_OUT_OF_RANGE;
+	}
+
+	GDALImporter::ImportType data = importer.importType();
+	if ((data != GDALImporter::ImportType::LONG) &&
+		(data != GDALImporter::ImportType::SHORT) &&
+		(data != GDALImporter::ImportType::USHORT) &&
+		(data != GDALImporter::ImportType::ULONG) &&
+		(data != GDALImporter::ImportType::FLOAT32) &&
+		(data != GDALImporter::ImportType::FLOAT64))
+		return E_FAIL;
+
+	double gridXLL, gridYLL, gridResolution;
+	std::uint16_t gridXDim, gridYDim;
+
+	PolymorphicAttribute var;
+	try {
+		if (FAILED(hr = engine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_PLOTRESOLUTION, &var))) return hr;
+		gridResolution = std::get<double>(var);
+
+		if (FAILED(hr = engine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_XLLCORNER, &var))) return hr;
+		gridXLL = std::get<double>(var);
+
+		if (FAILED(hr = engine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_YLLCORNER, &var))) return hr;
+		gridYLL = std::get<double>(var);
+	} catch (std::bad_variant_access&) {
+		weak_assert(false);
+		return ERROR_GRID_UNINITIALIZED;
+	}
+
+	if (FAILED(hr = engine->GetDimensions(0, &gridXDim, &gridYDim)))
+		return hr;
+	if ((gridXDim != importer.xSize()) ||
+		(gridYDim != importer.ySize()))
+		return ERROR_GRID_SIZE_INCORRECT;
+	if (fabs(gridResolution - importer.xPixelSize()) > 0.0001)
+		return ERROR_GRID_UNSUPPORTED_RESOLUTION;
+	if ((fabs(gridXLL - importer.lowerLeftX()) > 0.001) ||
+		(fabs(gridYLL - importer.lowerLeftY()) > 0.001))
+		return ERROR_GRID_LOCATION_OUT_OF_RANGE;
+
+	const std::uint32_t cnt = (std::uint32_t)gridXDim * (std::uint32_t)gridYDim;
+	const double noData = importer.nodata();
+	std::int16_t *values;
+	try {
+		values = new std::int16_t[cnt];
+	} catch (std::bad_alloc&) {
+		return E_OUTOFMEMORY;
+	}
+
+	for (std::uint32_t i = 0; i < cnt; i++) {
+		double v = importer.doubleData(1, i);
+		if (v == noData)
+			values[i] = RASTER_NODATA;
+		else if ((v < raster_min[variable]) || (v > raster_max[variable])) {
+			delete [] values;
+			return ERROR_INVALID_DATA | ERROR_SEVERITY_WARNING;
+		}
+		else
+			values[i] = (std::int16_t)floor(v / raster_scale[variable] + 0.5);
+	}
+
+	std::vector<raster_frame *>::iterator it = findFrame(time);
+	if (variable == CWFGM_WEATHER_RASTER_PRECIPITATION) {	// accumulations are spread over whole hours, so they have to line up with them
+		const std::int64_t hour = 60LL * 60LL * 1000000LL;
+		for (std::vector<raster_frame *>::iterator h = it; h != m_frames.end(); h++)
+			if (((*h)->m_data[variable]) && ((*h)->m_time != time)) {
+				if (((*h)->m_time - time).GetTotalMicroSeconds() % hour) {
+					delete [] values;
+					return E_INVALIDARG;
+				}
+				break;
+			}
+		for (std::vector<raster_frame *>::iterator l = it; l != m_frames.begin(); ) {
+			l--;
+			if ((*l)->m_data[variable]) {
+				if ((time - (*l)->m_time).GetTotalMicroSeconds() % hour) {
+					delete [] values;
+					return E_INVALIDARG;
+				}
+				break;
+			}
+		}
+	}
+
+	raster_frame *frame;
+	if ((it != m_frames.end()) && ((*it)->m_time == time))
+		frame = *it;
+	else {
+		frame = new raster_frame(WTime(time, m_timeManager));
+		m_frames.insert(it, frame);
+	}
+	if (frame->m_data[variable])
+		delete [] frame->m_data[variable];
+	frame->m_data[variable] = values;
+	frame->m_filename[variable] = grid_file_name;
+
+	m_xsize = gridXDim;
+	m_ysize = gridYDim;
+	m_resolution = gridResolution;
+	m_xllcorner = gridXLL;
+	m_yllcorner = gridYLL;
+
+	return hr;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::Remove(const HSS_Time::WTime &time, const std::uint16_t variable) {
+	if ((variable != (std::uint16_t)-1) && (variable >= CWFGM_WEATHER_RASTER_VARIABLES))	return E_INVALIDARG;
+	SEM_BOOL engaged;
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_TRUE, &engaged, 1000000LL);
+	if (!engaged)								return ERROR_SCENARIO_SIMULATION_RUNNING;
+
+	std::vector<raster_frame *>::iterator it = findFrame(time);
+	if ((it == m_frames.end()) || ((*it)->m_time != time))
+		return ERROR_GRID_TIME_OUT_OF_RANGE;
+
+	raster_frame *frame = *it;
+	for (std::uint16_t i = 0; i < CWFGM_WEATHER_RASTER_VARIABLES; i++)
+		if ((variable == (std::uint16_t)-1) || (variable == i)) {
+			if (frame->m_data[i]) {
+				delete [] frame->m_data[i];
+				frame->m_data[i] = nullptr;
+			}
+			frame->m_filename[i].clear();
+		}
+	if (frame->Empty()) {
+		m_frames.erase(it);
+		delete frame;
+	}
+	return S_OK;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::GetTimes(std::vector<HSS_Time::WTime> *times) {
+	if (!times)								return E_POINTER;
+
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_FALSE);
+
+	times->clear();
+	for (std::vector<raster_frame *>::const_iterator it = m_frames.begin(); it != m_frames.end(); it++)
+		times->push_back((*it)->m_time);
+	return S_OK;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::GetAttribute(std::uint16_t option, PolymorphicAttribute *value) {
+	if (!value)						return E_POINTER;
+
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_FALSE);
+
+	std::string empty;
+	switch (option) {
+		case CWFGM_WEATHER_OPTION_START_TIME:		if (m_frames.size()) *value = m_frames.front()->m_time; else *value = WTime((std::uint64_t)0, m_timeManager); return S_OK;
+		case CWFGM_WEATHER_OPTION_END_TIME:			if (m_frames.size()) *value = m_frames.back()->m_time; else *value = WTime((std::uint64_t)0, m_timeManager); return S_OK;
+		case CWFGM_ATTRIBUTE_LOAD_WARNING:
+			{
+				*value = empty;
+				return S_OK;
+			}
+	}
+	return E_INVALIDARG;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::SetAttribute(std::uint16_t /*option*/, const PolymorphicAttribute & /*value*/) {
+	SEM_BOOL engaged;
+	CRWThreadSemaphoreEngage engage(m_lock, SEM_TRUE, &engaged, 1000000LL);
+	if (!engaged)								return ERROR_SCENARIO_SIMULATION_RUNNING;
+
+	return E_INVALIDARG;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::MT_Lock(Layer *layerThread, bool exclusive, std::uint16_t obtain) {
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)	{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	HRESULT hr = S_OK;
+	if (obtain == (std::uint16_t)-1) {
+		std::int64_t state = m_lock.CurrentState();
+		if (!state)						return SUCCESS_STATE_OBJECT_UNLOCKED;
+		if (state < 0)					return SUCCESS_STATE_OBJECT_LOCKED_WRITE;
+		if (state >= 1000000LL)			return SUCCESS_STATE_OBJECT_LOCKED_SCENARIO;
+		return								   SUCCESS_STATE_OBJECT_LOCKED_READ;
+	} else if (obtain) {
+		if (exclusive)	m_lock.Lock_Write();
+		else			m_lock.Lock_Read(1000000LL);
+
+		hr = gridEngine->MT_Lock(layerThread, exclusive, obtain);
+	} else {
+		hr = gridEngine->MT_Lock(layerThread, exclusive, obtain);
+
+		if (exclusive)	m_lock.Unlock();
+		else			m_lock.Unlock(1000000LL);
+	}
+	return hr;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::Valid(Layer *layerThread, const HSS_Time::WTime &start_time, const HSS_Time::WTimeSpan &duration, std::uint32_t option, std::vector<uint16_t> *application_count) {
+	if (((option & (~(1 << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)))) && (!application_count))					return E_POINTER;
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)							{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+	HRESULT hr = gridEngine->Valid(layerThread, start_time, duration, option, application_count);
+
+	const std::uint32_t opt = option & (~(1 << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE));
+	if ((opt == CWFGM_WEATHER_WXGRID_WS_DIURNALTIMES) || (opt == CWFGM_WEATHER_WXGRID_WD_DIURNALTIMES)) {
+		const std::uint16_t variable = (opt == CWFGM_WEATHER_WXGRID_WS_DIURNALTIMES) ? CWFGM_WEATHER_RASTER_WINDSPEED : CWFGM_WEATHER_RASTER_WINDDIRECTION;
+		if (((std::int64_t)application_count->size()) <= duration.GetTotalSeconds())
+			application_count->resize(duration.GetTotalSeconds() + 1);
+		for (std::int64_t i = 0; i < duration.GetTotalSeconds(); i++)
+			if (covers(variable, start_time + WTimeSpan(i)))
+				(*application_count)[i] = (*application_count)[i] + 1;
+		return S_OK;
+	}
+	return hr;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::GetAttribute(Layer *layerThread, std::uint16_t option, PolymorphicAttribute *value) {
+	if (!layerThread) {
+		HRESULT hr = GetAttribute(option, value);
+		if (SUCCEEDED(hr))
+			return hr;
+	}
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)							{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+	return gridEngine->GetAttribute(layerThread, option, value);
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::GetWeatherData(Layer *layerThread, const XY_Point &pt, const HSS_Time::WTime &time, std::uint64_t interpolate_method, IWXData *wx, IFWIData *ifwi, DFWIData *dfwi, bool *wx_valid, XY_Rectangle *bbox_cache) {
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)							{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	return getWeatherData(gridEngine.get(), layerThread, pt, time, interpolate_method, wx, ifwi, dfwi, wx_valid, bbox_cache);
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::GetWeatherDataArray(Layer *layerThread, const XY_Point &min_pt, const XY_Point &max_pt, double scale, const HSS_Time::WTime &time, std::uint64_t interpolate_method,
+	IWXData_2d *wx, IFWIData_2d *ifwi, DFWIData_2d *dfwi, bool_2d *wx_valid) {
+
+	if (scale != m_resolution) { weak_assert(false); return ERROR_GRID_UNSUPPORTED_RESOLUTION; }
+
+	std::uint16_t x_min = convertX(min_pt.x, nullptr), y_min = convertY(min_pt.y, nullptr);
+	std::uint16_t x_max = convertX(max_pt.x, nullptr), y_max = convertY(max_pt.y, nullptr);
+	std::uint32_t xdim = x_max - x_min + 1;
+	std::uint32_t ydim = y_max - y_min + 1;
+
+	if (wx) {
+		const IWXData_2d::size_type *dims = wx->shape();
+		if ((dims[0] < xdim) || (dims[1] < ydim)) return E_INVALIDARG;
+	}
+	if (ifwi) {
+		const IFWIData_2d::size_type *dims = ifwi->shape();
+		if ((dims[0] < xdim) || (dims[1] < ydim)) return E_INVALIDARG;
+	}
+	if (dfwi) {
+		const DFWIData_2d::size_type *dims = dfwi->shape();
+		if ((dims[0] < xdim) || (dims[1] < ydim)) return E_INVALIDARG;
+	}
+	if (wx_valid) {
+		const bool_2d::size_type *dims = wx_valid->shape();
+		if ((dims[0] < xdim) || (dims[1] < ydim)) return E_INVALIDARG;
+	}
+
+	if (x_min > x_max)							return E_INVALIDARG;
+	if (y_min > y_max)							return E_INVALIDARG;
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)							{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	IWXData _iwx;
+	IFWIData _ifwi;
+	DFWIData _dfwi;
+	bool _wxv;
+
+	XY_Point pt;
+	std::uint16_t x, y;
+	HRESULT hr = S_OK;
+	bool first = true;
+	for (y = y_min; y <= y_max; y++) {
+		for (x = x_min; x <= x_max; x++) {
+			pt.x = invertX(((double)x) + 0.5);
+			pt.y = invertY(((double)y) + 0.5);
+
+			HRESULT hrr = getWeatherData(gridEngine.get(), layerThread, pt, time, interpolate_method, wx ? &_iwx : nullptr, ifwi ? &_ifwi : nullptr, dfwi ? &_dfwi : nullptr, wx_valid ? &_wxv : nullptr, nullptr);
+
+			if (SUCCEEDED(hrr)) {
+				if (first)
+					hr = hrr;
+				if (wx)
+					(*wx)[x - x_min][y - y_min] = _iwx;
+				if (ifwi)
+					(*ifwi)[x - x_min][y - y_min] = _ifwi;
+				if (dfwi)
+					(*dfwi)[x - x_min][y - y_min] = _dfwi;
+				if (wx_valid)
+					(*wx_valid)[x - x_min][y - y_min] = _wxv;
+			}
+			first = false;
+		}
+	}
+
+	return hr;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::GetEventTime(Layer *layerThread, const XY_Point& pt, std::uint32_t flags, const HSS_Time::WTime &from_time, HSS_Time::WTime *next_event, bool *event_valid) {
+	if (!next_event)							return E_POINTER;
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine = m_gridEngine(layerThread);
+	if (!gridEngine)							{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	HRESULT hr = gridEngine->GetEventTime(layerThread, pt, flags, from_time, next_event, event_valid);
+	if (flags & (CWFGM_GETEVENTTIME_FLAG_SEARCH_SUNRISE | CWFGM_GETEVENTTIME_FLAG_SEARCH_SUNSET))
+		return hr;
+
+	if (SUCCEEDED(hr) && (m_frames.size()) && (!(flags & (CWFGM_GETEVENTTIME_QUERY_PRIMARY_WX_STREAM | CWFGM_GETEVENTTIME_QUERY_ANY_WX_STREAM)))) {
+		std::vector<raster_frame *>::iterator it = findFrame(from_time);	// first frame at or after from_time
+		if (!(flags & CWFGM_GETEVENTTIME_FLAG_SEARCH_BACKWARD)) {
+			if ((it != m_frames.end()) && ((*it)->m_time == from_time))
+				it++;
+			if ((it != m_frames.end()) && ((*it)->m_time < *next_event))
+				next_event->SetTime((*it)->m_time);
+		} else {
+			if (it != m_frames.begin()) {
+				it--;
+				if ((*it)->m_time > *next_event)
+					next_event->SetTime((*it)->m_time);
+			}
+		}
+	}
+	return hr;
+}
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+// Returns the first frame at or after 'time'.
+std::vector<raster_frame *>::iterator CCWFGM_WeatherRasterGrid::findFrame(const HSS_Time::WTime &time) {
+	return std::lower_bound(m_frames.begin(), m_frames.end(), time, [](const raster_frame *f, const WTime &t) { return f->m_time < t; });
+}
+
+
+// Whether 'time' lies within the span of the rasters loaded for 'variable'.
+bool CCWFGM_WeatherRasterGrid::covers(std::uint16_t variable, const HSS_Time::WTime &time) const {
+	bool before = false, after = false;
+	for (std::vector<raster_frame *>::const_iterator it = m_frames.begin(); it != m_frames.end(); it++)
+		if ((*it)->m_data[variable]) {
+			if ((*it)->m_time <= time)	before = true;
+			if ((*it)->m_time >= time)	after = true;
+			if (before && after)
+				return true;
+		}
+	return false;
+}
+
+
+// Looks up the rasters for 'variable' bracketing 'time' at cell 'index'.  'value' is from the raster at or before 'time', 'value2' from the raster after it, and 'perc2' is
+// how far 'time' is between them.  Without temporal interpolation, or when 'time' is exactly on a raster, 'value2' is 'value' and 'perc2' is 0.  Returns false if 'time' isn't
+// covered by the rasters for 'variable' or either cell is no data.
+bool CCWFGM_WeatherRasterGrid::rasterValue(std::uint16_t variable, std::uint32_t index, const HSS_Time::WTime &time, bool temporal, double *value, double *value2, double *perc2) const {
+	std::vector<raster_frame *>::const_iterator it = std::lower_bound(m_frames.begin(), m_frames.end(), time, [](const raster_frame *f, const WTime &t) { return f->m_time < t; });
+
+	const raster_frame *lo = nullptr, *hi = nullptr;
+	for (std::vector<raster_frame *>::const_iterator h = it; h != m_frames.end(); h++)
+		if ((*h)->m_data[variable]) {
+			hi = *h;
+			break;
+		}
+	if (!hi)
+		return false;
+	if (hi->m_time == time)
+		lo = hi;
+	else {
+		for (std::vector<raster_frame *>::const_iterator l = it; l != m_frames.begin(); ) {
+			l--;
+			if ((*l)->m_data[variable]) {
+				lo = *l;
+				break;
+			}
+		}
+		if (!lo)
+			return false;
+	}
+
+	std::int16_t v1 = lo->m_data[variable][index];
+	if (v1 == RASTER_NODATA)
+		return false;
+	*value = ((double)v1) * raster_scale[variable];
+
+	if ((!temporal) || (lo == hi)) {
+		*value2 = *value;
+		*perc2 = 0.0;
+		return true;
+	}
+
+	std::int16_t v2 = hi->m_data[variable][index];
+	if (v2 == RASTER_NODATA)
+		return false;
+	*value2 = ((double)v2) * raster_scale[variable];
+	*perc2 = ((double)(time - lo->m_time).GetTotalMicroSeconds()) / ((double)(hi->m_time - lo->m_time).GetTotalMicroSeconds());
+	return true;
+}
+
+
+// The precipitation at cell 'index' for the hour ending at 'time'.  Each precipitation raster is the accumulation since the previous one (or over the hour
+// ending at it, for the first one), spread evenly over that period.  Returns false if 'time' isn't in any raster's period, or the cell is no data.
+bool CCWFGM_WeatherRasterGrid::rasterPrecipitation(std::uint32_t index, const HSS_Time::WTime &time, double *precip) const {
+	const std::uint16_t variable = CWFGM_WEATHER_RASTER_PRECIPITATION;
+	const std::int64_t hour = 60LL * 60LL * 1000000LL;
+	std::vector<raster_frame *>::const_iterator it = std::lower_bound(m_frames.begin(), m_frames.end(), time, [](const raster_frame *f, const WTime &t) { return f->m_time < t; });
+
+	const raster_frame *lo = nullptr, *hi = nullptr;
+	for (std::vector<raster_frame *>::const_iterator h = it; h != m_frames.end(); h++)
+		if ((*h)->m_data[variable]) {
+			hi = *h;
+			break;
+		}
+	if (!hi)
+		return false;
+	for (std::vector<raster_frame *>::const_iterator l = std::lower_bound(m_frames.begin(), m_frames.end(), hi->m_time, [](const raster_frame *f, const WTime &t) { return f->m_time < t; }); l != m_frames.begin(); ) {
+		l--;
+		if ((*l)->m_data[variable]) {
+			lo = *l;
+			break;
+		}
+	}
+
+	const std::int64_t period = (lo) ? (hi->m_time - lo->m_time).GetTotalMicroSeconds() : hour;
+	if ((hi->m_time - time).GetTotalMicroSeconds() >= period)
+		return false;
+
+	std::int16_t v = hi->m_data[variable][index];
+	if (v == RASTER_NODATA)
+		return false;
+	*precip = ((double)v) * raster_scale[variable] * ((double)hour) / ((double)period);
+	return true;
+}
+
+
+// Gets weather from the lower layer (e.g. other filters), then overrides it with values from the rasters.  This runs after the weather grid has interpolated
+// its stations, it doesn't replace that work.  Overridden values are flagged so the weather grid recalculates FWI values from them.
+HRESULT CCWFGM_WeatherRasterGrid::getWeatherData(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const XY_Point &pt, const HSS_Time::WTime &time, std::uint64_t interpolate_method, IWXData *wx, IFWIData *ifwi, DFWIData *dfwi, bool *wx_valid, XY_Rectangle *bbox_cache) {
+	HRESULT hr = gridEngine->GetWeatherData(layerThread, pt, time, interpolate_method, wx, ifwi, dfwi, wx_valid, bbox_cache);
+	if (FAILED(hr))
+		if (hr != E_NOTIMPL)
+			return hr;
+
+	if ((!wx) || (interpolate_method & CWFGM_GETEVENTTIME_QUERY_PRIMARY_WX_STREAM) || (!m_frames.size()))
+		return hr;
+
+	std::uint16_t x = convertX(pt.x, bbox_cache);
+	std::uint16_t y = convertY(pt.y, bbox_cache);
+	if ((x >= m_xsize) || (y >= m_ysize))
+		return hr;
+	const std::uint32_t index = arrayIndex(x, y);
+	const bool temporal = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL)) ? true : false;
+	double v1, v2, perc2;
+	bool calc_dew = false, overrode = false;
+
+	if (rasterValue(CWFGM_WEATHER_RASTER_TEMPERATURE, index, time, temporal, &v1, &v2, &perc2)) {
+		wx->Temperature = v1 * (1.0 - perc2) + v2 * perc2;
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_TEMPERATURE | IWXDATA_OVERRODE_TEMPERATURE;
+		overrode = true;
+		calc_dew = true;
+	}
+	if (rasterValue(CWFGM_WEATHER_RASTER_RH, index, time, temporal, &v1, &v2, &perc2)) {
+		wx->RH = (v1 * (1.0 - perc2) + v2 * perc2) * 0.01;
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_RH | IWXDATA_OVERRODE_RH;
+		overrode = true;
+		calc_dew = true;
+	}
+	if (rasterPrecipitation(index, time, &v1)) {
+		wx->Precipitation = v1;
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_PRECIPITATION | IWXDATA_OVERRODE_PRECIPITATION;
+		overrode = true;
+	}
+	if (rasterValue(CWFGM_WEATHER_RASTER_WINDSPEED, index, time, temporal, &v1, &v2, &perc2)) {
+		wx->WindSpeed = v1 * (1.0 - perc2) + v2 * perc2;
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_WINDSPEED | IWXDATA_OVERRODE_WINDSPEED;
+		overrode = true;
+	}
+	if (rasterValue(CWFGM_WEATHER_RASTER_WINDGUST, index, time, temporal, &v1, &v2, &perc2)) {
+		wx->WindGust = v1 * (1.0 - perc2) + v2 * perc2;
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_WINDGUST | IWXDATA_OVERRODE_WINDGUST;
+		overrode = true;
+	}
+	if (rasterValue(CWFGM_WEATHER_RASTER_WINDDIRECTION, index, time, temporal, &v1, &v2, &perc2)) {
+		double wd1 = NORMALIZE_ANGLE_RADIAN(DEGREE_TO_RADIAN(COMPASS_TO_CARTESIAN_DEGREE(v1)));
+		double wd2 = NORMALIZE_ANGLE_RADIAN(DEGREE_TO_RADIAN(COMPASS_TO_CARTESIAN_DEGREE(v2)));
+		double wd_diff = NORMALIZE_ANGLE_RADIAN(wd2 - wd1);
+		if (wd_diff > CONSTANTS_NAMESPACE::Pi<double>())
+			wd_diff -= CONSTANTS_NAMESPACE::TwoPi<double>();
+		wx->WindDirection = NORMALIZE_ANGLE_RADIAN(wd1 + perc2 * wd_diff);
+		wx->SpecifiedBits |= IWXDATA_SPECIFIED_WINDDIRECTION | IWXDATA_OVERRODE_WINDDIRECTION;
+		overrode = true;
+	}
+
+	if (calc_dew) {
+		double VPs = 0.6112 * pow(10.0, 7.5 * wx->Temperature / (237.7 + wx->Temperature));
+		double VP = wx->RH * VPs;
+		if (VP > 0.0)
+			wx->DewPointTemperature = 237.7 * log10(VP / 0.6112) / (7.5 - log10(VP / 0.6112));
+		else	wx->DewPointTemperature = -273.0;
+		wx->SpecifiedBits &= (~(IWXDATA_SPECIFIED_DEWPOINTTEMPERATURE));
+		wx->SpecifiedBits |= IWXDATA_OVERRODE_DEWPOINTTEMPERATURE;
+	}
+	if (wx_valid)
+		*wx_valid = true;
+	if ((overrode) && (hr == E_NOTIMPL))		// we've provided weather, so don't pass on the lower layers' "not implemented"
+		hr = S_OK;
+	return hr;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::PutGridEngine(Layer *layerThread, ICWFGM_GridEngine *newVal) {
+	HRESULT hr = ICWFGM_GridEngine::PutGridEngine(layerThread, newVal);
+	if (SUCCEEDED(hr) && m_gridEngine(nullptr)) {
+		HRESULT hr = fixResolution();
+		weak_assert(SUCCEEDED(hr));
+	}
+	return hr;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::PutCommonData(Layer* /*layerThread*/, ICWFGM_CommonData* pVal) {
+	if (!pVal)
+		return E_POINTER;
+	m_timeManager = pVal->m_timeManager;
+	for (std::vector<raster_frame *>::iterator it = m_frames.begin(); it != m_frames.end(); it++)
+		(*it)->m_time.SetTimeManager(m_timeManager);
+	return S_OK;
+}
+
+
+HRESULT CCWFGM_WeatherRasterGrid::fixResolution() {
+	HRESULT hr;
+	double gridResolution, gridXLL, gridYLL;
+	PolymorphicAttribute var;
+
+	boost::intrusive_ptr<ICWFGM_GridEngine> gridEngine;
+	if (!(gridEngine = m_gridEngine(nullptr)))					{ weak_assert(false); return ERROR_GRID_UNINITIALIZED; }
+
+	if (!m_timeManager) {
+		weak_assert(false);
+		ICWFGM_CommonData* data;
+		if (FAILED(hr = gridEngine->GetCommonData(nullptr, &data)) || (!data)) return hr;
+		m_timeManager = data->m_timeManager;
+	}
+	if (FAILED(hr = gridEngine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_PLOTRESOLUTION, &var))) return hr; VariantToDouble_(var, &gridResolution);
+	if (FAILED(hr = gridEngine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_XLLCORNER, &var))) return hr; VariantToDouble_(var, &gridXLL);
+	if (FAILED(hr = gridEngine->GetAttribute(nullptr, CWFGM_GRID_ATTRIBUTE_YLLCORNER, &var))) return hr; VariantToDouble_(var, &gridYLL);
+	if (FAILED(hr = gridEngine->GetDimensions(0, &m_xsize, &m_ysize))) return hr;
+
+	m_resolution = gridResolution;
+	m_xllcorner = gridXLL;
+	m_yllcorner = gridYLL;
+
+	return S_OK;
+}
+
+#endif
+
+
+std::uint16_t CCWFGM_WeatherRasterGrid::convertX(double x, XY_Rectangle* bbox) {
+	double lx = x - m_xllcorner;
+	double cx = floor(lx / m_resolution);
+	if (bbox) {
+		bbox->m_min.x = cx * m_resolution + m_xllcorner;
+		bbox->m_max.x = bbox->m_min.x + m_resolution;
+	}
+	return (std::uint16_t)cx;
+}
+
+
+std::uint16_t CCWFGM_WeatherRasterGrid::convertY(double y, XY_Rectangle* bbox) {
+	double ly = y - m_yllcorner;
+	double cy = floor(ly / m_resolution);
+	if (bbox) {
+		bbox->m_min.y = cy * m_resolution + m_yllcorner;
+		bbox->m_max.y = bbox->m_min.y + m_resolution;
+	}
+	return (std::uint16_t)cy;
+}
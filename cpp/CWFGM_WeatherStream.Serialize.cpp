@@ -57,7 +57,7 @@ HRESULT CCWFGM_WeatherStream::Import(const std::string & fileName, std::uint16_t
 	HRESULT success = m_weatherCondition.Import(fileName.c_str(), options, nullptr);
 	m_bRequiresSave = true;
 	m_weatherCondition.m_options |= 0x00000020;
-	m_cache.Clear();
+	clearCache();
 	return success;
 }
 
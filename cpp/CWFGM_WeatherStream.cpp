@@ -66,7 +66,7 @@ HRESULT CCWFGM_WeatherStream::put_WeatherStation(/*DWORD*/long key, CCWFGM_Weath
 	if (key != 0x12345678)							return E_NOINTERFACE;
 	if (newVal) {
 		if (newVal == (CCWFGM_WeatherStation *)-1) {			// special flag to say we have to re-calc
-			m_cache.Clear();
+			clearCache();
 			m_weatherCondition.ClearConditions();
 			return S_OK;
 		}
@@ -89,7 +89,7 @@ HRESULT CCWFGM_WeatherStream::put_WeatherStation(/*DWORD*/long key, CCWFGM_Weath
 		retval = S_OK;
 	}
 
-	m_cache.Clear();
+	clearCache();
 	m_weatherCondition.ClearConditions();
 	return retval;
 }
@@ -226,7 +226,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_FFMC_VANWAGNER:
 								if (FAILED(hr = VariantToBoolean_(v_value, &value))) return hr;
 								if ((value) && ((m_weatherCondition.m_options & 0x00000007) != WeatherCondition::FFMC_VAN_WAGNER)) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_options &= (~(0x0000007));	// also turn off the user override
 									m_weatherCondition.m_options |= WeatherCondition::FFMC_VAN_WAGNER;
@@ -237,7 +237,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_FFMC_LAWSON:
 								if (FAILED(hr = VariantToBoolean_(v_value, &value))) return hr;
 								if ((value) && ((m_weatherCondition.m_options & 0x00000007) != WeatherCondition::FFMC_LAWSON)) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_options &= (~(0x0000007));	// also turn off the user override
 									m_weatherCondition.m_options |= WeatherCondition::FFMC_LAWSON;
@@ -247,7 +247,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 
 		case CWFGM_WEATHER_OPTION_FWI_USE_SPECIFIED:
 								if (FAILED(hr = VariantToBoolean_(v_value, &value))) return hr;
-								m_cache.Clear();
+								clearCache();
 								m_weatherCondition.ClearConditions();
 								if (!value)	m_weatherCondition.m_options &= (~(WeatherCondition::USER_SPECIFIED));
 								else		m_weatherCondition.m_options |= WeatherCondition::USER_SPECIFIED;
@@ -257,7 +257,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_TEMP_ALPHA:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_temp_alpha != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_temp_alpha = dvalue;
 									m_bRequiresSave = true;
@@ -266,7 +266,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_TEMP_BETA:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_temp_beta != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_temp_beta = dvalue;
 									m_bRequiresSave = true;
@@ -275,7 +275,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_TEMP_GAMMA:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_temp_gamma != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_temp_gamma = dvalue;
 									m_bRequiresSave = true;
@@ -284,7 +284,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_WIND_ALPHA:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_wind_alpha != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_wind_alpha = dvalue;
 									m_bRequiresSave = true;
@@ -293,7 +293,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_WIND_BETA:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_wind_beta != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_wind_beta = dvalue;
 									m_bRequiresSave = true;
@@ -302,7 +302,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_WIND_GAMMA:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_wind_gamma != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_wind_gamma = dvalue;
 									m_bRequiresSave = true;
@@ -314,7 +314,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if (dvalue < 0.0)	return E_INVALIDARG;
 								if (dvalue > 101.0)	return E_INVALIDARG;
 								if (m_weatherCondition.m_spec_day.dFFMC != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_spec_day.dFFMC = dvalue;
 									m_bRequiresSave = true;
@@ -325,7 +325,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if (dvalue < 0.0)	return E_INVALIDARG;
 								if (dvalue > 101.0)	return E_INVALIDARG;
 								if ((m_weatherCondition.m_initialHFFMC != dvalue) && (m_weatherCondition.m_initialHFFMCTime != WTimeSpan(-1))) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_initialHFFMC = dvalue;
 									m_bRequiresSave = true;
@@ -334,7 +334,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 		case CWFGM_WEATHER_OPTION_INITIAL_RAIN:
 								if (FAILED(hr = VariantToDouble_(v_value, &dvalue))) return hr;
 								if (m_weatherCondition.m_initialRain != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_initialRain = dvalue;
 									m_bRequiresSave = true;
@@ -346,7 +346,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if (dvalue < 0.0)	return E_INVALIDARG;
 								if (dvalue > 1500.0)	return E_INVALIDARG;
 								if (m_weatherCondition.m_spec_day.dDC != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_spec_day.dDC = dvalue;
 									m_bRequiresSave = true;
@@ -358,7 +358,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if (dvalue < 0.0)	return E_INVALIDARG;
 								if (dvalue > 500.0)	return E_INVALIDARG;
 								if (m_weatherCondition.m_spec_day.dDMC != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_spec_day.dDMC = dvalue;
 									m_bRequiresSave = true;
@@ -374,7 +374,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if (dvalue < DEGREE_TO_RADIAN(-90.0))					{ weak_assert(false); return E_INVALIDARG; }
 								if (dvalue > DEGREE_TO_RADIAN(90.0))					{ weak_assert(false); return E_INVALIDARG; }
 								if (m_weatherCondition.m_worldLocation.m_latitude() != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_worldLocation.m_latitude(dvalue);
 									m_bRequiresSave = true;
@@ -385,7 +385,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if (dvalue < DEGREE_TO_RADIAN(-180.0))					{ weak_assert(false); return E_INVALIDARG; }
 								if (dvalue > DEGREE_TO_RADIAN(180.0))					{ weak_assert(false); return E_INVALIDARG; }
 								if (m_weatherCondition.m_worldLocation.m_longitude() != dvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_worldLocation.m_longitude(dvalue);
 									m_bRequiresSave = true;
@@ -398,7 +398,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if ((llvalue < WTimeSpan(-1)) && (llvalue != WTimeSpan(-1 * 60 * 60)))		return E_INVALIDARG;
 								if ((llvalue > WTimeSpan(0)) && (llvalue.GetSeconds() || llvalue.GetMinutes()))	return E_INVALIDARG;
 								if (m_weatherCondition.m_initialHFFMCTime != llvalue) {
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_weatherCondition.m_initialHFFMCTime = llvalue;
 									m_bRequiresSave = true;
@@ -413,7 +413,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								if ((m_weatherCondition.m_time != t) || (hour != m_weatherCondition.m_firstHour)) {
 									m_weatherCondition.m_time = t;
 									m_weatherCondition.m_firstHour = (std::uint8_t)hour;
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_bRequiresSave = true;
 								}
@@ -429,7 +429,7 @@ HRESULT CCWFGM_WeatherStream::SetAttribute(std::uint16_t option, const Polymorph
 								m_weatherCondition.GetEndTime(endTime);
 								if ((endTime != t) || (hour != m_weatherCondition.m_lastHour)) {
 									m_weatherCondition.SetEndTime(t);
-									m_cache.Clear();
+									clearCache();
 									m_weatherCondition.ClearConditions();
 									m_bRequiresSave = true;
 								}
@@ -518,7 +518,7 @@ HRESULT CCWFGM_WeatherStream::MakeHourlyObservations(const HSS_Time::WTime &time
 
 	WTime t(time, &m_weatherCondition.m_timeManager);
 	if (!m_weatherCondition.MakeHourlyObservations(t))	return ERROR_SEVERITY_WARNING;
-	m_cache.Clear();
+	clearCache();
 	m_bRequiresSave = true;
 	return S_OK;
 }
@@ -531,7 +531,7 @@ HRESULT CCWFGM_WeatherStream::MakeDailyObservations(const HSS_Time::WTime &time)
 
 	WTime t(time, &m_weatherCondition.m_timeManager);
 	if (!m_weatherCondition.MakeDailyObservations(t))	return ERROR_SEVERITY_WARNING;
-	m_cache.Clear();
+	clearCache();
 	m_bRequiresSave = true;
 	return S_OK;
 }
@@ -624,7 +624,7 @@ HRESULT CCWFGM_WeatherStream::SetDailyValues(const HSS_Time::WTime &time, double
 	if (!b)
 		return ERROR_SEVERITY_WARNING;
 
-	m_cache.Clear();
+	clearCache();
 	m_bRequiresSave = true;
 	return S_OK;
 }
@@ -701,7 +701,7 @@ HRESULT CCWFGM_WeatherStream::SetInstantaneousValues(const HSS_Time::WTime &time
 	if (!b)
 		return ERROR_SEVERITY_WARNING;
 
-	m_cache.Clear();
+	clearCache();
 	m_bRequiresSave = true;
 	return S_OK;
 }
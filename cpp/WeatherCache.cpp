@@ -29,86 +29,102 @@ IMPLEMENT_OBJECT_CACHE_MT_NO_TEMPLATE(WeatherBaseCache, WeatherBaseCache, 4 * 10
 IMPLEMENT_OBJECT_CACHE_MT_NO_TEMPLATE(WeatherBaseCache_MT, WeatherBaseCache_MT, 1024 / sizeof(WeatherBaseCache_MT), true, 16)
 
 
-ValueCacheTempl<WeatherKeyBase, WeatherData> *WeatherBaseCache::getCache(const HSS_Time::WTime &time, const WTimeManager *tm) {
-	WTime t(time), pt(t);
-
-	pt.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
-	if (t == pt)
-		return &m_cacheDay;
-	else {
-		pt += WTimeSpan(12 * 60 * 60);
-		if (t == pt)
-			return &m_cacheNoon;
+#ifndef DOXYGEN_IGNORE_CODE
+
+// bits of interpolate_method cleared from cache keys because they can't change the cached result, so queries that only differ in them share entries:
+// which cache to use (and whether to use one at all) is decided before we get here, and plain weather doesn't depend on the FWI options
+#define KEY_MASK	(~((1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE)))
+#define KEY_MASK_WX	(KEY_MASK & (~((1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_CALCFWI) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY))))
+
+#endif
+
+
+// decides which of the day, noon, hour, or second caches a time belongs in, the same as comparing it against PurgeToDay() and PurgeToHour()
+// with WTIME_FORMAT_AS_LOCAL would.  Those only apply the standard time zone offset (no DST), so the offset is found once per time manager
+// (and time zone) by purging a reference time, and after that it's just integer arithmetic on the raw time.  The time's own manager is used
+// since that's what PurgeToDay() and PurgeToHour() would use; a time without one is taken as UTC.
+std::uint16_t WeatherBaseCache::TimeTier(const HSS_Time::WTime &time) {
+	constexpr std::int64_t hour = 60LL * 60LL * 1000000LL, day = 24LL * hour;
+	thread_local const WTimeManager *s_tm = nullptr;
+	thread_local std::int64_t s_timezone = 0, s_offset = 0;
+
+	const WTimeManager *tm = time.GetTimeManager();
+	const std::int64_t timezone = (tm) ? tm->m_worldLocation.m_timezone().GetTotalMicroSeconds() : 0;
+	if (!tm) {
+		s_offset = 0;
+		s_timezone = 0;
+		s_tm = nullptr;
+	}
+	else if ((tm != s_tm) || (timezone != s_timezone)) {
+		WTime ref((std::uint64_t)(1000LL * day), tm, false);
+		ref.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
+		s_offset = (day - (std::int64_t)(ref.GetTotalMicroSeconds() % (std::uint64_t)day)) % day;
+		s_timezone = timezone;
+		s_tm = tm;
+	}
+
+	const std::int64_t local = (std::int64_t)((time.GetTotalMicroSeconds() + (std::uint64_t)s_offset) % (std::uint64_t)day);
+	std::uint16_t tier;
+	if (!local)				tier = TIER_DAY;
+	else if (local == 12 * hour)		tier = TIER_NOON;
+	else if (!(local % hour))		tier = TIER_HOUR;
+	else					tier = TIER_SEC;
+
+#ifdef _DEBUG
+	if (tm) {
+		WTime t(time), pt(t);
+		pt.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
+		if (t == pt)					weak_assert(tier == TIER_DAY);
+		else if (t == pt + WTimeSpan(12 * 60 * 60))	weak_assert(tier == TIER_NOON);
 		else {
 			pt = t;
 			pt.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
-			if (t == pt)
-				return &m_cacheHour;
-			else	return &m_cacheSec;
+			if (t == pt)				weak_assert(tier == TIER_HOUR);
+			else					weak_assert(tier == TIER_SEC);
 		}
 	}
+#endif
+
+	return tier;
+}
+
+
+ValueCacheTempl<WeatherKeyBase, WeatherData> *WeatherBaseCache::getCache(const HSS_Time::WTime &time, const WTimeManager *tm) {
+	switch (TimeTier(time)) {
+		case TIER_DAY:	return &m_cacheDay;
+		case TIER_NOON:	return &m_cacheNoon;
+		case TIER_HOUR:	return &m_cacheHour;
+		default:	return &m_cacheSec;
+	}
 }
 
 
 ValueCacheTempl<WeatherKeyBase, HIWXData> *WeatherBaseCache::getCacheWx(const HSS_Time::WTime &time, const WTimeManager *tm) {
-	WTime t(time), pt(t);
-
-	pt.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
-	if (t == pt)
-		return &m_iwxDay;
-	else {
-		pt += WTimeSpan(12 * 60 * 60);
-		if (t == pt)
-			return &m_iwxNoon;
-		else {
-			pt = t;
-			pt.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
-			if (t == pt)
-				return &m_iwxHour;
-			else	return &m_iwxSec;
-		}
+	switch (TimeTier(time)) {
+		case TIER_DAY:	return &m_iwxDay;
+		case TIER_NOON:	return &m_iwxNoon;
+		case TIER_HOUR:	return &m_iwxHour;
+		default:	return &m_iwxSec;
 	}
 }
 
 
 ValueCacheTempl<WeatherKeyBase, HIFWIData> *WeatherBaseCache::getCacheIfwi(const HSS_Time::WTime &time, const WTimeManager *tm) {
-	WTime t(time), pt(t);
-
-	pt.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
-	if (t == pt)
-		return &m_ifwiDay;
-	else {
-		pt += WTimeSpan(12 * 60 * 60);
-		if (t == pt)
-			return &m_ifwiNoon;
-		else {
-			pt = t;
-			pt.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
-			if (t == pt)
-				return &m_ifwiHour;
-			else	return &m_ifwiSec;
-		}
+	switch (TimeTier(time)) {
+		case TIER_DAY:	return &m_ifwiDay;
+		case TIER_NOON:	return &m_ifwiNoon;
+		case TIER_HOUR:	return &m_ifwiHour;
+		default:	return &m_ifwiSec;
 	}
 }
 
 
 ValueCacheTempl<WeatherKeyBase, HDFWIData> *WeatherBaseCache::getCacheDfwi(const HSS_Time::WTime &time, const WTimeManager *tm) {
-	WTime t(time), pt(t);
-
-	pt.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
-	if (t == pt)
-		return &m_dfwiDay;
-	else {
-		pt += WTimeSpan(12 * 60 * 60);
-		if (t == pt)
-			return &m_dfwiNoon;
-		else {
-			pt = t;
-			pt.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
-			if (t == pt)
-				return &m_dfwiHour;
-			else	return &m_dfwiSec;
-		}
+	switch (TimeTier(time)) {
+		case TIER_DAY:	return &m_dfwiDay;
+		case TIER_NOON:	return &m_dfwiNoon;
+		case TIER_HOUR:	return &m_dfwiHour;
+		default:	return &m_dfwiSec;
 	}
 }
 
@@ -204,217 +220,846 @@ HDFWIData *WeatherBaseCache::Retrieve(const WeatherKeyBase *_key, HDFWIData *_to
 }
 
 
+DailyFWIState::DailyFWIState(std::uint16_t x, std::uint16_t y) {
+	m_xsize = x;
+	m_ysize = y;
+	m_xtiles = (std::uint16_t)((((std::uint32_t)x) + TILE_SIZE - 1) / TILE_SIZE);
+	m_ytiles = (std::uint16_t)((((std::uint32_t)y) + TILE_SIZE - 1) / TILE_SIZE);
+	m_tileCount = 0;
+	m_hand = 0;
+	SetBudget(DEFAULT_BUDGET);
+	for (std::uint16_t i = 0; i < METHODS; i++) {
+		m_tables[i].used = false;
+		m_tables[i].method = 0;
+		m_tables[i].tiles = nullptr;
+	}
+}
+
+
+DailyFWIState::~DailyFWIState() {
+	Clear();
+	for (std::uint16_t i = 0; i < METHODS; i++)
+		if (m_tables[i].tiles)
+			delete [] m_tables[i].tiles;
+}
+
+
+// bytes of the tables of tiles, which are allocated as methods are first used and aren't part of the tiles' budget
+std::uint64_t DailyFWIState::TableBytes() const {
+	return (std::uint64_t)METHODS * (std::uint64_t)m_xtiles * (std::uint64_t)m_ytiles * sizeof(std::atomic<Tile *>);
+}
+
+
+void DailyFWIState::SetBudget(std::uint64_t bytes) {
+	std::uint64_t tiles = bytes / sizeof(Tile);
+	m_maxTiles = (tiles < 1) ? 1 : ((tiles > 0x7fffffff) ? 0x7fffffff : (std::uint32_t)tiles);
+}
+
+
+// finds the table of tiles for this interpolation method, adding one if asked to and there's room
+DailyFWIState::Table *DailyFWIState::table(std::uint64_t interpolate_method, bool add) {
+	for (std::uint16_t i = 0; i < METHODS; i++)
+		if ((m_tables[i].used.load(std::memory_order_acquire)) && (m_tables[i].method == interpolate_method))
+			return &m_tables[i];
+	if (!add)
+		return nullptr;
+
+	Table *t = nullptr;
+	m_tableLock.Lock();
+	for (std::uint16_t i = 0; i < METHODS; i++)
+		if ((m_tables[i].used.load(std::memory_order_acquire)) && (m_tables[i].method == interpolate_method)) {
+			t = &m_tables[i];
+			break;
+		}
+	if (!t) {
+		for (std::uint16_t i = 0; i < METHODS; i++)
+			if (!m_tables[i].used.load(std::memory_order_acquire)) {
+				const size_t cnt = (size_t)m_xtiles * (size_t)m_ytiles;
+				try {
+					if (!m_tables[i].tiles) {
+						m_tables[i].tiles = new std::atomic<Tile *>[cnt];
+						for (size_t j = 0; j < cnt; j++)
+							m_tables[i].tiles[j] = nullptr;
+					}
+				} catch (std::bad_alloc& cme) {
+					weak_assert(false);
+					break;
+				}
+				m_tables[i].method = interpolate_method;
+				m_tables[i].used.store(true, std::memory_order_release);
+				t = &m_tables[i];
+				break;
+			}
+	}
+	m_tableLock.Unlock();
+	return t;			// null if every table is in use by another method, then the codes just aren't kept
+}
+
+
+// returns the cell's state, the lock for its tile must be held
+DailyFWIState::CellState *DailyFWIState::cell(Table *t, std::uint16_t x, std::uint16_t y, bool allocate) {
+	if ((!t) || (x >= m_xsize) || (y >= m_ysize))
+		return nullptr;
+	std::uint32_t index = tileIndex(x, y);
+	Tile *tile = t->tiles[index].load(std::memory_order_acquire);
+	if (!tile) {
+		if (!allocate)
+			return nullptr;
+		try {
+			tile = new Tile();
+		} catch (std::bad_alloc& cme) {
+			weak_assert(false);
+			return nullptr;
+		}
+		t->tiles[index].store(tile, std::memory_order_release);
+		m_tileCount++;
+	}
+	tile->referenced = true;
+	return &tile->cells[(y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE)];
+}
+
+
+// makes room for another tile by dropping one, in the same CLOCK order the layer caches use: tiles used since the hand last passed them
+// get another chance.  No other tile lock may be held by the caller.
+void DailyFWIState::evict() {
+	const std::uint32_t tiles = (std::uint32_t)m_xtiles * (std::uint32_t)m_ytiles;
+	const std::uint64_t slots = (std::uint64_t)tiles * METHODS;
+	for (std::uint64_t i = 0; i < 2 * slots; i++) {
+		const std::uint64_t slot = (m_hand++) % slots;
+		Table *t = &m_tables[slot / tiles];
+		if ((!t->used.load(std::memory_order_acquire)) || (!t->tiles))
+			continue;
+		const std::uint32_t index = (std::uint32_t)(slot % tiles);
+		if (!t->tiles[index].load(std::memory_order_acquire))
+			continue;
+		CThreadSemaphore *lock = &m_locks[index % LOCKS];
+		lock->Lock();
+		Tile *tile = t->tiles[index].load(std::memory_order_acquire);
+		bool dropped = false;
+		if (tile) {
+			if (tile->referenced)
+				tile->referenced = false;
+			else {
+				t->tiles[index].store(nullptr, std::memory_order_release);
+				delete tile;
+				m_tileCount--;
+				dropped = true;
+			}
+		}
+		lock->Unlock();
+		if (dropped)
+			return;
+	}
+}
+
+
+bool DailyFWIState::Retrieve(std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, const HSS_Time::WTime &day, DFWIData *dfwi, bool *valid) {
+	Table *t = table(interpolate_method & KEY_MASK, false);
+	if ((!t) || (x >= m_xsize) || (y >= m_ysize))
+		return false;
+
+	bool retval = false;
+	std::uint64_t d = day.GetTotalMicroSeconds();
+	CThreadSemaphore *lock = &m_locks[tileIndex(x, y) % LOCKS];
+	lock->Lock();
+	CellState *cs = cell(t, x, y, false);
+	if (cs) {
+		Codes *c = nullptr;
+		if (cs->curr.day == d)		c = &cs->curr;
+		else if (cs->prev.day == d)	c = &cs->prev;
+		if (c) {
+			dfwi->dFFMC = c->dFFMC;
+			dfwi->dDMC = c->dDMC;
+			dfwi->dDC = c->dDC;
+			*valid = c->valid;
+			retval = true;
+		}
+	}
+	lock->Unlock();
+	return retval;
+}
+
+
+bool DailyFWIState::RetrieveBefore(std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, const HSS_Time::WTime &day, std::uint64_t *found, DFWIData *dfwi, bool *valid) {
+	Table *t = table(interpolate_method & KEY_MASK, false);
+	if ((!t) || (x >= m_xsize) || (y >= m_ysize))
+		return false;
+
+	bool retval = false;
+	std::uint64_t d = day.GetTotalMicroSeconds();
+	CThreadSemaphore *lock = &m_locks[tileIndex(x, y) % LOCKS];
+	lock->Lock();
+	CellState *cs = cell(t, x, y, false);
+	if (cs) {
+		Codes *c = nullptr;
+		if ((cs->curr.day) && (cs->curr.day < d))	c = &cs->curr;
+		else if ((cs->prev.day) && (cs->prev.day < d))	c = &cs->prev;
+		if (c) {
+			*found = c->day;
+			dfwi->dFFMC = c->dFFMC;
+			dfwi->dDMC = c->dDMC;
+			dfwi->dDC = c->dDC;
+			*valid = c->valid;
+			retval = true;
+		}
+	}
+	lock->Unlock();
+	return retval;
+}
+
+
+void DailyFWIState::Store(std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, const HSS_Time::WTime &day, const DFWIData *dfwi, bool valid) {
+	Table *t = table(interpolate_method & KEY_MASK, true);
+	if ((!t) || (x >= m_xsize) || (y >= m_ysize))
+		return;
+
+	const std::uint32_t index = tileIndex(x, y);
+	if ((m_tileCount >= m_maxTiles) && (!t->tiles[index].load(std::memory_order_acquire)))
+		evict();
+
+	std::uint64_t d = day.GetTotalMicroSeconds();
+	CThreadSemaphore *lock = &m_locks[index % LOCKS];
+	lock->Lock();
+	CellState *cs = cell(t, x, y, true);
+	if (cs) {
+		Codes *c = nullptr;
+		if ((cs->curr.day == d) || (!cs->curr.day))
+			c = &cs->curr;
+		else if (cs->curr.day < d) {		// moving forward a day, keep the one we have for requests for yesterday's codes
+			cs->prev = cs->curr;
+			c = &cs->curr;
+		} else if ((cs->prev.day == d) || (cs->prev.day < d))
+			c = &cs->prev;
+						// else it's older than anything we're keeping so just drop it
+		if (c) {
+			c->day = d;
+			c->valid = valid;
+			c->dFFMC = dfwi->dFFMC;
+			c->dDMC = dfwi->dDMC;
+			c->dDC = dfwi->dDC;
+		}
+	}
+	lock->Unlock();
+}
+
+
+void DailyFWIState::Clear() {			// assumes this is never called asynchronously to Store/Retrieve, like WeatherLayerCache::Clear()
+	m_tableLock.Lock();
+	const size_t cnt = (size_t)m_xtiles * (size_t)m_ytiles;
+	for (std::uint16_t i = 0; i < METHODS; i++) {
+		if (m_tables[i].tiles)
+			for (size_t j = 0; j < cnt; j++) {
+				Tile *tile = m_tables[i].tiles[j].load(std::memory_order_acquire);
+				if (tile) {
+					m_tables[i].tiles[j].store(nullptr, std::memory_order_release);
+					delete tile;
+				}
+			}
+		m_tables[i].used.store(false, std::memory_order_release);
+	}
+	m_tileCount = 0;
+	m_tableLock.Unlock();
+}
+
+
 IMPLEMENT_OBJECT_CACHE_MT_NO_TEMPLATE(WeatherLayerCache, WeatherLayerCache, 256 * 1024 / sizeof(WeatherLayerCache), false, 16)
 
 
-WeatherLayerCache::WeatherLayerCache(std::uint16_t x, std::uint16_t y, std::uint32_t max_cache_entries, WTimeManager *tm) : m_equilibriumTime(0ULL, tm) {
+// 'budget' is the bytes this cache may use in all, 0 for 'max_cache_entries' cells with the built-in tile and daily FWI budgets.  The tables
+// of tiles come off the top of it, then an eighth each goes to the tiles and the daily FWI state, and the rest to the cells.
+WeatherLayerCache::WeatherLayerCache(std::uint16_t x, std::uint16_t y, std::uint32_t max_cache_entries, std::uint64_t budget, WTimeManager *tm) : m_equilibriumTime(0ULL, tm), m_fwiState(x, y) {
 	m_xsize = x;
 	m_ysize = y;
-	std::uint32_t size = ((std::uint32_t)m_xsize) * ((std::uint32_t)m_ysize);
-	size_t allocsize = (size_t)size * sizeof(WeatherBaseCache *);
-	m_cacheArray = (WeatherBaseCache **)malloc(allocsize);
-	if (m_cacheArray)
-		memset(m_cacheArray, 0, allocsize);
+	m_xtiles = (std::uint16_t)((((std::uint32_t)x) + TILE_SIZE - 1) / TILE_SIZE);
+	m_ytiles = (std::uint16_t)((((std::uint32_t)y) + TILE_SIZE - 1) / TILE_SIZE);
+	size_t allocsize = (size_t)m_xtiles * (size_t)m_ytiles * sizeof(Tile *);
+	m_tiles = (Tile **)malloc(allocsize);
+	if (m_tiles)
+		memset(m_tiles, 0, allocsize);
+	const size_t words = ((size_t)x * (size_t)y + 63) / 64;
+	try {
+		m_referenced = new std::atomic<std::uint64_t>[words];
+		for (size_t i = 0; i < words; i++)
+			m_referenced[i] = 0;
+	} catch (std::bad_alloc &) {
+		m_referenced = nullptr;				// CLOCK just works as FIFO
+	}
+
+	std::uint64_t tile_budget = TILE_BUDGET;
+	if (budget) {
+		const std::uint64_t tables = (std::uint64_t)allocsize + words * sizeof(std::uint64_t) + m_fwiState.TableBytes();
+		budget = (budget > tables) ? (budget - tables) : 0;
+		tile_budget = budget / 8;
+		m_fwiState.SetBudget(budget / 8);
+		max_cache_entries = CellsForBudget(budget - 2 * (budget / 8));
+	}
+	tile_budget /= sizeof(Tile);
+	m_maxTiles = (tile_budget < SHARDS) ? SHARDS : ((tile_budget > 0x7fffffff) ? 0x7fffffff : (std::uint32_t)tile_budget);
+	m_maxCells = (max_cache_entries < 2) ? 2 : max_cache_entries;
+	m_cellCount = 0;
+	m_tileCount = 0;
+	for (std::uint16_t i = 0; i < 4; i++)
+		m_frontHits[i] = 0;
+	for (std::uint16_t i = 0; i < SHARDS; i++) {
+		Shard *s = &m_shards[i];
+		s->touch = 0;
+		s->begin = s->end = s->slots = 0;
+		s->tierTotal = 0;
+		for (std::uint16_t j = 0; j < 4; j++)
+			s->tierStores[j] = 0;
+		s->tierEntries[WeatherBaseCache::TIER_DAY] = WeatherBaseCache::DAY_ENTRIES;
+		s->tierEntries[WeatherBaseCache::TIER_NOON] = WeatherBaseCache::NOON_ENTRIES;
+		s->tierEntries[WeatherBaseCache::TIER_HOUR] = WeatherBaseCache::HOUR_ENTRIES;
+		s->tierEntries[WeatherBaseCache::TIER_SEC] = WeatherBaseCache::SEC_ENTRIES;
+		s->buckets.clear();
+		allocsize = (size_t)m_maxCells * sizeof(WEntry);
+		s->created = (WEntry *)malloc(allocsize);
+		if (s->created)
+			memset(s->created, -1, allocsize);
+	}
+}
+
+
+// the most memory one cell's cache can grow to: the cell itself, every entry in all its value caches, its slot in every shard's creation order
+// (each is sized to the whole budget), and its purge bucket entries.  A cell is filed again each hour it's stored to and its older entries
+// only go once their buckets expire, two hours on, so it can be in three buckets at once.  Tiles are budgeted separately.
+std::uint64_t WeatherLayerCache::CellBytes() {
+	const std::uint64_t entries = WeatherBaseCache::ENTRIES;
+	return sizeof(WeatherBaseCache) + SHARDS * sizeof(WEntry) + 3 * sizeof(WEntry) +
+		entries * (4 * sizeof(WeatherKeyBase) + sizeof(WeatherData) + sizeof(HIWXData) + sizeof(HIFWIData) + sizeof(HDFWIData));
+}
 
-	m_begin = m_end = 0;
-	m_max = max_cache_entries;
-	allocsize = (size_t)m_max * sizeof(WEntry);
-	m_created = (WEntry *)malloc(allocsize);
-	if (m_created)
-		memset(m_created, -1, allocsize);
+
+// how many cells fit in 'bytes', never fewer than a couple
+std::uint32_t WeatherLayerCache::CellsForBudget(std::uint64_t bytes) {
+	std::uint64_t cells = bytes / CellBytes();
+	if (cells < 2)
+		cells = 2;
+	else if (cells > 0x7fffffff)
+		cells = 0x7fffffff;
+	return (std::uint32_t)cells;
 }
 
 
 WeatherLayerCache::~WeatherLayerCache() {
 	Clear();
-	if (m_cacheArray)
-		free(m_cacheArray);
-	if (m_created)
-		free(m_created);
+	if (m_tiles)
+		free(m_tiles);
+	if (m_referenced)
+		delete [] m_referenced;
+	for (std::uint16_t i = 0; i < SHARDS; i++)
+		if (m_shards[i].created)
+			free(m_shards[i].created);
+}
+
+
+// returns the tile at 'index', which must belong to shard 's' and 's' must be locked
+WeatherLayerCache::Tile *WeatherLayerCache::tile(Shard *s, std::uint32_t index, bool allocate) {
+	if (!m_tiles)
+		return nullptr;
+	weak_assert(shard(index) == s);
+	Tile *t = m_tiles[index];
+	if (!t) {
+		if (!allocate)
+			return nullptr;
+		if (m_tileCount.load(std::memory_order_relaxed) >= m_maxTiles)
+			evictTile(s);
+		try {
+			t = new Tile();
+			s->tiles.push_back(index);
+		} catch (std::bad_alloc& cme) {
+			weak_assert(false);
+			if (t)
+				delete t;
+			return nullptr;
+		}
+		t->slot = (std::uint32_t)(s->tiles.size() - 1);
+		m_tiles[index] = t;
+		m_tileCount++;
+	}
+	t->touched = ++s->touch;
+	return t;
+}
+
+
+// deletes a tile and every cell cache in it, removing those cells from the shard's creation order
+void WeatherLayerCache::freeTile(Shard *s, std::uint32_t index) {
+	Tile *t = m_tiles[index];
+	if (t) {
+		for (std::uint32_t i = 0; i < TILE_SIZE * TILE_SIZE; i++)
+			if (t->cells[i]) {
+				s->created[t->cells[i]->m_createdIndex].x = (std::uint16_t)-1;
+				s->created[t->cells[i]->m_createdIndex].y = (std::uint16_t)-1;
+				delete t->cells[i];
+				unreference((std::uint16_t)((index % m_xtiles) * TILE_SIZE + (i % TILE_SIZE)), (std::uint16_t)((index / m_xtiles) * TILE_SIZE + (i / TILE_SIZE)));
+				m_cellCount--;
+			}
+		s->tiles[t->slot] = s->tiles.back();
+		m_tiles[s->tiles[t->slot]]->slot = t->slot;
+		s->tiles.pop_back();
+		delete t;
+		m_tiles[index] = nullptr;
+		m_tileCount--;
+	}
+}
+
+
+// drops the shard's tile that has gone the longest without being used, to keep the tiles within the memory budget
+void WeatherLayerCache::evictTile(Shard *s) {
+	std::uint32_t oldest = (std::uint32_t)-1;
+	for (std::uint32_t i : s->tiles)
+		if ((oldest == (std::uint32_t)-1) || (m_tiles[i]->touched < m_tiles[oldest]->touched))
+			oldest = i;
+	if (oldest != (std::uint32_t)-1) {
+		s->stats.evictions += m_tiles[oldest]->count;
+		freeTile(s, oldest);
+	}
+}
+
+
+// marks the cell as used for CLOCK eviction.  This is called without a shard lock (from front cache hits), so the cell may be gone by now,
+// which just costs some other cell at the same spot an extra pass
+void WeatherLayerCache::reference(std::uint16_t x, std::uint16_t y) {
+	if ((m_referenced) && (m_eviction == CWFGM_WEATHER_CACHE_EVICT_CLOCK)) {
+		const size_t i = (size_t)y * (size_t)m_xsize + (size_t)x;
+		const std::uint64_t bit = 1ull << (i & 63);
+		if (!(m_referenced[i >> 6].load(std::memory_order_relaxed) & bit))	// only write when it changes, so hot cells don't keep bouncing the line between cores
+			m_referenced[i >> 6].fetch_or(bit, std::memory_order_relaxed);
+	}
+}
+
+
+// clears the cell's used mark, returning whether it was set
+bool WeatherLayerCache::unreference(std::uint16_t x, std::uint16_t y) {
+	if (!m_referenced)
+		return false;
+	const size_t i = (size_t)y * (size_t)m_xsize + (size_t)x;
+	const std::uint64_t bit = 1ull << (i & 63);
+	if (!(m_referenced[i >> 6].load(std::memory_order_relaxed) & bit))
+		return false;
+	return (m_referenced[i >> 6].fetch_and(~bit, std::memory_order_relaxed) & bit) ? true : false;
 }
 
 
-WeatherBaseCache *WeatherLayerCache::cache(std::uint16_t x, std::uint16_t y) {
+// drops the oldest cell in the shard's creation order other than 'keep'.  With CLOCK, cells that have had a hit since they were last looked at
+// go to the back of the order instead.  Returns false if the shard has nothing else to drop
+bool WeatherLayerCache::evictCell(Shard *s, const WeatherBaseCache *keep) {
+	for (std::uint32_t k = 0, n = 2 * s->slots; (s->slots) && (k < n); k++) {	// after one pass every referenced cell has been cleared
+		WEntry we = s->created[s->end];
+		s->end = (s->end + 1) % m_maxCells;
+		s->slots--;
+		if ((we.x == (std::uint16_t)-1) || (we.y == (std::uint16_t)-1))
+			continue;					// already dropped by a purge or a tile eviction
+		WeatherBaseCache *o = existing(we.x, we.y);
+		weak_assert(o);
+		if (!o)
+			continue;
+		const bool referenced = unreference(we.x, we.y);
+		if ((o == keep) || ((m_eviction == CWFGM_WEATHER_CACHE_EVICT_CLOCK) && (referenced))) {
+			s->created[s->begin] = we;
+			o->m_createdIndex = s->begin;
+			s->begin = (s->begin + 1) % m_maxCells;
+			s->slots++;
+			continue;
+		}
+		removeCell(s, we.x, we.y);
+		s->stats.evictions++;
+		return true;
+	}
+	return false;
+}
+
+
+// deletes the cell's cache, and its tile once that's empty; the cell must already be out of the shard's creation order
+void WeatherLayerCache::removeCell(Shard *s, std::uint16_t x, std::uint16_t y) {
+	std::uint32_t index = tileIndex(x, y);
+	weak_assert(shard(index) == s);
+	Tile *t = m_tiles[index];
+	if (t) {
+		WeatherBaseCache **c = &t->cells[cellIndex(x, y)];
+		if (*c) {
+			delete *c;
+			*c = nullptr;
+			unreference(x, y);
+			m_cellCount--;
+			if (!(--t->count))
+				freeTile(s, index);
+		}
+	}
+}
+
+
+// counts a store towards how new cells in this shard split their entries between the day, noon, hour, and second caches.  Every REBALANCE_STORES
+// the split is worked out again in proportion to the stores each tier has had, with older counts decaying by half each time.  Every tier keeps
+// MIN_TIER_ENTRIES, and the total stays WeatherBaseCache::ENTRIES so CellBytes() still holds.  Cells keep the split they were created with.
+void WeatherLayerCache::tierStore(Shard *s, std::uint16_t tier) {
+	s->tierStores[tier]++;
+	if (++s->tierTotal < REBALANCE_STORES)
+		return;
+
+	const std::uint32_t spare = WeatherBaseCache::ENTRIES - 4 * MIN_TIER_ENTRIES;
+	std::uint32_t given = 0;
+	for (std::uint16_t i = 0; i < 4; i++) {
+		s->tierEntries[i] = (std::uint16_t)(MIN_TIER_ENTRIES + (std::uint64_t)spare * s->tierStores[i] / s->tierTotal);
+		given += s->tierEntries[i];
+	}
+	s->tierEntries[WeatherBaseCache::TIER_HOUR] += (std::uint16_t)(WeatherBaseCache::ENTRIES - given);	// rounding goes to the hour cache, the one most queries use
+
+	s->tierTotal = 0;
+	for (std::uint16_t i = 0; i < 4; i++) {
+		s->tierStores[i] /= 2;
+		s->tierTotal += s->tierStores[i];
+	}
+}
+
+
+WeatherBaseCache *WeatherLayerCache::cache(Shard *s, std::uint16_t x, std::uint16_t y) {
 	weak_assert(x < m_xsize);
 	weak_assert(y < m_ysize);
-	std::uint32_t index = arrayIndex(x, y);
+	if (!s->created)
+		return nullptr;
+	Tile *t = tile(s, tileIndex(x, y), true);
+	if (!t)
+		return nullptr;
+	WeatherBaseCache **c = &t->cells[cellIndex(x, y)];
+
+	if (!*c) {
+		try {
+			*c = new WeatherBaseCache(s->tierEntries[WeatherBaseCache::TIER_DAY], s->tierEntries[WeatherBaseCache::TIER_NOON],
+			    s->tierEntries[WeatherBaseCache::TIER_HOUR], s->tierEntries[WeatherBaseCache::TIER_SEC]);
+		} catch (std::bad_alloc& cme) {
+			weak_assert(false);
+			*c = NULL;
+			return nullptr;
+		}
+		t->count++;						// counted before anything is evicted, so this tile can't be freed from under the new cell
+		m_cellCount++;
+		unreference(x, y);					// a front cache hit may have marked an earlier cell here after it went
 
-	try {
-		if (!m_cacheArray[index]) {
-			m_cacheArray[index] = new WeatherBaseCache();
+		if (s->slots == m_maxCells)				// only when this shard holds the whole budget
+			evictCell(s, nullptr);
 
-			WEntry we;
-			we.x = x;
-			we.y = y;
+		WEntry we;
+		we.x = x;
+		we.y = y;
 
-			m_created[m_begin] = we;
-			m_cacheArray[index]->m_createdIndex = m_begin;
-			m_begin = (m_begin + 1) % m_max;
-			if (m_begin == m_end) {
-				if ((m_created[m_end].x != (std::uint16_t)-1) && (m_created[m_end].y != (std::uint16_t)-1)) {
-					std::uint32_t dindex = arrayIndex(m_created[m_end].x, m_created[m_end].y);
+		s->created[s->begin] = we;
+		(*c)->m_createdIndex = s->begin;
+		s->begin = (s->begin + 1) % m_maxCells;
+		s->slots++;
 
-					m_created[m_end].x = (std::uint16_t)-1;
-					m_created[m_end].y = (std::uint16_t)-1;
+		if (m_cellCount.load(std::memory_order_relaxed) > m_maxCells)	// the budget is for the whole layer, but each shard only evicts its own cells, so
+			evictCell(s, *c);					// a shard with nothing else to drop lets the layer run over by a cell until another shard adds one
+	}
+	return *c;
+}
 
-					delete m_cacheArray[dindex];
-					m_cacheArray[dindex] = nullptr;
-				}
 
-				m_end = (m_end + 1) % m_max;
-			}
-		}
-	} catch (std::bad_alloc& cme) {
-		weak_assert(false);
-		m_cacheArray[index] = NULL;
+// the cell's cache if it already has one.  Retrieve() doesn't make one on a miss, since only Store() files cells under a purge bucket and an
+// empty cell made by a miss would never be purged, only evicted.
+WeatherBaseCache *WeatherLayerCache::lookup(Shard *s, std::uint16_t x, std::uint16_t y) {
+	weak_assert(x < m_xsize);
+	weak_assert(y < m_ysize);
+	Tile *t = tile(s, tileIndex(x, y), false);
+	return (t) ? t->cells[cellIndex(x, y)] : nullptr;
+}
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+#define FRONT_SIZE	64		// entries in each thread's front cache, per answer type
+
+// a small direct mapped cache per thread, per answer type, looked at before the shards so that a worker asking for the same few cells and times
+// over and over doesn't take a shard lock each time.  Entries are tagged with the layer's cache and the epoch they were filled in; Clear()
+// and PurgeOld() bump the epoch, which drops every thread's entries at once without having to reach into them
+template<class T>
+struct FrontEntry {
+	const WeatherLayerCache *cache;
+	std::uint64_t epoch;
+	std::uint64_t time, interpolate_method;
+	std::uint16_t x, y;
+	T answer;
+};
+
+static std::atomic<std::uint64_t> s_frontEpoch(1);		// thread_local entries start zeroed, so never match
+
+template<class T>
+static FrontEntry<T> *frontEntry(const WeatherLayerCache *c, const WeatherKey *key, std::uint64_t interpolate_method) {
+	thread_local FrontEntry<T> front[FRONT_SIZE];
+	std::uint64_t h = key->time.GetTotalMicroSeconds() ^ (((std::uint64_t)key->x) << 32) ^ (((std::uint64_t)key->y) << 48) ^ (((std::uint64_t)(std::uintptr_t)c) >> 4) ^ interpolate_method;
+	h *= 0x9e3779b97f4a7c15ull;
+	return &front[h >> 58];				// top 6 bits, for FRONT_SIZE entries
+}
+
+
+template<class T>
+static bool frontRetrieve(const WeatherLayerCache *c, const WeatherKey *key, std::uint64_t interpolate_method, T *to_fill) {
+	FrontEntry<T> *f = frontEntry<T>(c, key, interpolate_method);
+	if ((f->cache == c) && (f->epoch == s_frontEpoch.load(std::memory_order_acquire)) && (f->x == key->x) && (f->y == key->y) &&
+	    (f->time == key->time.GetTotalMicroSeconds()) && (f->interpolate_method == interpolate_method)) {
+		*to_fill = f->answer;
+		return true;
 	}
+	return false;
+}
+
+
+template<class T>
+static void frontStore(const WeatherLayerCache *c, const WeatherKey *key, std::uint64_t interpolate_method, const T *answer) {
+	FrontEntry<T> *f = frontEntry<T>(c, key, interpolate_method);
+	f->cache = c;
+	f->epoch = s_frontEpoch.load(std::memory_order_acquire);
+	f->time = key->time.GetTotalMicroSeconds();
+	f->interpolate_method = interpolate_method;
+	f->x = key->x;
+	f->y = key->y;
+	f->answer = *answer;
+}
+
+#endif
+
 
-	WeatherBaseCache *c = m_cacheArray[index];
-	return c;
+// files the cell under the purge bucket for 'time', if that's later than anything it's had stored in it before
+void WeatherLayerCache::bucket(Shard *s, WeatherBaseCache *c, std::uint16_t x, std::uint16_t y, const HSS_Time::WTime &time) {
+	std::uint64_t b = time.GetTotalMicroSeconds() / PURGE_BUCKET;
+	if (b > c->m_bucket) {
+		WEntry we;
+		we.x = x;
+		we.y = y;
+		try {
+			s->buckets[b].push_back(we);
+			c->m_bucket = b;
+		} catch (std::bad_alloc& cme) {
+			weak_assert(false);
+		}
+	}
 }
 
 
 void WeatherLayerCache::Store(const WeatherKey *_key, const WeatherData *_answer, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = cache(s, _key->x, _key->y);
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK;
 		c->Store(&key, _answer, tm);
+		bucket(s, c, _key->x, _key->y, _key->time);
+		frontStore(this, _key, key.interpolate_method, _answer);
 	}
+	const std::uint16_t tier = WeatherBaseCache::TimeTier(_key->time);
+	tierStore(s, tier);
+	if (m_statistics)
+		s->stats.stores[0][tier]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 }
 
 
 void WeatherLayerCache::Store(const WeatherKey *_key, const HIWXData *_answer, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = cache(s, _key->x, _key->y);
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK_WX;
 		c->Store(&key, _answer, tm);
+		bucket(s, c, _key->x, _key->y, _key->time);
+		frontStore(this, _key, key.interpolate_method, _answer);
 	}
+	const std::uint16_t tier = WeatherBaseCache::TimeTier(_key->time);
+	tierStore(s, tier);
+	if (m_statistics)
+		s->stats.stores[1][tier]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 }
 
 
 void WeatherLayerCache::Store(const WeatherKey *_key, const HIFWIData *_answer, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = cache(s, _key->x, _key->y);
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK;
 		c->Store(&key, _answer, tm);
+		bucket(s, c, _key->x, _key->y, _key->time);
+		frontStore(this, _key, key.interpolate_method, _answer);
 	}
+	const std::uint16_t tier = WeatherBaseCache::TimeTier(_key->time);
+	tierStore(s, tier);
+	if (m_statistics)
+		s->stats.stores[2][tier]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 }
 
 
 void WeatherLayerCache::Store(const WeatherKey *_key, const HDFWIData *_answer, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = cache(s, _key->x, _key->y);
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK;
 		c->Store(&key, _answer, tm);
+		bucket(s, c, _key->x, _key->y, _key->time);
+		frontStore(this, _key, key.interpolate_method, _answer);
 	}
+	const std::uint16_t tier = WeatherBaseCache::TimeTier(_key->time);
+	tierStore(s, tier);
+	if (m_statistics)
+		s->stats.stores[3][tier]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 }
 
 
 WeatherData *WeatherLayerCache::Retrieve(const WeatherKey *_key, WeatherData *_to_fill, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	if (frontRetrieve(this, _key, _key->interpolate_method & KEY_MASK, _to_fill)) {
+		reference(_key->x, _key->y);
+		if (m_statistics)
+			m_frontHits[0].fetch_add(1, std::memory_order_relaxed);
+		return _to_fill;
+	}
+
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = lookup(s, _key->x, _key->y);
 	WeatherData *wd = NULL;
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK;
 		wd = c->Retrieve(&key, _to_fill, tm);
+		if (wd) {
+			reference(_key->x, _key->y);
+			frontStore(this, _key, key.interpolate_method, wd);
+		}
 	}
+	if (m_statistics)
+		((wd) ? s->stats.hits : s->stats.misses)[0][WeatherBaseCache::TimeTier(_key->time)]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 	return wd;
 }
 
 
 HIWXData *WeatherLayerCache::Retrieve(const WeatherKey *_key, HIWXData *_to_fill, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	if (frontRetrieve(this, _key, _key->interpolate_method & KEY_MASK_WX, _to_fill)) {
+		reference(_key->x, _key->y);
+		if (m_statistics)
+			m_frontHits[1].fetch_add(1, std::memory_order_relaxed);
+		return _to_fill;
+	}
+
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = lookup(s, _key->x, _key->y);
 	HIWXData *wd = NULL;
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK_WX;
 		wd = c->Retrieve(&key, _to_fill, tm);
+		if (wd) {
+			reference(_key->x, _key->y);
+			frontStore(this, _key, key.interpolate_method, wd);
+		}
 	}
+	if (m_statistics)
+		((wd) ? s->stats.hits : s->stats.misses)[1][WeatherBaseCache::TimeTier(_key->time)]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 	return wd;
 }
 
 
 HIFWIData *WeatherLayerCache::Retrieve(const WeatherKey *_key, HIFWIData *_to_fill, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	if (frontRetrieve(this, _key, _key->interpolate_method & KEY_MASK, _to_fill)) {
+		reference(_key->x, _key->y);
+		if (m_statistics)
+			m_frontHits[2].fetch_add(1, std::memory_order_relaxed);
+		return _to_fill;
+	}
+
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = lookup(s, _key->x, _key->y);
 	HIFWIData *wd = NULL;
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK;
 		wd = c->Retrieve(&key, _to_fill, tm);
+		if (wd) {
+			reference(_key->x, _key->y);
+			frontStore(this, _key, key.interpolate_method, wd);
+		}
 	}
+	if (m_statistics)
+		((wd) ? s->stats.hits : s->stats.misses)[2][WeatherBaseCache::TimeTier(_key->time)]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 	return wd;
 }
 
 
 HDFWIData *WeatherLayerCache::Retrieve(const WeatherKey *_key, HDFWIData *_to_fill, const WTimeManager *tm) {
-	m_lock.Lock();
-	WeatherBaseCache *c = cache(_key->x, _key->y);
+	if (frontRetrieve(this, _key, _key->interpolate_method & KEY_MASK, _to_fill)) {
+		reference(_key->x, _key->y);
+		if (m_statistics)
+			m_frontHits[3].fetch_add(1, std::memory_order_relaxed);
+		return _to_fill;
+	}
+
+	Shard *s = shard(tileIndex(_key->x, _key->y));
+	s->lock.Lock();
+	WeatherBaseCache *c = lookup(s, _key->x, _key->y);
 	HDFWIData *wd = NULL;
 
 	if (c) {
 		WeatherKeyBase key(_key->time);
-		key.interpolate_method = _key->interpolate_method;
+		key.interpolate_method = _key->interpolate_method & KEY_MASK;
 		wd = c->Retrieve(&key, _to_fill, tm);
+		if (wd) {
+			reference(_key->x, _key->y);
+			frontStore(this, _key, key.interpolate_method, wd);
+		}
 	}
+	if (m_statistics)
+		((wd) ? s->stats.hits : s->stats.misses)[3][WeatherBaseCache::TimeTier(_key->time)]++;
 
-	m_lock.Unlock();
+	s->lock.Unlock();
 	return wd;
 }
 
 
-void WeatherLayerCache::Clear() {			// really, the above lock/unlock locations should be changed - after the actual Store/Retrieve, but we are going
-	m_lock.Lock();					// to make the assumption that this routine will never be called asynchronously to the others
-	std::uint32_t i, size = ((std::uint32_t)m_xsize) * ((std::uint32_t)m_ysize);
-	for (i = 0; i < size; i++)
-		if (m_cacheArray[i]) {
-			m_created[m_cacheArray[i]->m_createdIndex].x = (std::uint16_t)-1;
-			m_created[m_cacheArray[i]->m_createdIndex].y = (std::uint16_t)-1;
-
-			delete m_cacheArray[i];
-			m_cacheArray[i] = NULL;
-		}
+void WeatherLayerCache::Clear() {			// shards are locked one at a time, making the assumption that this routine will never be called
+	for (std::uint16_t k = 0; k < SHARDS; k++) {	// asynchronously to Store/Retrieve
+		Shard *s = &m_shards[k];
+		s->lock.Lock();
+		while (!s->tiles.empty())
+			freeTile(s, s->tiles.back());
 
-		m_begin = m_end = 0;
+		s->begin = s->end = s->slots = 0;
+		s->buckets.clear();
 
 #ifdef _DEBUG
-		size_t allocsize = (size_t)m_max * sizeof(WEntry);
-		memset(m_created, -1, allocsize);
+		size_t allocsize = (size_t)m_maxCells * sizeof(WEntry);
+		memset(s->created, -1, allocsize);
 #endif
 
+		s->lock.Unlock();
+	}
 
-	m_lock.Unlock();
+	m_fwiState.Clear();
+	s_frontEpoch.fetch_add(1, std::memory_order_acq_rel);
 }
 
 
@@ -455,31 +1100,83 @@ bool WeatherBaseCache::Purge(const HSS_Time::WTime &time) {
 }
 
 
+// drops the cells that have had nothing stored in them for 2 hours before 'time', as WeatherBaseCache::Purge() would find, by only visiting the
+// buckets that have expired rather than every cell
 void WeatherLayerCache::PurgeOld(const HSS_Time::WTime &time) {
-	m_lock.Lock();					// to make the assumption that this routine will never be called asynchronously to the others
-	std::uint32_t i, size = ((std::uint32_t)m_xsize) * ((std::uint32_t)m_ysize);
-	for (i = 0; i < size; i++)
-		if (m_cacheArray[i]) {
-			if (m_cacheArray[i]->Purge(time)) {
-				m_created[m_cacheArray[i]->m_createdIndex].x = (std::uint16_t)-1;
-				m_created[m_cacheArray[i]->m_createdIndex].y = (std::uint16_t)-1;
-
-				delete m_cacheArray[i];
-				m_cacheArray[i] = NULL;
+	if (!m_tiles)
+		return;
+	const std::uint64_t cutoff = (time - WTimeSpan(2 * 60 * 60)).GetTotalMicroSeconds();	// keep caches around for at least 2 hours after points move on, so we can deal with joins, etc.
+	for (std::uint16_t k = 0; k < SHARDS; k++) {
+		Shard *s = &m_shards[k];
+		s->lock.Lock();
+		std::map<std::uint64_t, std::vector<WEntry>>::iterator it = s->buckets.begin();
+		while ((it != s->buckets.end()) && ((it->first + 1) * PURGE_BUCKET <= cutoff)) {
+			for (WEntry &we : it->second) {
+				WeatherBaseCache *c = existing(we.x, we.y);
+				if ((c) && (c->m_bucket == it->first)) {		// else it's gone, or it's had later times stored in it
+					s->created[c->m_createdIndex].x = (std::uint16_t)-1;	// left as a gap that evictCell() skips
+					s->created[c->m_createdIndex].y = (std::uint16_t)-1;
+					removeCell(s, we.x, we.y);
+					s->stats.purges++;
+				}
 			}
+			it = s->buckets.erase(it);
 		}
-	m_lock.Unlock();
+		s->lock.Unlock();
+	}
+	s_frontEpoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+
+WeatherCacheStats &WeatherCacheStats::operator+=(const WeatherCacheStats &s) {
+	for (std::uint16_t i = 0; i < 4; i++)
+		for (std::uint16_t j = 0; j < 4; j++) {
+			hits[i][j] += s.hits[i][j];
+			misses[i][j] += s.misses[i][j];
+			stores[i][j] += s.stores[i][j];
+		}
+	for (std::uint16_t i = 0; i < 4; i++)
+		front[i] += s.front[i];
+	evictions += s.evictions;
+	purges += s.purges;
+	return *this;
+}
+
+
+void WeatherLayerCache::Stats(WeatherCacheStats *stats) {
+	stats->Reset();
+	for (std::uint16_t k = 0; k < SHARDS; k++) {
+		m_shards[k].lock.Lock();
+		*stats += m_shards[k].stats;
+		m_shards[k].lock.Unlock();
+	}
+	for (std::uint16_t i = 0; i < 4; i++)
+		stats->front[i] = m_frontHits[i].load(std::memory_order_relaxed);
+}
+
+
+void WeatherLayerCache::ResetStats() {
+	for (std::uint16_t k = 0; k < SHARDS; k++) {
+		m_shards[k].lock.Lock();
+		m_shards[k].stats.Reset();
+		m_shards[k].lock.Unlock();
+	}
+	for (std::uint16_t i = 0; i < 4; i++)
+		m_frontHits[i] = 0;
 }
 
 
 bool WeatherLayerCache::Exists(std::uint16_t x, std::uint16_t y) {
-	bool retval;
-	m_lock.Lock();
+	bool retval = false;
 	weak_assert(x < m_xsize);
 	weak_assert(y < m_ysize);
-	std::uint32_t index = arrayIndex(x, y);
-	retval = (m_cacheArray[index]) ? true : false;
-	m_lock.Unlock();
+	std::uint32_t index = tileIndex(x, y);
+	Shard *s = shard(index);
+	s->lock.Lock();
+	Tile *t = tile(s, index, false);
+	if (t)
+		retval = (t->cells[cellIndex(x, y)]) ? true : false;
+	s->lock.Unlock();
 	return retval;
 }
 
@@ -499,7 +1196,24 @@ WeatherCache::~WeatherCache() {
 
 
 std::uint32_t WeatherCache::CacheEntries() const {
-	return (std::uint32_t)m_weatherLayerMap[0].size();
+	return (std::uint32_t)(m_weatherLayerMap[0].size() + m_weatherLayerMap[1].size());
+}
+
+
+bool WeatherCache::Stats(Layer *layerThread, std::uint16_t cacheIndex, WeatherCacheStats *stats) {
+	WeatherLayerCache *c = cache(layerThread, cacheIndex);
+	if ((!c) || (!c->m_statistics))
+		return false;
+	c->Stats(stats);
+	return true;
+}
+
+
+void WeatherCache::ResetStats() {
+	std::map<Layer *, WeatherLayerCache *>::iterator it;
+	for (std::uint16_t i = 0; i < 2; i++)
+		for (it = m_weatherLayerMap[i].begin(); it != m_weatherLayerMap[i].end(); it++)
+			it->second->ResetStats();
 }
 
 
@@ -516,7 +1230,7 @@ WeatherLayerCache *WeatherCache::cache(Layer *layerThread, std::uint16_t cacheIn
 
 void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const WeatherData *_answer, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			c->Store(_key, _answer, tm);
@@ -526,7 +1240,7 @@ void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const
 
 void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const HIWXData *_answer, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			c->Store(_key, _answer, tm);
@@ -536,7 +1250,7 @@ void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const
 
 void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const HIFWIData *_answer, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			c->Store(_key, _answer, tm);
@@ -546,7 +1260,7 @@ void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const
 
 void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const HDFWIData *_answer, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			c->Store(_key, _answer, tm);
@@ -556,7 +1270,7 @@ void WeatherCache::Store(std::uint16_t cacheIndex, const WeatherKey *_key, const
 
 WeatherData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_key, WeatherData *_to_fill, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			return c->Retrieve(_key, _to_fill, tm);
@@ -567,7 +1281,7 @@ WeatherData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *
 
 HIWXData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_key, HIWXData *_to_fill, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			return c->Retrieve(_key, _to_fill, tm);
@@ -578,7 +1292,7 @@ HIWXData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_ke
 
 HIFWIData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_key, HIFWIData *_to_fill, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			return c->Retrieve(_key, _to_fill, tm);
@@ -589,7 +1303,7 @@ HIFWIData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_k
 
 HDFWIData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_key, HDFWIData *_to_fill, const WTimeManager *tm) {
 	if (_key->layerThread) {
-		WeatherLayerCache *c = cache(_key->layerThread, cacheIndex);
+		WeatherLayerCache *c = cache(_key, cacheIndex);
 		weak_assert(c);
 		if (c)
 			return c->Retrieve(_key, _to_fill, tm);
@@ -598,14 +1312,21 @@ HDFWIData *WeatherCache::Retrieve(std::uint16_t cacheIndex, const WeatherKey *_k
 }
 
 
-void WeatherCache::Add(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x_size, std::uint16_t y_size) {
+void WeatherCache::Add(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x_size, std::uint16_t y_size, std::uint16_t eviction, std::uint64_t budget, bool statistics) {
 	if (layerThread) {
 		WeatherLayerCache* c1 = nullptr;
 		try {
 			std::map<Layer *, WeatherLayerCache *>::iterator it;
 			if ((it = m_weatherLayerMap[0].find(layerThread)) == m_weatherLayerMap[0].end()) {
-				c1 = new WeatherLayerCache(x_size, y_size, (cacheIndex) ? 50 : 7500, m_tm);
+				std::uint64_t b = budget;
+				if ((b) && (cacheIndex))
+					b = (b >= 150) ? (b / 150) : 1;		// same proportions as the built-in sizes
+				c1 = new WeatherLayerCache(x_size, y_size, (cacheIndex) ? 50 : 7500, b, m_tm);
+				c1->m_cacheIndex = cacheIndex;
+				c1->m_eviction = eviction;
+				c1->m_statistics = statistics;
 				(m_weatherLayerMap[cacheIndex])[layerThread] = c1;
+				setHandle(layerThread, cacheIndex, c1);
 			}
 		} catch (std::bad_alloc& cme) {
 			if (c1)
@@ -615,11 +1336,38 @@ void WeatherCache::Add(Layer *layerThread, std::uint16_t cacheIndex, std::uint16
 }
 
 
+// records the cache Handle() returns for this layer.  A layer keeps its slot once it has no caches left, until another layer needs the slot,
+// and the slot's layer is always set before its caches so Handle() can tell when a slot has changed hands under it.  If every slot is
+// taken, the layer just isn't recorded and its caches are looked up in the maps.
+void WeatherCache::setHandle(Layer *layerThread, std::uint16_t cacheIndex, WeatherLayerCache *c) {
+	LayerHandles *free = nullptr;
+	std::uint16_t slot = handleSlot(layerThread);
+	for (std::uint16_t i = 0; i < HANDLE_SLOTS; i++, slot = (slot + 1) % HANDLE_SLOTS) {
+		LayerHandles *h = &m_handles[slot];
+		Layer *l = h->layerThread.load(std::memory_order_relaxed);
+		if (l == layerThread) {
+			h->cache[cacheIndex].store(c, std::memory_order_release);
+			return;
+		}
+		if ((!free) && ((!l) || ((!h->cache[0].load(std::memory_order_relaxed)) && (!h->cache[1].load(std::memory_order_relaxed)))))
+			free = h;
+		if (!l)
+			break;
+	}
+	if ((c) && (free)) {
+		free->layerThread.store(layerThread, std::memory_order_release);
+		free->cache[cacheIndex ^ 1].store(nullptr, std::memory_order_release);
+		free->cache[cacheIndex].store(c, std::memory_order_release);
+	}
+}
+
+
 void WeatherCache::Remove(Layer *layerThread, std::uint16_t cacheIndex) {
 	if (layerThread == (Layer *)-1) {
 		std::map<Layer *, WeatherLayerCache*>::iterator it;
 		for (it = m_weatherLayerMap[cacheIndex].begin(); it != m_weatherLayerMap[cacheIndex].end(); it++) {
 			weak_assert(false);
+			setHandle(it->first, cacheIndex, nullptr);
 			delete it->second;
 		}
 	}
@@ -627,6 +1375,7 @@ void WeatherCache::Remove(Layer *layerThread, std::uint16_t cacheIndex) {
 		std::map<Layer *, WeatherLayerCache *>::iterator it;
 		if ((it = m_weatherLayerMap[cacheIndex].find(layerThread)) == m_weatherLayerMap[cacheIndex].end())
 			return;
+		setHandle(layerThread, cacheIndex, nullptr);
 		if (it->second)
 			delete it->second;
 		m_weatherLayerMap[cacheIndex].erase(it);
@@ -715,6 +1464,16 @@ void WeatherCache::SetTimeManager(WTimeManager* tm) {
 }
 
 
+DailyFWIState *WeatherCache::FWIState(Layer *layerThread, std::uint16_t cacheIndex) {
+	if (layerThread) {
+		WeatherLayerCache *c = cache(layerThread, cacheIndex);
+		if (c)
+			return &c->m_fwiState;
+	}
+	return nullptr;
+}
+
+
 HSS_Time::WTime WeatherCache::EquilibriumDepth(Layer *layerThread, std::uint16_t cacheIndex) {
 	if (layerThread) {
 		WeatherLayerCache *c = cache(layerThread, cacheIndex);
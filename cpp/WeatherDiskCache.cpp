@@ -0,0 +1,390 @@
+/**
+ * WISE_Weather_Module: WeatherDiskCache.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WeatherDiskCache.h"
+#include "FireEngine_ext.h"
+#include "filesystem.hpp"
+#include "str_printf.h"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+#define DISK_CACHE_FRAMES	2			// frames kept open at once, per stripe
+#define DISK_CACHE_TILES	64			// tiles kept mapped at once, per frame
+#define DISK_CACHE_VERSION	3
+#define DISK_CACHE_MAX_BYTES	(32ull * 1024ull * 1024ull * 1024ull)	// tile files are deleted, least recently written first, to keep the directory under this
+#define DISK_CACHE_MAX_AGE	(30 * 24)		// hours since a tile file was last written before it's deleted
+#define DISK_CACHE_PRUNE	256			// tile files created between checks of the directory's size
+#define DISK_CACHE_TMP_AGE	1			// hours before a temporary file is taken to be left behind by a run that stopped part way
+
+#define DISK_KEY_MASK	(~((1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE) | \
+			   (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_CALCFWI) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)))	// same bits WeatherCache ignores for weather
+
+struct WeatherDiskHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t record_size;
+	std::uint16_t x_size, y_size;
+	std::uint32_t tile;
+	std::uint64_t grid_hash;
+};
+
+static const char disk_magic[8] = { 'W', 'I', 'S', 'E', 'W', 'X', 'D', 'C' };
+
+
+WeatherDiskCache::WeatherDiskCache(const std::string &directory, std::uint64_t grid_hash, std::uint16_t x_size, std::uint16_t y_size, const ContentHash &content)
+    : m_directory(directory), m_gridHash(grid_hash), m_content(content) {
+	m_xsize = x_size;
+	m_ysize = y_size;
+	m_xtiles = (std::uint16_t)((m_xsize + TILE_SIZE - 1) / TILE_SIZE);
+	m_created = 0;
+	for (std::uint16_t i = 0; i < STRIPES; i++)
+		m_stripes[i].used = 0;
+
+	std::error_code ec;
+	std::filesystem::create_directories(m_directory, ec);		// if this fails then opening frames fails too, and the cache just does nothing
+	prune();
+}
+
+
+WeatherDiskCache::~WeatherDiskCache() {
+	for (std::uint16_t i = 0; i < STRIPES; i++)
+		for (auto &f : m_stripes[i].frames)
+			for (auto &t : f.tiles)
+				delete t.second.file;
+}
+
+
+// FNV-1a, it only has to tell inputs apart, not resist anyone trying to collide them
+std::uint64_t WeatherDiskCache::Hash(std::uint64_t hash, const void *data, std::size_t size) {
+	const std::uint8_t *d = (const std::uint8_t *)data;
+	for (std::size_t i = 0; i < size; i++) {
+		hash ^= d[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+
+// field by field so padding in the structure doesn't get into the hash
+std::uint64_t WeatherDiskCache::Hash(std::uint64_t hash, const IWXData &wx) {
+	hash = Hash(hash, wx.Temperature);
+	hash = Hash(hash, wx.DewPointTemperature);
+	hash = Hash(hash, wx.RH);
+	hash = Hash(hash, wx.Precipitation);
+	hash = Hash(hash, wx.WindSpeed);
+	hash = Hash(hash, wx.WindGust);
+	hash = Hash(hash, wx.WindDirection);
+	return Hash(hash, (std::uint64_t)wx.SpecifiedBits);
+}
+
+
+bool WeatherDiskCache::Retrieve(const HSS_Time::WTime &time, std::uint64_t interpolate_method, std::uint16_t x, std::uint16_t y, double elevation, IWXData *wx) {
+	weak_assert(x < m_xsize);
+	weak_assert(y < m_ysize);
+
+	bool found = false;
+	interpolate_method &= DISK_KEY_MASK;
+	Stripe *s = stripe(time, interpolate_method);
+	s->lock.Lock();
+	const Tile *t = tile(frame(s, time, interpolate_method), tileIndex(x, y));
+	if (t->records) {
+		const Record *r = t->records + recordIndex(x, y);
+		if (r->filled) {
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (r->elevation == elevation) {
+				*wx = r->wx;
+				found = true;
+			}
+		}
+	}
+	s->lock.Unlock();
+	return found;
+}
+
+
+void WeatherDiskCache::Store(const HSS_Time::WTime &time, std::uint64_t interpolate_method, std::uint16_t x, std::uint16_t y, double elevation, const IWXData *wx) {
+	weak_assert(x < m_xsize);
+	weak_assert(y < m_ysize);
+
+	interpolate_method &= DISK_KEY_MASK;
+	Stripe *s = stripe(time, interpolate_method);
+	s->lock.Lock();
+	Frame *f = frame(s, time, interpolate_method);
+	const std::uint32_t index = tileIndex(x, y);
+	Tile *t = tile(f, index);
+	if (writable(f, index, t)) {
+		Record *r = t->writable + recordIndex(x, y);
+		r->elevation = elevation;
+		r->wx = *wx;
+		std::atomic_thread_fence(std::memory_order_release);	// another process may have the file mapped too
+		r->filled = 1;
+	}
+	s->lock.Unlock();
+}
+
+
+WeatherDiskCache::Stripe *WeatherDiskCache::stripe(const HSS_Time::WTime &time, std::uint64_t interpolate_method) {
+	std::uint64_t h = (time.GetTotalMicroSeconds() / (60ULL * 60ULL * 1000000ULL)) ^ interpolate_method;
+	h *= 0x9e3779b97f4a7c15ull;
+	return &m_stripes[(h >> 32) % STRIPES];
+}
+
+
+// finds the frame for this time and interpolation in the stripe (which must be locked), closing the stripe's least recently used frame (and all of
+// its tiles) to make room if it's not open yet
+WeatherDiskCache::Frame *WeatherDiskCache::frame(Stripe *s, const HSS_Time::WTime &time, std::uint64_t interpolate_method) {
+	const std::uint64_t t = time.GetTotalMicroSeconds();
+	for (auto &f : s->frames)
+		if ((f.time == t) && (f.interpolate_method == interpolate_method)) {
+			f.used = ++s->used;
+			return &f;
+		}
+
+	Frame *f;
+	if (s->frames.size() < DISK_CACHE_FRAMES) {
+		s->frames.emplace_back();
+		f = &s->frames.back();
+	}
+	else {
+		f = &s->frames[0];
+		for (auto &ff : s->frames)
+			if (ff.used < f->used)
+				f = &ff;
+		for (auto &tt : f->tiles)
+			delete tt.second.file;
+		f->tiles.clear();
+	}
+
+	f->time = t;
+	f->interpolate_method = interpolate_method;
+	f->content = m_content(time, interpolate_method);
+	f->touch = 0;
+	f->used = ++s->used;
+	return f;
+}
+
+
+// finds a tile of the frame, mapping its file for reading if it's not open yet and the file exists, and closing the frame's least recently
+// used tile to make room
+WeatherDiskCache::Tile *WeatherDiskCache::tile(Frame *f, std::uint32_t index) {
+	auto it = f->tiles.find(index);
+	if (it != f->tiles.end()) {
+		it->second.used = ++f->touch;
+		return &it->second;
+	}
+
+	if (f->tiles.size() >= DISK_CACHE_TILES) {
+		auto lru = f->tiles.begin();
+		for (auto tt = f->tiles.begin(); tt != f->tiles.end(); tt++)
+			if (tt->second.used < lru->second.used)
+				lru = tt;
+		delete lru->second.file;
+		f->tiles.erase(lru);
+	}
+
+	Tile &t = f->tiles[index];
+	t.file = map(filename(f, index), index, false);
+	t.records = (t.file) ? (const Record *)(t.file->const_data() + sizeof(WeatherDiskHeader)) : nullptr;
+	t.writable = nullptr;
+	t.failed = false;
+	t.used = ++f->touch;
+	return &t;
+}
+
+
+// makes sure the tile's file is mapped for writing, creating the file if it doesn't exist yet
+bool WeatherDiskCache::writable(const Frame *f, std::uint32_t index, Tile *t) {
+	if (t->writable)
+		return true;
+	if (t->failed)
+		return false;
+
+	const std::string name = filename(f, index);
+	boost::iostreams::mapped_file *mf = map(name, index, true);
+	if ((!mf) && (create(name, index)))
+		mf = map(name, index, true);
+	if (!mf) {
+		t->failed = true;
+		return false;
+	}
+	delete t->file;
+	t->file = mf;
+	t->writable = (Record *)(mf->data() + sizeof(WeatherDiskHeader));
+	t->records = t->writable;
+	return true;
+}
+
+
+std::string WeatherDiskCache::filename(const Frame *f, std::uint32_t index) const {
+	const std::filesystem::path p = std::filesystem::path(m_directory) / strprintf("%016llx%016llx%08x.wxc", (unsigned long long)m_gridHash, (unsigned long long)f->content, (unsigned)index);
+	return p.string();
+}
+
+
+static void diskHeader(WeatherDiskHeader *h, std::uint64_t grid_hash, std::uint16_t x_size, std::uint16_t y_size, std::uint32_t tile, std::uint32_t record_size) {
+	memset(h, 0, sizeof(*h));
+	memcpy(h->magic, disk_magic, sizeof(h->magic));
+	h->version = DISK_CACHE_VERSION;
+	h->record_size = record_size;
+	h->x_size = x_size;
+	h->y_size = y_size;
+	h->tile = tile;
+	h->grid_hash = grid_hash;
+}
+
+
+// maps an existing tile file if it's the right size and from this build, grid, and tile, nullptr otherwise; never creates or resizes the file
+boost::iostreams::mapped_file *WeatherDiskCache::map(const std::string &filename, std::uint32_t index, bool writable) {
+	const std::size_t size = sizeof(WeatherDiskHeader) + (std::size_t)TILE_SIZE * (std::size_t)TILE_SIZE * sizeof(Record);
+	WeatherDiskHeader h;
+	diskHeader(&h, m_gridHash, m_xsize, m_ysize, index, sizeof(Record));
+
+	boost::iostreams::mapped_file *mf = nullptr;
+	try {
+		std::error_code ec;
+		if (std::filesystem::file_size(filename, ec) == size) {
+			mf = new boost::iostreams::mapped_file(filename, (writable) ? boost::iostreams::mapped_file::readwrite : boost::iostreams::mapped_file::readonly);
+			if (!memcmp(mf->const_data(), &h, sizeof(h)))
+				return mf;
+		}
+	}
+	catch (std::exception &) {
+	}
+	if (mf)
+		delete mf;
+	return nullptr;
+}
+
+
+// creates a tile file with every record empty.  Tiles along the right and bottom edges of the grid are the same size as the rest, so the
+// file layout doesn't depend on where the tile is.  It's made under a temporary name (opened exclusively, so two processes can't share one)
+// and then linked to its real name, which fails rather than replacing a file another process made first.  Only a file from a different
+// build or grid is removed to make way, and removing a file doesn't disturb anyone that has it mapped.
+bool WeatherDiskCache::create(const std::string &filename, std::uint32_t index) {
+	const std::size_t size = sizeof(WeatherDiskHeader) + (std::size_t)TILE_SIZE * (std::size_t)TILE_SIZE * sizeof(Record);
+	WeatherDiskHeader h;
+	diskHeader(&h, m_gridHash, m_xsize, m_ysize, index, sizeof(Record));
+
+	static std::atomic<std::uint64_t> s_tmp(0);
+	const std::uint64_t unique = (std::uint64_t)std::chrono::steady_clock::now().time_since_epoch().count() ^ (((std::uint64_t)(std::uintptr_t)this) << 16) ^ (++s_tmp);
+	const std::string tmp = filename + strprintf(".%016llx.tmp", (unsigned long long)unique);
+
+	FILE *fp = fopen(tmp.c_str(), "wbx");
+	if (!fp)
+		return false;
+	const bool written = (fwrite(&h, sizeof(h), 1, fp) == 1);
+	fclose(fp);
+
+	std::error_code ec;
+	if (written)
+		std::filesystem::resize_file(tmp, size, ec);		// zero filled, so every record starts out empty
+	if ((!written) || (ec)) {
+		std::filesystem::remove(tmp, ec);
+		return false;
+	}
+
+	bool created = false;
+	for (std::uint16_t attempt = 0; (attempt < 2) && (!created); attempt++) {
+		std::filesystem::create_hard_link(tmp, filename, ec);
+		if (!ec)
+			created = true;
+		else if (std::filesystem::exists(filename, ec)) {
+			boost::iostreams::mapped_file *mf = map(filename, index, false);
+			if (mf) {					// another process beat us to it, use theirs
+				delete mf;
+				created = true;
+			}
+			else
+				std::filesystem::remove(filename, ec);	// stale, from a different build or grid
+		}
+		else {
+			std::filesystem::rename(tmp, filename, ec);	// the file system doesn't do hard links, and there's nothing at 'filename' to replace
+			created = !ec;
+		}
+	}
+	std::filesystem::remove(tmp, ec);
+	if ((created) && (!(++m_created % DISK_CACHE_PRUNE)))
+		prune();
+	return created;
+}
+
+
+// deletes tile files that haven't been written to in DISK_CACHE_MAX_AGE, then the least recently written until what's left fits in
+// DISK_CACHE_MAX_BYTES, along with temporary files left behind by runs that stopped part way through creating a tile.  Files another process
+// has mapped stay usable by it (or, on Windows, can't be deleted and are left for next time).
+void WeatherDiskCache::prune() {
+	struct Entry {
+		std::filesystem::file_time_type written;
+		std::uintmax_t size;
+		std::filesystem::path path;
+	};
+
+	std::vector<Entry> entries;
+	const std::filesystem::file_time_type now = std::filesystem::file_time_type::clock::now();
+	std::uintmax_t total = 0;
+	std::error_code ec;
+	try {
+		for (std::filesystem::directory_iterator it(m_directory, ec), end; (!ec) && (it != end); it.increment(ec)) {
+			const std::filesystem::path &p = it->path();
+			const std::string ext = p.extension().string();
+			if ((ext != ".wxc") && (ext != ".tmp"))
+				continue;
+			std::error_code fec;
+			const std::filesystem::file_time_type written = std::filesystem::last_write_time(p, fec);
+			if (fec)
+				continue;
+			if (ext == ".tmp") {
+				if (now - written > std::chrono::hours(DISK_CACHE_TMP_AGE))
+					std::filesystem::remove(p, fec);
+			}
+			else if (now - written > std::chrono::hours(DISK_CACHE_MAX_AGE))
+				std::filesystem::remove(p, fec);
+			else {
+				Entry e;
+				e.written = written;
+				e.size = std::filesystem::file_size(p, fec);
+				e.path = p;
+				if (!fec) {
+					total += e.size;
+					entries.push_back(std::move(e));
+				}
+			}
+		}
+
+		if (total > DISK_CACHE_MAX_BYTES) {
+			std::sort(entries.begin(), entries.end(), [](const Entry &e1, const Entry &e2) { return e1.written < e2.written; });
+			for (auto &e : entries) {
+				if (total <= DISK_CACHE_MAX_BYTES)
+					break;
+				if (std::filesystem::remove(e.path, ec))
+					total -= e.size;
+			}
+		}
+	}
+	catch (std::exception &) {			// the cache is only an accelerator, anything left is tried again next time
+	}
+}
+
+#endif
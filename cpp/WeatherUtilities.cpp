@@ -29,8 +29,8 @@ WeatherUtilities::WeatherUtilities(WTimeManager *tm) : m_cache(tm) {
 }
 
 
-void WeatherUtilities::AddCache(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x, std::uint16_t y) {
-	m_cache.Add(layerThread, cacheIndex, x, y);
+void WeatherUtilities::AddCache(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x, std::uint16_t y, std::uint16_t eviction, std::uint64_t budget, bool statistics) {
+	m_cache.Add(layerThread, cacheIndex, x, y, eviction, budget, statistics);
 }
 
 
@@ -64,6 +64,25 @@ void WeatherUtilities::SetEquilibriumLimit(Layer *layerThread, std::uint16_t cac
 }
 
 
+// returns the cache GetCalculatedValues() will use for this layer and interpolation method, for callers to put in their WeatherKeys so the
+// layer isn't looked up for every point they ask for
+WeatherLayerCache *WeatherUtilities::CacheHandle(Layer *layerThread, std::uint64_t interpolate_method) {
+	const std::uint16_t alternate = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE)) ? 1 : 0;
+	return m_cache.Handle(layerThread, alternate);
+}
+
+
+// fills 'stats' with the counts for this layer's cache, returning false if it doesn't exist or isn't keeping them
+bool WeatherUtilities::CacheStats(Layer *layerThread, std::uint16_t cacheIndex, WeatherCacheStats *stats) {
+	return m_cache.Stats(layerThread, cacheIndex, stats);
+}
+
+
+void WeatherUtilities::ResetCacheStats() {
+	m_cache.ResetStats();
+}
+
+
 void WeatherUtilities::PurgeOldCache(Layer *layerThread, std::uint16_t cacheIndex, const HSS_Time::WTime &time) {
 	m_cache.PurgeOld(layerThread, cacheIndex, time);	
 }
@@ -83,7 +102,7 @@ HRESULT WeatherUtilities::GetCalculatedValues(ICWFGM_GridEngine *grid, Layer *la
 		return data.hr;
 	}
 
-	if (FAILED(hr = GetRawWxValues(grid, layerThread, time, pt, key.interpolate_method, &data.wx, &data.wx_valid))) {
+	if (FAILED(hr = GetRawWxValues(grid, layerThread, key.cache, time, pt, key.interpolate_method, &data.wx, &data.wx_valid))) {
 		weak_assert(false);
 		return hr;
 	}
@@ -95,23 +114,23 @@ HRESULT WeatherUtilities::GetCalculatedValues(ICWFGM_GridEngine *grid, Layer *la
 													// where effects are cumulative, then we can't continue here and let it simply act
 													// as if it's just 1 weather stream feeding data (because it isn't)
 
-		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, time, pt, key.interpolate_method, data.wx.SpecifiedBits, &data.dfwi, &data.wx_valid))) {
+		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, key.cache, time, pt, key.interpolate_method, data.wx.SpecifiedBits, &data.dfwi, &data.wx_valid))) {
 			weak_assert(false);
 			return hr;
 		}
-		if (FAILED(hr = GetRawIFWIValues(grid, layerThread, time, pt, key.interpolate_method, data.wx.SpecifiedBits, &data.ifwi, &data.wx_valid))) {
+		if (FAILED(hr = GetRawIFWIValues(grid, layerThread, key.cache, time, pt, key.interpolate_method, data.wx.SpecifiedBits, &data.ifwi, &data.wx_valid))) {
 			weak_assert(false);
 			return hr;
 		}
 	} else {
-		if (time <= m_cache.EquilibriumDepth(layerThread, alternate))
+		if ((key.cache) && (time <= key.cache->m_equilibriumTime))
 			hr = CWFGM_WEATHER_INITIAL_VALUES_ONLY;
 		if (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY) {
 			WTime yesterday(time);
 			yesterday -= WTimeSpan(0, 12, 0, 0);
 			yesterday.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
 			WTime todayStart(yesterday + WTimeSpan(0, 12, 0, 0));
-			if (FAILED(hr = GetRawDFWIValues(grid, layerThread, time, pt, key.interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), data.wx.SpecifiedBits, &data.dfwi, &data.wx_valid)))
+			if (FAILED(hr = GetRawDFWIValues(grid, layerThread, key.cache, time, pt, key.interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), data.wx.SpecifiedBits, &data.dfwi, &data.wx_valid)))
 			{
 				weak_assert(false);
 				return hr;
@@ -133,13 +152,13 @@ HRESULT WeatherUtilities::GetCalculatedValues(ICWFGM_GridEngine *grid, Layer *la
 			lat = DEGREE_TO_RADIAN(lat);
 			
 			// gets yesterday's daily FWI starting codes, spatially interpolated to this location
-			if (FAILED(hr = GetCalculatedDFWIValues(grid, layerThread, time, pt, lat, lon, key.interpolate_method, &data.wx, &data.dfwi))) {
+			if (FAILED(hr = GetCalculatedDFWIValues(grid, layerThread, key.cache, time, pt, lat, lon, key.interpolate_method, &data.wx, &data.dfwi))) {
 				weak_assert(false);
 				return hr;
 			}
 
 			// computes the instantaneous FWI codes for this location, using spatially interpolated weather and starting codes
-			if (FAILED(hr = GetCalculatedIFWIValues(grid, layerThread, key.time, pt, lat, lon, key.interpolate_method, &data.wx, &data.ifwi))) {
+			if (FAILED(hr = GetCalculatedIFWIValues(grid, layerThread, key.cache, key.time, pt, lat, lon, key.interpolate_method, &data.wx, &data.ifwi))) {
 				weak_assert(false);
 				return hr;
 			}
@@ -154,7 +173,7 @@ HRESULT WeatherUtilities::GetCalculatedValues(ICWFGM_GridEngine *grid, Layer *la
 	return hr;
 }
 
-HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, DFWIData *t_dfwi, DFWIData *p_dfwi)
+HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, DFWIData *t_dfwi, DFWIData *p_dfwi)
 {
 	HRESULT hr = S_OK;
 	bool wx_valid;
@@ -169,7 +188,7 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 	yesterday -= WTimeSpan(0, 12, 0, 0);
 
 	if ((!(interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL))) || (!(interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_CALCFWI)))) {
-		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, todayStart, pt, interpolate_method, wx->SpecifiedBits, t_dfwi, &wx_valid)) || (!wx_valid))
+		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, layerCache, todayStart, pt, interpolate_method, wx->SpecifiedBits, t_dfwi, &wx_valid)) || (!wx_valid))
 		{
 			weak_assert(false);
 		}
@@ -177,11 +196,18 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 		return hr;
 	}
 
+	const std::uint32_t bitmask = IWXDATA_OVERRODE_TEMPERATURE | IWXDATA_OVERRODE_RH | IWXDATA_OVERRODE_PRECIPITATION | IWXDATA_OVERRODE_WINDSPEED |
+			      IWXDATA_OVERRODEHISTORY_TEMPERATURE | IWXDATA_OVERRODEHISTORY_RH | IWXDATA_OVERRODEHISTORY_PRECIPITATION | IWXDATA_OVERRODEHISTORY_WINDSPEED;
+
 	// get yesterday's spatially interpolated FWI starting codes for this location
-	if (FAILED(hr = GetRawDFWIValues(grid, layerThread, yesterday, pt, interpolate_method, wx->SpecifiedBits, p_dfwi, &wx_valid)) || (!wx_valid))
+	if ((wx->SpecifiedBits & bitmask) && (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)))
+		hr = getDailyState(grid, layerThread, layerCache, yesterday, pt, lat, lon, interpolate_method, wx->SpecifiedBits, p_dfwi, &wx_valid);
+	else
+		hr = GetRawDFWIValues(grid, layerThread, layerCache, yesterday, pt, interpolate_method, wx->SpecifiedBits, p_dfwi, &wx_valid);
+	if (FAILED(hr) || (!wx_valid))
 	{
 		// this happens whenever at least one weather stream has no daily codes specified for yesterday
-		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, todayStart, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx->SpecifiedBits, t_dfwi, &wx_valid)) || (!wx_valid))
+		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, layerCache, todayStart, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx->SpecifiedBits, t_dfwi, &wx_valid)) || (!wx_valid))
 		{
 			weak_assert(false);
 		}
@@ -190,8 +216,8 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 	}
 	
 	// get todays spatially interpolated weather conditions (at the start of the FWI day)
-	IWXData wx1, wx2;
-	if (FAILED(hr = GetRawWxValues(grid, layerThread, todayStart, pt, interpolate_method, &wx1, &wx_valid)) || (!wx_valid))
+	IWXData wx1;
+	if (FAILED(hr = GetRawWxValues(grid, layerThread, layerCache, todayStart, pt, interpolate_method, &wx1, &wx_valid)) || (!wx_valid))
 	{
 		weak_assert(false);
 		return hr;
@@ -199,7 +225,7 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 	else if (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY)
 	{
 		// this happens when at least one weather stream is missing wx data from the start of the fwi day
-		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, todayStart, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx1.SpecifiedBits, t_dfwi, &wx_valid)) || (!wx_valid))
+		if (FAILED(hr = GetRawDFWIValues(grid, layerThread, layerCache, todayStart, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx1.SpecifiedBits, t_dfwi, &wx_valid)) || (!wx_valid))
 		{
 			weak_assert(false);
 		}
@@ -207,21 +233,45 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 		return hr;
 	}
 
-	double rain = wx1.Precipitation;
+	return calculateDailyCodes(grid, layerThread, layerCache, todayStart, yesterday, pt, lat, lon, interpolate_method, &wx1, p_dfwi, t_dfwi);
+}
+
+
+// this routine returns the rain that fell at this location since the start of the previous FWI day, up to and including the start of today's FWI day
+HRESULT WeatherUtilities::GetRawDailyRain(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &todayStart, const HSS_Time::WTime &yesterday, const XY_Point &pt, std::uint64_t interpolate_method, const IWXData *wx1, double *rain)
+{
+	HRESULT hr = S_OK;
+	bool wx_valid;
+	IWXData wx2;
+
+	*rain = wx1->Precipitation;
 	WTime loop(todayStart);
 	for (loop -= WTimeSpan(0, 1, 0, 0); loop > yesterday; loop -= WTimeSpan(0, 1, 0, 0)) {
-		if (SUCCEEDED(hr = GetRawWxValues(grid, layerThread, loop, pt, interpolate_method, &wx2, &wx_valid)) || (!wx_valid))
-			rain += wx2.Precipitation;
+		if (SUCCEEDED(hr = GetRawWxValues(grid, layerThread, layerCache, loop, pt, interpolate_method, &wx2, &wx_valid)) || (!wx_valid))
+			*rain += wx2.Precipitation;
 		else
-			break;				// ran out of weather data
+			break;				// ran out of weather data, the failure goes back to the caller
 	}
+	return hr;
+}
+
+
+// this routine computes the daily codes for the FWI day starting at todayStart from the previous day's codes and the weather for the
+// start of the day, accumulating the rain that fell since the start of the previous FWI day
+HRESULT WeatherUtilities::calculateDailyCodes(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &todayStart, const HSS_Time::WTime &yesterday, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx1, const DFWIData *p_dfwi, DFWIData *t_dfwi)
+{
+	HRESULT hr;
+
+	double rain;
+	if (FAILED(hr = GetRawDailyRain(grid, layerThread, layerCache, todayStart, yesterday, pt, interpolate_method, wx1, &rain)))
+		return hr;
 
 	std::uint16_t fwiMonth = (std::uint16_t)todayStart.GetMonth(WTIME_FORMAT_AS_LOCAL) - 1;
 
 	double dd;
 	// Compute new value for dFFMC, dDMC and dDC for time using the values found in wx and the p_dfwi, and place the result
 	// in the return variable for todays daily FWI codes (t_dfwi).
-	if (FAILED(hr = m_fwi.DailyFFMC_VanWagner(p_dfwi->dFFMC, rain, wx1.Temperature, wx1.RH, wx1.WindSpeed, &dd)))
+	if (FAILED(hr = m_fwi.DailyFFMC_VanWagner(p_dfwi->dFFMC, rain, wx1->Temperature, wx1->RH, wx1->WindSpeed, &dd)))
 	{
 		weak_assert(false);
 		return hr;
@@ -231,7 +281,7 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 		t_dfwi->SpecifiedBits |= DFWIDATA_OVERRODE_FFMC;
 	}
 
-	if (FAILED(hr = m_fwi.ISI_FBP(t_dfwi->dFFMC, wx1.WindSpeed, 24 * 60 * 60, &dd)))
+	if (FAILED(hr = m_fwi.ISI_FBP(t_dfwi->dFFMC, wx1->WindSpeed, 24 * 60 * 60, &dd)))
 	{
 		weak_assert(false);
 		return hr;
@@ -241,7 +291,7 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 		t_dfwi->SpecifiedBits |= DFWIDATA_OVERRODE_ISI;
 	}
 
-	if (FAILED(hr = m_fwi.DMC(p_dfwi->dDMC, rain, wx1.Temperature, lat, lon, fwiMonth, wx1.RH, &dd)))
+	if (FAILED(hr = m_fwi.DMC(p_dfwi->dDMC, rain, wx1->Temperature, lat, lon, fwiMonth, wx1->RH, &dd)))
 	{
 		weak_assert(false);
 		return hr;
@@ -251,7 +301,7 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 		t_dfwi->SpecifiedBits |= DFWIDATA_OVERRODE_DMC;
 	}
 
-	if (FAILED(hr = m_fwi.DC(p_dfwi->dDC, rain, wx1.Temperature, lat, lon, fwiMonth, &dd)))
+	if (FAILED(hr = m_fwi.DC(p_dfwi->dDC, rain, wx1->Temperature, lat, lon, fwiMonth, &dd)))
 	{
 		weak_assert(false);
 		return hr;
@@ -287,7 +337,110 @@ HRESULT WeatherUtilities::GetCalculatedDFWIValues(ICWFGM_GridEngine *grid, Layer
 }
 
 
-HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, IFWIData *ifwi)
+// this routine returns the daily FWI codes for this location, for the FWI day starting at 'day', as GetCalculatedValues() would calculate them.
+// rather than recursing back through every day to the equilibrium depth, the codes are kept per cell and advanced a day at a time.
+HRESULT WeatherUtilities::getDailyState(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &day, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *dfwi, bool *wx_valid)
+{
+	const bool use_cache = (interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE) ? false : true);
+
+	WeatherLayerCache *c = (use_cache) ? layerCache : nullptr;
+	if (!c)
+		return GetRawDFWIValues(grid, layerThread, layerCache, day, pt, interpolate_method, WX_SpecifiedBits, dfwi, wx_valid);
+
+	std::uint16_t x = (std::uint16_t)floor((pt.x - m_converter.xllcorner()) / m_converter.resolution());
+	std::uint16_t y = (std::uint16_t)floor((pt.y - m_converter.yllcorner()) / m_converter.resolution());
+
+	DailyFWIState *state = &c->m_fwiState;
+	HRESULT hr = S_OK;
+	memset(dfwi, 0, sizeof(DFWIData));
+	if (!state->Retrieve(x, y, interpolate_method, day, dfwi, wx_valid)) {
+		WTime base(c->m_equilibriumTime);	// the last FWI day starting at or before the equilibrium depth, where everything
+		base -= WTimeSpan(0, 12, 0, 0);					// starts from the (interpolated) initial codes
+		base.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
+		base += WTimeSpan(0, 12, 0, 0);
+
+		WTime n(day);
+		DFWIData p;
+		bool p_valid;
+		std::uint64_t found;
+		if (state->RetrieveBefore(x, y, interpolate_method, day, &found, &p, &p_valid))
+			n = WTime(found, m_tm, false);
+		if ((n == day) || (n < base)) {
+			n = (day < base) ? day : base;
+			if (FAILED(hr = stepDailyState(grid, layerThread, layerCache, c->m_equilibriumTime, n, pt, lat, lon, interpolate_method, nullptr, &p, &p_valid)))
+				p_valid = false;
+			state->Store(x, y, interpolate_method, n, &p, p_valid);
+		}
+		while (n < day) {
+			n += WTimeSpan(1, 0, 0, 0);
+			DFWIData t;
+			bool t_valid;
+			if (FAILED(hr = stepDailyState(grid, layerThread, layerCache, c->m_equilibriumTime, n, pt, lat, lon, interpolate_method, (p_valid) ? &p : nullptr, &t, &t_valid)))
+				t_valid = false;
+			state->Store(x, y, interpolate_method, n, &t, t_valid);
+			p = t;
+			p_valid = t_valid;
+		}
+		weak_assert(n == day);
+
+		dfwi->dFFMC = p.dFFMC;
+		dfwi->dDMC = p.dDMC;
+		dfwi->dDC = p.dDC;
+		*wx_valid = p_valid;
+		if (FAILED(hr))
+			return hr;
+	}
+	if (*wx_valid)
+		m_fwi.BUI(dfwi->dDC, dfwi->dDMC, &dfwi->dBUI);
+	return S_OK;
+}
+
+
+// this routine calculates the daily FWI codes for this location for the FWI day starting at 'day', given the codes for the previous day, making the same
+// decisions as GetCalculatedValues() and GetCalculatedDFWIValues() would when asked for the codes at 'day'
+HRESULT WeatherUtilities::stepDailyState(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &equilibrium, const HSS_Time::WTime &day, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const DFWIData *p_dfwi, DFWIData *t_dfwi, bool *t_valid)
+{
+	const std::uint32_t bitmask = IWXDATA_OVERRODE_TEMPERATURE | IWXDATA_OVERRODE_RH | IWXDATA_OVERRODE_PRECIPITATION | IWXDATA_OVERRODE_WINDSPEED |
+			      IWXDATA_OVERRODEHISTORY_TEMPERATURE | IWXDATA_OVERRODEHISTORY_RH | IWXDATA_OVERRODEHISTORY_PRECIPITATION | IWXDATA_OVERRODEHISTORY_WINDSPEED;
+	HRESULT hr;
+	IWXData wx1;
+	bool wx_valid;
+
+	memset(t_dfwi, 0, sizeof(DFWIData));
+	*t_valid = false;
+	if (FAILED(hr = GetRawWxValues(grid, layerThread, layerCache, day, pt, interpolate_method, &wx1, &wx_valid)))
+		return hr;
+
+	if ((day <= equilibrium) || (hr == CWFGM_WEATHER_INITIAL_VALUES_ONLY))
+		return GetRawDFWIValues(grid, layerThread, layerCache, day, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx1.SpecifiedBits, t_dfwi, t_valid);
+
+	*t_valid = wx_valid;
+
+	WTime yesterday(day);
+	yesterday -= WTimeSpan(1, 0, 0, 0);
+	DFWIData p;
+	bool p_valid;
+	if (!(wx1.SpecifiedBits & bitmask)) {		// nothing was overridden so yesterday's codes come straight from the streams
+		if (FAILED(GetRawDFWIValues(grid, layerThread, layerCache, yesterday, pt, interpolate_method, wx1.SpecifiedBits, &p, &p_valid)))
+			p_valid = false;
+	} else if (p_dfwi) {
+		p = *p_dfwi;
+		p_valid = true;
+	} else
+		p_valid = false;
+
+	if (!p_valid) {
+		bool valid;
+		return GetRawDFWIValues(grid, layerThread, layerCache, day, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx1.SpecifiedBits, t_dfwi, &valid);
+	}
+	if (!wx_valid)
+		return hr;
+
+	return calculateDailyCodes(grid, layerThread, layerCache, day, yesterday, pt, lat, lon, interpolate_method, &wx1, &p, t_dfwi);
+}
+
+
+HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, IFWIData *ifwi)
 {
 	HRESULT hr = S_OK;
 	bool wx_valid;
@@ -309,7 +462,7 @@ HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine,
 	}
 
 	if ((!(interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL))) || (!(interpolate_method & (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_CALCFWI)))) {
-		if (FAILED(hr = GetRawIFWIValues(gridEngine, layerThread, ttime, pt, interpolate_method, wx->SpecifiedBits, ifwi, &wx_valid)) || (!wx_valid))
+		if (FAILED(hr = GetRawIFWIValues(gridEngine, layerThread, layerCache, ttime, pt, interpolate_method, wx->SpecifiedBits, ifwi, &wx_valid)) || (!wx_valid))
 		{
 			weak_assert(false);
 		}
@@ -340,9 +493,9 @@ HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine,
 					lh0.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
 					WTime lh1(lh0);
 					lh1 += WTimeSpan(60 * 60);
-					if (FAILED(this->GetRawWxValues(gridEngine, layerThread, lh0, pt, interpolate_method, &wh0, &wx_valid)) || (!wx_valid))
+					if (FAILED(this->GetRawWxValues(gridEngine, layerThread, layerCache, lh0, pt, interpolate_method, &wh0, &wx_valid)) || (!wx_valid))
 						wh0.RH = wx->RH;
-					if (FAILED(this->GetRawWxValues(gridEngine, layerThread, lh1, pt, interpolate_method, &wh1, &wx_valid)) || (!wx_valid))
+					if (FAILED(this->GetRawWxValues(gridEngine, layerThread, layerCache, lh1, pt, interpolate_method, &wh1, &wx_valid)) || (!wx_valid))
 						wh1.RH = wx->RH;
 
 					WTime ld0(ttime);
@@ -350,7 +503,7 @@ HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine,
 					ld0 += WTimeSpan(0, 12, 0, 0);
 					DFWIData p_dfwi, t_dfwi;
 					// get yesterday's and today's spatially interpolated daily FWI starting codes
-					if (FAILED(hr = this->GetCalculatedDFWIValues(gridEngine, layerThread, ld0, pt, lat, lon, interpolate_method, wx, &t_dfwi, &p_dfwi)))
+					if (FAILED(hr = this->GetCalculatedDFWIValues(gridEngine, layerThread, layerCache, ld0, pt, lat, lon, interpolate_method, wx, &t_dfwi, &p_dfwi)))
 					{									// RWB: ***** above line - parameters for FWI stuff needed reversed
 						weak_assert(false);
 						return hr;
@@ -389,7 +542,7 @@ HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine,
 					if (prev_time == (ttime - WTimeSpan(0, 1, 0, 1)))
 					{
 						// no previous event!
-						if (FAILED(hr = GetRawIFWIValues(gridEngine, layerThread, ttime, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx->SpecifiedBits, ifwi, &wx_valid)) || (!wx_valid))
+						if (FAILED(hr = GetRawIFWIValues(gridEngine, layerThread, layerCache, ttime, pt, interpolate_method & (~(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY)), wx->SpecifiedBits, ifwi, &wx_valid)) || (!wx_valid))
 						{
 							weak_assert(false);
 							return hr;
@@ -399,7 +552,7 @@ HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine,
 					{
 						weak_assert((ttime - prev_time) <= WTimeSpan(60 * 60));
 						HSS_Time::WTimeSpan duration = ttime - prev_time;
-						if (FAILED(hr = GetRawIFWIValues(gridEngine, layerThread, prev_time, pt, interpolate_method, wx->SpecifiedBits, ifwi, &wx_valid)) || (!wx_valid))
+						if (FAILED(hr = GetRawIFWIValues(gridEngine, layerThread, layerCache, prev_time, pt, interpolate_method, wx->SpecifiedBits, ifwi, &wx_valid)) || (!wx_valid))
 						{
 							weak_assert(false);
 							return hr;
@@ -430,7 +583,7 @@ HRESULT WeatherUtilities::GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine,
 
 	// get todays daily FWI starting codes
 	DFWIData t_dfwi = {0};
-	if (FAILED(hr = GetCalculatedDFWIValues(gridEngine, layerThread, ttime, pt, lat, lon, interpolate_method, wx, &t_dfwi)))
+	if (FAILED(hr = GetCalculatedDFWIValues(gridEngine, layerThread, layerCache, ttime, pt, lat, lon, interpolate_method, wx, &t_dfwi)))
 	{
 		weak_assert(false);
 		return hr;
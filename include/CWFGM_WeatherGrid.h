@@ -24,26 +24,135 @@
 #include "semaphore.h"
 #include "FireEngine_ext.h"
 #include "WeatherUtilities.h"
+#include "WeatherDiskCache.h"
 #include "valuecache_mt.h"
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cfloat>
 
 #include "FwiCom.h"
+#include "vectors.h"
 #include "CWFGM_WeatherStream.h"
 
 #ifdef HSS_SHOULD_PRAGMA_PACK
 #pragma pack(push, 8)
 #endif
 
+
+#define CWFGM_WEATHER_EXPORT_TEMPERATURE	0
+#define CWFGM_WEATHER_EXPORT_DEWPOINT		1
+#define CWFGM_WEATHER_EXPORT_RH			2
+#define CWFGM_WEATHER_EXPORT_PRECIPITATION	3
+#define CWFGM_WEATHER_EXPORT_WINDSPEED		4
+#define CWFGM_WEATHER_EXPORT_WINDDIRECTION	5
+#define CWFGM_WEATHER_EXPORT_WINDGUST		6
+#define CWFGM_WEATHER_EXPORT_FFMC		7	// hourly FFMC
+#define CWFGM_WEATHER_EXPORT_ISI		8	// hourly ISI
+#define CWFGM_WEATHER_EXPORT_FWI		9	// hourly FWI
+#define CWFGM_WEATHER_EXPORT_DMC		10
+#define CWFGM_WEATHER_EXPORT_DC			11
+#define CWFGM_WEATHER_EXPORT_BUI		12
+#define CWFGM_WEATHER_EXPORT_VARIABLES		13
+
 #ifndef DOXYGEN_IGNORE_CODE
 
+struct WeatherBatchQuery {
+	XY_Point pt;
+	HSS_Time::WTime time;
+	std::uint64_t interpolate_method;
+};
+
+
+struct WeatherBatchResult {
+	HRESULT hr;
+	IWXData wx;
+	IFWIData ifwi;
+	DFWIData dfwi;
+	bool wx_valid;
+};
+
+
+struct GStreamWxData {
+	HRESULT hr;
+	IWXData wx;		// station weather, with temperature and dew point temperature reduced to sea level
+	double UALR, SALR;	// unsaturated and saturated adiabatic lapse rates at the station
+	double ws_u, ws_v;	// wind speed and gust decomposed along the wind direction, for vector interpolation
+	double gust_u, gust_v;
+};
+
+
+struct GStationSums {
+	double wx__UALR = 0.0, wx__SALR = 0.0;
+	double wx_WindSpeed = 0.0, wx_WindGust = 0.0;
+	double weight_temp = 0.0, weight_ws = 0.0, weight_gust = 0.0, weight_precip = 0.0;	// the cumulative weights for each value
+	XY_Vector wind_vector = XY_Vector(0.0, 0.0), gust_vector = XY_Vector(0.0, 0.0);
+	std::uint32_t wind_cnt = 0, gust_cnt = 0;
+	double nearest_d = DBL_MAX;		// the distance to the active weather station nearest this point
+	double nearest_precip = 0.0;		// values at the active weather station nearest this point
+	double nearest_wd = 0.0, nearest_ws = 0.0, nearest_gust = 0.0;
+};
+
+
+struct GLatticeValues {
+	double temperature, dewPointTemperature;	// IDW normalized, at sea level
+	double UALR, SALR;
+	double ws, gust;
+	double wind_u, wind_v, gust_u, gust_v;
+	double precipitation;
+	std::uint32_t wind_cnt, gust_cnt;
+};
+
+
+struct GLatticeBlock {
+	bool refined;				// upsampling missed the tolerance in this block so its cells are calculated directly
+	GLatticeValues corner[4];		// lattice nodes at the block's corners
+};
+
+
+struct GLatticeSet {
+	std::uint64_t time;			// microseconds, always a whole hour
+	std::uint64_t interpolate_method;
+	std::uint64_t generation;		// CCWFGM_WeatherGrid::streamGeneration() when the set was handed to this hour
+	std::atomic<GLatticeBlock *> *blocks;	// one per lattice block, filled in on first use
+};
+
+
+struct GEventTimeline {
+	std::vector<std::uint64_t> forward, backward;			// event times (microseconds) from all streams, as each stream reports them searching in each direction
+	std::vector<std::uint64_t> primaryForward, primaryBackward;	// same, for just the primary stream
+	std::uint64_t start, end;					// [start, end) is the range of time that every stream covers
+	std::uint64_t primaryStart, primaryEnd;
+	std::uint64_t generation;					// CCWFGM_WeatherGrid::streamGeneration() when built
+};
+
+
 class GStreamNode : public MinNode {
     public:
+	GStreamNode() : m_wxCache(32), m_rainCache(64) { m_generation = m_primaryGeneration = (std::uint32_t)-1; m_primary = nullptr; }
+
 	XY_Point m_location; // location of the weatherstation containing this stream, expressed in grid units
 	double m_elevation; // elevation of the weatherstation containing this stream
 	double m_Pe;		// atmospheric pressure at the station
 	boost::intrusive_ptr<CCWFGM_WeatherStream> m_stream;
 
+	HRESULT GetStationValues(const HSS_Time::WTime &time, std::uint64_t interpolate_method, GStreamWxData *data);
+	HRESULT GetStationDailyRain(const HSS_Time::WTime &todayStart, std::uint64_t interpolate_method, CCWFGM_WeatherStream *primary, double *rain);
+	void ClearStationValues();
+
 	DECLARE_OBJECT_CACHE_MT(GStreamNode, GStreamNode);
+
+    private:
+	CThreadSemaphore m_wxLock;
+	ValueCacheTempl<WeatherKeyBase, GStreamWxData> m_wxCache;	// station-only terms (everything that doesn't depend on the grid cell), per time
+	ValueCacheTempl<WeatherKeyBase, double> m_rainCache;		// rain totals for the 23 hours before the start of each FWI day
+	std::uint32_t m_generation;					// m_stream's CacheGeneration() when the caches were last valid
+	CCWFGM_WeatherStream *m_primary;				// primary stream, and its CacheGeneration(), m_rainCache was calculated against
+	std::uint32_t m_primaryGeneration;
+
+	void checkGeneration();
 };
 
 #endif
@@ -115,6 +224,13 @@ public:
 		\retval	ERROR_WEATHER_STREAM_UNKNOWN	The index is out of range.
 	*/
 	virtual NO_THROW HRESULT IndexOfStream(CCWFGM_WeatherStream *stream, std::uint32_t *index);
+	/**
+		Returns every pair of weather streams whose stations were found to be within 100m of each other the last time Valid() was called.
+		\param	pairs	Indices (as used by StreamAtIndex()) of each pair of streams that are too close, lower index first.
+		\retval	E_POINTER	The address provided for pairs is invalid.
+		\retval	S_OK	Successful.
+	*/
+	virtual NO_THROW HRESULT GetTooCloseStreams(std::vector<std::pair<std::uint32_t, std::uint32_t>> *pairs);
 	/**
 		Polymorphic.  This routine retrieves an attribute/option value given the attribute/option index.
 		\param option	The attribute of interest.  Valid attributes are:
@@ -123,6 +239,11 @@ public:
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_WS</code> 64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND</code> and/or <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR</code> is set.  IDW power for interpolating WS values.
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_PRECIP</code>  64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP</code> is set.  IDW power for interpolating precip values.
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_FWI</code>  64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> is set.  IDW power for interpolating FWI values.
+		<li><code>CWFGM_WEATHER_OPTION_HOURLY_BLEND</code> Boolean.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> and <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL</code> are set.  Sub-hour values are blended from spatially interpolated values at the bracketing hours rather than spatially interpolating temporally interpolated station values.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_SPACING</code> 64-bit floating point, a whole number of grid cells.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> is set.  When greater than 1, stations are interpolated on a lattice this many cells apart and bilinearly upsampled to each cell, for whole hours only.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code> 64-bit floating point.  Largest difference (C) in temperature and dew point allowed between the upsampled and the directly interpolated values at the center and edge midpoints of a lattice block, any block that misses (or holds a station) is calculated per cell.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_WIND</code> 64-bit floating point.  As <code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code>, for wind speed, gust, and their vector components (km/h).
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_PRECIP</code> 64-bit floating point.  As <code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code>, for precipitation (mm).
 		<li><code>CWFGM_WEATHER_OPTION_FFMC_VANWAGNER</code>		Boolean.  Use the Van Wagner approach to calculating HFFMC values
 		<li><code>CWFGM_WEATHER_OPTION_FFMC_LAWSON</code>		Boolean.  Use the Lawson approach to calculating HFFMC values
 		</ul>
@@ -184,6 +305,11 @@ public:
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_WS</code> 64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND</code> and/or <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR</code> is set.  IDW power for interpolating WS values.
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_PRECIP</code>  64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP</code> is set.  IDW power for interpolating precip values.
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_FWI</code>  64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> is set.  IDW power for interpolating FWI values.
+		<li><code>CWFGM_WEATHER_OPTION_HOURLY_BLEND</code> Boolean.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> and <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL</code> are set.  Sub-hour values are blended from spatially interpolated values at the bracketing hours rather than spatially interpolating temporally interpolated station values.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_SPACING</code> 64-bit floating point, a whole number of grid cells.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> is set.  When greater than 1, stations are interpolated on a lattice this many cells apart and bilinearly upsampled to each cell, for whole hours only.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code> 64-bit floating point.  Largest difference (C) in temperature and dew point allowed between the upsampled and the directly interpolated values at the center and edge midpoints of a lattice block, any block that misses (or holds a station) is calculated per cell.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_WIND</code> 64-bit floating point.  As <code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code>, for wind speed, gust, and their vector components (km/h).
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_PRECIP</code> 64-bit floating point.  As <code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code>, for precipitation (mm).
 		<li><code>CWFGM_WEATHER_OPTION_FFMC_VANWAGNER</code>		Boolean.  Use the Van Wagner approach to calculating HFFMC values
 		<li><code>CWFGM_WEATHER_OPTION_FFMC_LAWSON</code>		Boolean.  Use the Lawson approach to calculating HFFMC values
 		</ul>
@@ -202,6 +328,11 @@ public:
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_WS</code> 64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND</code> and/or <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR</code> is set.  IDW power for interpolating WS values.
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_PRECIP</code>  64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP</code> is set.  IDW power for interpolating precip values.
 		<li><code>CWFGM_WEATHER_OPTION_IDW_EXPONENT_FWI</code>  64-bit floating point.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> is set.  IDW power for interpolating FWI values.
+		<li><code>CWFGM_WEATHER_OPTION_HOURLY_BLEND</code> Boolean.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> and <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL</code> are set.  Sub-hour values are blended from spatially interpolated values at the bracketing hours rather than spatially interpolating temporally interpolated station values.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_SPACING</code> 64-bit floating point, a whole number of grid cells.  Used when <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL</code> is set.  When greater than 1, stations are interpolated on a lattice this many cells apart and bilinearly upsampled to each cell, for whole hours only.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code> 64-bit floating point.  Largest difference (C) in temperature and dew point allowed between the upsampled and the directly interpolated values at the center and edge midpoints of a lattice block, any block that misses (or holds a station) is calculated per cell.
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_WIND</code> 64-bit floating point.  As <code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code>, for wind speed, gust, and their vector components (km/h).
+		<li><code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_PRECIP</code> 64-bit floating point.  As <code>CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE</code>, for precipitation (mm).
 		</ul>
 		\param	value	The value to set the option to.
 		\retval	S_OK	Successful.
@@ -272,6 +403,53 @@ public:
 	*/
 	virtual NO_THROW HRESULT GetWeatherDataArray( Layer *layerThread, const XY_Point &min_pt, const XY_Point &max_pt, double scale,const HSS_Time::WTime &time, std::uint64_t interpolate_method, 
 	    IWXData_2d *wx, IFWIData_2d *ifwi, DFWIData_2d *dfwi, bool_2d *wx_valid) override;
+	/**
+		Structure-of-arrays alternative to GetWeatherDataArray().  Only the requested variables are returned, each in its own contiguous plane, and when only weather variables are
+		requested the FWI calculations are skipped entirely.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	min_pt		Minimum value (inclusive).
+		\param	max_pt		Maximum value (inclusive).
+		\param	scale		Scale (meters) that the array is defined for
+		\param	time	A GMT time.
+		\param	interpolate_method		Interpolation method identifier, as for GetWeatherDataArray().
+		\param	variables	CWFGM_WEATHER_EXPORT_* values to return, in the units described for ExportRasters().
+		\param	planes		Resized to hold one plane per entry in 'variables', in the same order.  Each plane is (x_max - x_min + 1) * (y_max - y_min + 1) values, indexed by
+					(y - y_min) * (x_max - x_min + 1) + (x - x_min).  Cells without valid weather are set to -9999.
+		\retval	E_POINTER	planes is NULL.
+		\retval	E_INVALIDARG	An unknown variable, or min_pt is greater than max_pt.
+		\retval	ERROR_GRID_LOCATION_OUT_OF_RANGE	The requested area is outside the grid.
+		\retval	S_OK	Successful.
+	*/
+	virtual NO_THROW HRESULT GetWeatherDataPlanes(Layer *layerThread, const XY_Point &min_pt, const XY_Point &max_pt, double scale, const HSS_Time::WTime &time, std::uint64_t interpolate_method,
+	    const std::vector<std::uint16_t> &variables, std::vector<double> *planes);
+	/**
+		Calculates weather for a list of point/time queries, as GetWeatherData() would for each one.  The queries are run in order of time, then interpolation method, then
+		by grid cell along a Morton (Z-order) curve, so queries sharing a time and neighbouring cells hit the same cache entries; results are returned in the order the queries were given.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	queries		Location, GMT time and interpolation method identifier (see GetWeatherData()) for each query.
+		\param	results		Resized to match queries, each entry is filled with the result of the query at the same index.
+		\retval E_POINTER	results is NULL.
+		\retval S_OK		Every query succeeded, otherwise the failure code of the first (by index) query that failed.
+	*/
+	virtual NO_THROW HRESULT GetWeatherDataBatch(Layer *layerThread, const std::vector<WeatherBatchQuery> &queries, std::vector<WeatherBatchResult> *results);
+	/**
+		Exports hourly rasters of interpolated weather and FWI values over the whole grid, one file per variable per hour, for every hour from 'start_time' to 'end_time' inclusive.
+		Each hour is calculated as GetWeatherDataArray() would, and the next hour is calculated while the current hour's files are written.  Files are named
+		<code>&lt;file_prefix&gt;_&lt;variable&gt;_&lt;YYYYMMDDHH&gt;.tif</code> using local standard time (no daylight savings, so every hour has its own name), where the variable is one of temp, dewpt, rh, precip, ws, wd, gust, ffmc, isi, fwi, dmc, dc, bui.
+		RH is written in percent and wind direction in compass degrees, cells without valid weather are written as -9999.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	start_time	GMT time of the first hour to export.
+		\param	end_time	GMT time of the last hour to export.
+		\param	interpolate_method		Interpolation method identifier, as for GetWeatherData().
+		\param	variables	CWFGM_WEATHER_EXPORT_* values to export.
+		\param	file_prefix	Path and file name prefix for the exported files.
+		\retval	S_OK	Successful.
+		\retval	E_INVALIDARG	No variables, an unknown variable, an empty file prefix, or 'end_time' is before 'start_time'.
+		\retval	E_ACCESSDENIED	A file could not be written.
+		\retval	E_FAIL	GDAL failed to write a file for some other reason.
+		\retval	ERROR_GRID_UNINITIALIZED	No object in the grid layering to forward the request to.
+	*/
+	virtual NO_THROW HRESULT ExportRasters(Layer *layerThread, const HSS_Time::WTime &start_time, const HSS_Time::WTime &end_time, std::uint64_t interpolate_method, const std::vector<std::uint16_t> &variables, const std::string &file_prefix);
 	/**
 		This method will query all valid, associated weather streams for the next time at which a specified weather event (recorded change in weather data) occurs.
 		This filter object it will then forward the call to the next lower GIS layer determined by layerThread and combine results.
@@ -347,6 +525,28 @@ protected:
 	double				m_idwExponentWS;
 	double				m_idwExponentPrecip;
 	std::uint16_t		m_xsize, m_ysize;
+	std::atomic<float *>		*m_elevationTiles;	// elevation for grid cells by tile, filled in on first use, NaN where the grid can't provide it
+	std::uint16_t			m_elevationXTiles;
+	size_t				m_elevationTileCount;
+	CRWThreadSemaphore		m_elevationLock;	// shared to look up and fill in tiles, exclusive to drop them
+	std::shared_ptr<GEventTimeline>	m_timeline;		// merged event times for all streams, built at the start of a simulation, only read through a copy taken under m_timelineLock
+	CThreadSemaphore		m_timelineLock;
+	bool				m_hourlyBlend;		// whether sub-hour queries are blended from cached hourly station weather
+	std::uint16_t			m_latticeSpacing;	// in grid cells, 0 or 1 to interpolate at every cell
+	double				m_latticeTolerance;	// C
+	double				m_latticeToleranceWind;	// km/h
+	double				m_latticeTolerancePrecip;	// mm
+	GLatticeSet			*m_lattice;		// LATTICE_SETS of them, picked by the hour, allocated on first use
+	std::uint32_t			m_latticeBlocks;	// blocks in each set
+	CRWThreadSemaphore		m_latticeLock;		// shared to look up and fill in blocks, exclusive to hand a set to another hour or drop them
+	std::uint16_t			m_cacheEviction;	// eviction policy for caches created by SetCache()
+	std::uint64_t			m_cacheBudget;		// bytes for each cache created by SetCache() (cells, tiles, daily FWI state, and for the first, the elevation cache and lattice), 0 for the built-in sizes
+	bool				m_cacheStats;		// whether caches created by SetCache() keep statistics
+	std::string			m_diskCachePath;	// directory for the disk cache, empty if it's turned off, only changed with m_diskLock exclusive
+	std::atomic<WeatherDiskCache *>	m_diskCache;		// opened on first use, closed whenever anything it hashes may change
+	CRWThreadSemaphore		m_diskLock;		// shared to open and use the disk cache, exclusive to close it
+	CThreadSemaphore		m_diskOpenLock;		// so only one thread opens the disk cache
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> m_tooClose;	// stream pairs found too close together by Valid()
 
 	std::uint16_t convertX(double x, XY_Rectangle *bbox);
 	std::uint16_t convertY(double y, XY_Rectangle *bbox);
@@ -355,11 +555,45 @@ protected:
 	double revertX(double x);
 	double revertY(double y);
 	HRESULT fixResolution();
+	void clearStationValues();
+	void buildElevationCache();
+	void clearElevationCache();
+	std::uint64_t elevationCacheBytes() const;
+	float *elevationTile(std::uint16_t x, std::uint16_t y);
+	HRESULT getElevation(const XY_Point &pt, std::uint16_t x, std::uint16_t y, double *elev, bool *elev_valid);
+	void buildEventTimeline();
+	void clearEventTimeline();
+	std::uint64_t streamGeneration();
+	bool timelineEventTime(std::uint32_t flags, const HSS_Time::WTime &from_time, HSS_Time::WTime *next_event);
+	HRESULT stationWx(const HSS_Time::WTime &time, const XY_Point &pt, std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, bool use_cache, IWXData *wx, bool *wx_valid);
+	HRESULT hourlyStationWx(Layer *layerThread, WeatherLayerCache *layerCache, std::uint16_t alternate, const HSS_Time::WTime &hour, std::uint16_t x, std::uint16_t y, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid);
+	HRESULT nearestStation(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, GStationSums *sums);
+	HRESULT latticeNode(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t kernel, GLatticeValues *lv);
+	HRESULT latticeBlock(const HSS_Time::WTime &time, std::uint16_t bx, std::uint16_t by, std::uint64_t interpolate_method, std::uint32_t kernel, GLatticeBlock *block);
+	HRESULT latticeSums(const HSS_Time::WTime &time, const XY_Point &pt, std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, std::uint32_t kernel, IWXData *wx, GStationSums *sums);
+	void clearLattice();
+	void claimLatticeSet(std::uint32_t slot, std::uint64_t time, std::uint64_t interpolate_method, std::uint64_t generation);
+	std::uint64_t latticeCacheBytes() const;
+	std::string cacheStatsReport(Layer *layerThread);
+	WeatherDiskCache *diskCache();
+	std::uint64_t diskContentHash(const HSS_Time::WTime &time, std::uint64_t interpolate_method);
+	void clearDiskCache();
+	HRESULT exportFrame(Layer *layerThread, const HSS_Time::WTime &time, std::uint64_t interpolate_method, const std::vector<std::uint16_t> &variables, std::vector<double> *planes);
+	HRESULT writeFrame(const HSS_Time::WTime &time, const std::vector<std::uint16_t> &variables, const std::vector<double> &planes, const std::string &file_prefix);
+
+	typedef HRESULT (CCWFGM_WeatherGrid::*StationKernel)(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums);
+	static const StationKernel m_stationKernels[16];		// indexed by the TEMP_RH, WIND, WIND_VECTOR, PRECIP interpolation bits
+	template<bool TEMP_RH, bool WIND, bool WIND_VECTOR, bool PRECIP>
+	HRESULT accumulateStations(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums);
+	HRESULT accumulateStationsGeneric(const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums);
+
+	friend class WeatherGridTest;						// tests/ reaches the kernels and caches through this
 
 private:
-	virtual HRESULT GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid);
-	virtual HRESULT GetRawIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, IFWIData *ifwi, bool *wx_valid);
-	virtual HRESULT GetRawDFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *dfwi, bool *wx_valid);
+	virtual HRESULT GetRawWxValues(ICWFGM_GridEngine *grid, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid);
+	virtual HRESULT GetRawIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, IFWIData *ifwi, bool *wx_valid);
+	virtual HRESULT GetRawDFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *dfwi, bool *wx_valid);
+	virtual HRESULT GetRawDailyRain(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &todayStart, const HSS_Time::WTime &yesterday, const XY_Point &pt, std::uint64_t interpolate_method, const IWXData *wx1, double *rain);
 #endif
 };
 
@@ -0,0 +1,266 @@
+/**
+ * WISE_Weather_Module: CWFGM_WeatherRasterGrid.h
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "WeatherCOM.h"
+#include "WeatherCom_ext.h"
+#include "WTime.h"
+#include "ICWFGM_GridEngine.h"
+#include "semaphore.h"
+
+#include <vector>
+#include <string>
+
+using namespace HSS_Time;
+
+#ifdef HSS_SHOULD_PRAGMA_PACK
+#pragma pack(push, 8)
+#endif
+
+
+#define CWFGM_WEATHER_RASTER_TEMPERATURE	0	// Celsius
+#define CWFGM_WEATHER_RASTER_RH			1	// percent, 0..100
+#define CWFGM_WEATHER_RASTER_PRECIPITATION	2	// mm, accumulated since the previous precipitation raster
+#define CWFGM_WEATHER_RASTER_WINDSPEED		3	// kph
+#define CWFGM_WEATHER_RASTER_WINDDIRECTION	4	// compass degrees
+#define CWFGM_WEATHER_RASTER_WINDGUST		5	// kph
+#define CWFGM_WEATHER_RASTER_VARIABLES		6
+
+#ifndef DOXYGEN_IGNORE_CODE
+// One point in the time series.  Each variable is stored as a fixed point 16-bit raster (see raster_scale) rather than as doubles,
+// no data cells hold RASTER_NODATA so no separate validity array is needed.
+struct raster_frame
+{
+	raster_frame(const WTime &t) : m_time(t) { for (std::uint16_t i = 0; i < CWFGM_WEATHER_RASTER_VARIABLES; i++) m_data[i] = nullptr; }
+	raster_frame(const raster_frame &toCopy, std::uint32_t cnt);
+	~raster_frame() { for (std::uint16_t i = 0; i < CWFGM_WEATHER_RASTER_VARIABLES; i++) if (m_data[i]) delete [] m_data[i]; }
+	bool Empty() const { for (std::uint16_t i = 0; i < CWFGM_WEATHER_RASTER_VARIABLES; i++) if (m_data[i]) return false; return true; }
+
+	WTime m_time;
+	std::int16_t *m_data[CWFGM_WEATHER_RASTER_VARIABLES];
+	std::string m_filename[CWFGM_WEATHER_RASTER_VARIABLES];
+};
+#endif
+
+/**
+	This object provides gridded weather from a time series of rasters (for example, output from a numerical weather model), in place of weather interpolated from weather stations.
+	It is placed in the grid layering alongside the wind speed and wind direction grids, and replaces temperature, relative humidity, precipitation, wind speed, wind direction, and wind gust
+	by direct lookup of the cell containing the requested location.  Between rasters, values are linearly interpolated in time (wind direction along the shortest arc) when temporal interpolation
+	is requested.  Precipitation rasters are the accumulation over the period since the previous precipitation raster (or the hour, for the first one), must be a whole number of hours apart,
+	and are spread evenly over that period to give the hourly amounts the rest of the weather module works in.  Any variable with no raster, and any time outside of the series, is left unchanged. \n\n
+	Overridden values are flagged in the weather data, and S_OK is returned in place of the lower layer's E_NOTIMPL, so the weather grid recalculates FWI values from them (using the starting
+	codes of the weather stream(s)) and totals daily precipitation hour by hour through this layer.  The weather grid still interpolates its stations before this layer overrides the result,
+	so that work isn't saved by adding rasters. \n\n Rasters must match the dimensions, resolution, and location of the associated grid.
+*/
+class WEATHERCOM_API CCWFGM_WeatherRasterGrid : public ICWFGM_GridEngine {
+
+public:
+#ifndef DOXYGEN_IGNORE_CODE
+	CCWFGM_WeatherRasterGrid();
+	CCWFGM_WeatherRasterGrid(const CCWFGM_WeatherRasterGrid &toCopy);
+	~CCWFGM_WeatherRasterGrid();
+
+#endif
+	/**
+		Creates a new weather raster grid with all the same properties and data of the object being called, returns a handle to the new object in 'newObject'.
+		No data is shared between these two objects, an exact copy (including all loaded rasters) is created.
+		\param	newObject	A weather raster grid object.
+		\retval	E_POINTER	The address provided for "newObject" is invalid.
+		\retval	S_OK	Successful.
+		\retval	E_FAIL	Insufficient memory.
+	*/
+	virtual NO_THROW HRESULT Clone(boost::intrusive_ptr<ICWFGM_CommonBase> *newObject) const;
+	/**
+		Imports a raster for one weather variable at one time.  Any raster previously loaded for the same variable and time is replaced.  If the raster has a projection, it must match
+		the projection of the associated ICWFGM_GridEngine object.
+		\param	time	A GMT time, the time the raster's values are valid for.
+		\param	variable	One of the CWFGM_WEATHER_RASTER_* values.
+		\param	grid_file_name	Grid file name, any raster format supported by GDAL.
+		\retval	S_OK	Successful.
+		\retval	E_INVALIDARG	Unknown variable, no file name, or a precipitation raster that isn't a whole number of hours from the precipitation rasters before and after it.
+		\retval	E_FAIL	The file could not be read, or contains an unsupported data type.
+		\retval	E_OUTOFMEMORY	Insufficient memory.
+		\retval	ERROR_GRID_SIZE_INCORRECT	Incorrect grid size.
+		\retval	ERROR_GRID_UNSUPPORTED_RESOLUTION	Resolution doesn't match the associated grid.
+		\retval	ERROR_GRID_LOCATION_OUT_OF_RANGE	Location or projection doesn't match the associated grid.
+		\retval	ERROR_GRID_UNINITIALIZED	Grid uninitialized.
+		\retval	ERROR_SCENARIO_SIMULATION_RUNNING	Scenario simulation running.
+		\retval	ERROR_INVALID_DATA | ERROR_SEVERITY_WARNING	A value is out of range for the variable.
+	*/
+	virtual NO_THROW HRESULT Import(const HSS_Time::WTime &time, const std::uint16_t variable, const std::string &grid_file_name);
+	/**
+		Removes a loaded raster.
+		\param	time	A GMT time.
+		\param	variable	One of the CWFGM_WEATHER_RASTER_* values, or (std::uint16_t)-1 to remove all rasters for 'time'.
+		\retval	S_OK	Successful.
+		\retval	E_INVALIDARG	Unknown variable.
+		\retval	ERROR_GRID_TIME_OUT_OF_RANGE	No raster is loaded for 'time'.
+		\retval	ERROR_SCENARIO_SIMULATION_RUNNING	Scenario simulation running.
+	*/
+	virtual NO_THROW HRESULT Remove(const HSS_Time::WTime &time, const std::uint16_t variable);
+	/**
+		Returns the times that rasters are loaded for, in ascending order.
+		\param	times	Loaded times.
+		\retval	S_OK	Successful.
+		\retval	E_POINTER	Invalid pointer.
+	*/
+	virtual NO_THROW HRESULT GetTimes(std::vector<HSS_Time::WTime> *times);
+	/**
+		Polymorphic.  This routine retrieves an attribute/option value given the attribute/option index.
+		\param option	The attribute of interest.  Valid attributes are:
+		<ul>
+		<li><code>CWFGM_WEATHER_OPTION_START_TIME</code>	64-bit unsigned integer.  GMT time provided as seconds since Midnight January 1, 1600.  Time of the first loaded raster.
+		<li><code>CWFGM_WEATHER_OPTION_END_TIME</code>		64-bit unsigned integer.  GMT time provided as seconds since Midnight January 1, 1600.  Time of the last loaded raster.
+		<li><code>CWFGM_ATTRIBUTE_LOAD_WARNING</code>	BSTR.  Any warnings generated by the COM object when deserializating.
+		</ul>
+		\param value	Location for the retrieved value to be placed.
+		\retval E_POINTER	value is NULL
+		\retval E_INVALIDARG	unknown requested option
+		\retval S_OK Success
+	*/
+	virtual NO_THROW HRESULT GetAttribute(std::uint16_t option, PolymorphicAttribute *value);
+	/**
+		Sets the value of an "option" to the value of the "value" variable provided.  This object currently has no settable options; its times are determined by the loaded rasters.
+		\param	option	The weather option of interest.
+		\param	value	Value of attribute
+		\retval	E_INVALIDARG	Invalid argument
+		\retval	ERROR_SCENARIO_SIMULATION_RUNNING	Scenario simulation running.
+	*/
+	virtual NO_THROW HRESULT SetAttribute(std::uint16_t option, const PolymorphicAttribute &value);
+
+	/**
+		Changes the state of the object with respect to access rights.  When the object is used by an active simulation, it must not be modified.
+		When the object is somehow modified, it must be done so in an atomic action to prevent concerns with arising from multithreading.
+		Locking request is forwarded to the next lower object in the 'layerThread' layering.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	exclusive	true if the requester wants a write lock, false for read/shared access
+		\param	obtain	true to obtain the lock, false to release the lock.  If this is false, then the 'exclusive' parameter must match the initial call used to obtain the lock.
+		\sa ICWFGM_GridEngine::MT_Lock
+		\retval	SUCCESS_STATE_OBJECT_UNLOCKED	Lock was released.
+		\retval	SUCCESS_STATE_OBJECT_LOCKED_WRITE	Exclusive/write lock obtained.
+		\retval	SUCCESS_STATE_OBJECT_LOCKED_SCENARIO	A scenario successfully required a lock for purposes of simulating.
+		\retval	SUCCESS_STATE_OBJECT_LOCKED_READ	Shared/read lock obtained.
+		\retval	S_OK	Successful
+		\retval	ERROR_GRID_UNINITIALIZED	No path via layerThread can be determined to further determine successful locks.
+	*/
+	virtual NO_THROW HRESULT MT_Lock(Layer *layerThread, bool exclusive, std::uint16_t obtain) override;
+	/**
+		Forwards the call to the next lower GIS layer determined by layerThread.  For the <code>CWFGM_WEATHER_WXGRID_WS_DIURNALTIMES</code> and <code>CWFGM_WEATHER_WXGRID_WD_DIURNALTIMES</code>
+		options, the application count is incremented for every second covered by wind speed or wind direction rasters, respectively.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	start_time	Start time of grid data
+		\param	duration	Duration of observational data in grid
+		\param option	Determines type of Valid request.
+		\param application_count	Optional (dependent on option).  Array of counts for how often a particular type of grid occurs in the set of ICWFGM_GridEngine objects associated with a scenario.
+		\sa ICWFGM_GridEngine::Valid
+		\retval S_OK		Successful.
+		\retval	ERROR_GRID_UNINITIALIZED	No object in the grid layering to forward the request to.
+	*/
+	virtual NO_THROW HRESULT Valid(Layer *layerThread, const HSS_Time::WTime &start_time, const HSS_Time::WTimeSpan &duration, std::uint32_t option, std::vector<uint16_t> *application_count) override;
+	/**
+		Polymorphic.  If layerThread is non-zero, then this object simply forwards the call to the next lower GIS
+		layer determined by layerThread.  If layerthread is zero, then this object will interpret the call.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param option	The attribute of interest.  Refer to GetAttribute(std::uint16_t, PolymorphicAttribute *).
+		\param value	Location for the retrieved value to be placed.
+		\sa ICWFGM_GridEngine::GetAttribute
+		\retval E_POINTER	value is NULL
+		\retval	ERROR_GRID_UNINITIALIZED	No object in the grid layering to forward the request to.
+		\retval S_OK Success
+	*/
+	virtual NO_THROW HRESULT GetAttribute(Layer *layerThread, std::uint16_t option, PolymorphicAttribute *value) override;
+	/**
+		Retrieves weather from the next lower GIS layer, then replaces any values which are provided by loaded rasters at location 'pt' and time 'time'.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	pt			Location.
+		\param	time	A GMT time.
+		\param	interpolate_method		Interpolation method identifier.  When <code>CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL</code> is set, values are interpolated between rasters,
+					otherwise the raster at or before 'time' is used.
+		\param	wx			Weather information.
+		\param	ifwi		IFWI Information.
+		\param	dfwi		DFWI Information.
+		\param	wx_valid	Whether the weather information is valid.
+		\param	bbox_cache	Optional, returns the cell containing 'pt'.
+		\sa ICWFGM_GridEngine::GetWeatherData
+		\retval ERROR_GRID_UNINITIALIZED	No object in the grid layering to forward the request to.
+		\retval S_OK					Calculations are successful
+	*/
+	virtual NO_THROW HRESULT GetWeatherData(Layer *layerThread, const XY_Point &pt, const HSS_Time::WTime &time, std::uint64_t interpolate_method, IWXData *wx, IFWIData *ifwi, DFWIData *dfwi, bool *wx_valid, XY_Rectangle *bbox_cache) override;
+	/**
+		Array version of GetWeatherData.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	min_pt		Minimum value (inclusive).
+		\param	max_pt		Maximum value (inclusive).
+		\param	scale		Scale (meters) that the array is defined for
+		\param	time	A GMT time.
+		\param	interpolate_method		Interpolation method identifier.
+		\param	wx		Array of Weather information.
+		\param	ifwi		Array of Instantaneous FWI codes.
+		\param	dfwi		Array of Daily FWI codes.
+		\param	wx_valid	Array of validity flags.
+		\sa ICWFGM_GridEngine::GetWeatherDataArray
+		\retval	ERROR_GRID_UNINITIALIZED	No object in the grid layering to forward the request to.
+		\retval	ERROR_GRID_UNSUPPORTED_RESOLUTION	'scale' doesn't match the grid's resolution.
+		\retval E_INVALIDARG	The array is not 2D, or is insufficient in size to contain the requested data
+	*/
+	virtual NO_THROW HRESULT GetWeatherDataArray(Layer *layerThread, const XY_Point &min_pt,const XY_Point &max_pt, double scale,const HSS_Time::WTime &time, std::uint64_t interpolate_method,
+			IWXData_2d *wx, IFWIData_2d *ifwi, DFWIData_2d *dfwi, bool_2d *wx_valid) override;
+	/**
+		Forwards the call to the next lower GIS layer determined by layerThread, and combines the result with the times of the loaded rasters.
+		\param	layerThread		Handle for scenario layering/stack access, allocated from an ICWFGM_LayerManager COM object.  Needed.  It is designed to allow nested layering analogous to the GIS layers.
+		\param	pt		Location.
+		\param	flags	Calculation flags.  Refer to ICWFGM_GridEngine::GetEventTime.
+		\param	from_time	A GMT time provided as seconds since January 1st, 1600.
+		\param	next_event	A GMT time provided as seconds since January 1st, 1600, representing the time for the next event, based on 'flags'.
+		\param	event_valid	Whether 'next_event' is valid.
+		\sa ICWFGM_GridEngine::GetEventTime
+		\retval	ERROR_GRID_UNINITIALIZED	No object in the grid layering to forward the request to.
+	*/
+	virtual NO_THROW HRESULT GetEventTime(Layer *layerThread, const XY_Point& pt, std::uint32_t flags, const HSS_Time::WTime &from_time,  HSS_Time::WTime *next_event, bool* event_valid) override;
+	virtual NO_THROW HRESULT PutGridEngine(Layer *layerThread, ICWFGM_GridEngine * newVal) override;
+	virtual NO_THROW HRESULT PutCommonData(Layer* layerThread, ICWFGM_CommonData* pVal) override;
+
+#ifndef DOXYGEN_IGNORE_CODE
+	protected:
+		WTimeManager				*m_timeManager;
+		CRWThreadSemaphore			m_lock;
+		std::vector<raster_frame *>		m_frames;			// sorted by time
+
+		std::uint16_t				m_xsize, m_ysize;
+		double						m_resolution, m_xllcorner, m_yllcorner;
+
+		std::uint16_t convertX(double x, XY_Rectangle *bbox);
+		std::uint16_t convertY(double y, XY_Rectangle *bbox);
+		double invertX(double x)			{ return x * m_resolution + m_xllcorner; }
+		double invertY(double y)			{ return y * m_resolution + m_yllcorner; }
+		std::uint32_t arrayIndex(std::uint16_t x, std::uint16_t y) const	{ return (m_ysize - (y + 1)) * m_xsize + x; }
+		HRESULT fixResolution();
+
+	private:
+		HRESULT getWeatherData(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const XY_Point &pt, const HSS_Time::WTime &time, std::uint64_t interpolate_method, IWXData *wx, IFWIData *ifwi, DFWIData *dfwi, bool *wx_valid, XY_Rectangle *bbox_cache);
+		bool rasterValue(std::uint16_t variable, std::uint32_t index, const HSS_Time::WTime &time, bool temporal, double *value, double *value2, double *perc2) const;
+		bool rasterPrecipitation(std::uint32_t index, const HSS_Time::WTime &time, double *precip) const;
+		bool covers(std::uint16_t variable, const HSS_Time::WTime &time) const;
+		std::vector<raster_frame *>::iterator findFrame(const HSS_Time::WTime &time);
+#endif
+};
+
+#ifdef HSS_SHOULD_PRAGMA_PACK
+#pragma pack(pop)
+#endif
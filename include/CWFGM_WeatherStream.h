@@ -414,7 +414,13 @@ public:
 	virtual CCWFGM_WeatherStream *deserialize(const google::protobuf::Message& proto, std::shared_ptr<validation::validation_object> valid, const std::string& name) override;
 	virtual std::optional<bool> isdirty(void) const noexcept override { return m_bRequiresSave; }
 
+	std::uint32_t CacheGeneration() const { return m_cacheGeneration.load(std::memory_order_acquire); }	// changes whenever the stream's values may have, so callers know to drop what they've derived from them
+	void CacheStats(WeatherCacheStats *stats) { m_cache.Stats(stats); }	// hits, misses, and stores of the stream's own cache of calculated values (only WeatherData is cached)
+	void ResetCacheStats() { m_cache.ResetStats(); }
+
 protected:
+	void clearCache() { m_cache.Clear(); m_cacheGeneration.fetch_add(1, std::memory_order_acq_rel); }
+
 	WeatherCondition	m_weatherCondition;
 	std::uint16_t			m_gridCount;			// number of WeatherGrids using this stream
 	CRWThreadSemaphore	m_lock, m_mt_calc_lock;
@@ -422,6 +428,7 @@ protected:
 	bool				m_bRequiresSave;
 
 	WeatherBaseCache_MT m_cache;
+	std::atomic<std::uint32_t> m_cacheGeneration = 0;
 #endif
 };
 
@@ -83,6 +83,20 @@ struct WeatherGridSetModifier {
 #define CWFGM_WEATHER_OPTION_WARNONSUNRISE		10572
 #define CWFGM_WEATHER_OPTION_WARNONSUNSET		10573
 
+#define CWFGM_WEATHER_OPTION_HOURLY_BLEND		10580		// blend sub-hour grid weather from cached hourly station weather
+#define CWFGM_WEATHER_OPTION_LATTICE_SPACING		10581		// interpolate on a coarser lattice (in grid cells) and upsample, 0 to turn off
+#define CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE		10582		// largest tolerated upsampling error in temperature and dew point (C) before a lattice block is calculated per cell
+#define CWFGM_WEATHER_OPTION_CACHE_EVICTION		10583		// how cell caches created from now on make room, one of the CWFGM_WEATHER_CACHE_EVICT_ values
+#define CWFGM_WEATHER_OPTION_CACHE_BUDGET		10584		// bytes for each cell cache created from now on, including its tiles and daily FWI state (the first on a grid also pays for its elevation cache and lattice), 0 for the built-in sizes
+#define CWFGM_WEATHER_OPTION_CACHE_STATS		10585		// whether cell caches created from now on count hits, misses, etc., setting it resets existing counts (and the streams')
+#define CWFGM_WEATHER_OPTION_CACHE_STATS_REPORT		10586		// read-only, per layer, a text summary of its caches' counts, then each stream's
+#define CWFGM_WEATHER_OPTION_DISK_CACHE			10587		// directory to keep spatially interpolated hourly weather in across runs, empty to turn off
+#define CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_WIND	10588		// as LATTICE_TOLERANCE, for wind speed, gust and their vector components (km/h)
+#define CWFGM_WEATHER_OPTION_LATTICE_TOLERANCE_PRECIP	10589		// as LATTICE_TOLERANCE, for precipitation (mm)
+
+#define CWFGM_WEATHER_CACHE_EVICT_FIFO			0		// drop the cell created longest ago
+#define CWFGM_WEATHER_CACHE_EVICT_CLOCK			1		// as FIFO, but cells that have had cache hits since the last pass get a second chance
+
 #define CWFGM_WEATHERSTREAM_IMPORT_PURGE		0x0001
 #define CWFGM_WEATHERSTREAM_IMPORT_SUPPORT_APPEND	0x0002
 #define CWFGM_WEATHERSTREAM_IMPORT_SUPPORT_OVERWRITE	0x0004
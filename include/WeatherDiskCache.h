@@ -0,0 +1,134 @@
+/**
+ * WISE_Weather_Module: WeatherDiskCache.h
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "WeatherUtilities.h"
+#include "semaphore.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+#ifndef DOXYGEN_IGNORE_CODE
+
+namespace boost { namespace iostreams { class mapped_file; } }
+
+
+/**
+	Spatially interpolated weather kept on disk so that it can be reused by later runs.  Each frame (a time and interpolation method) is split
+	into tiles of TILE_SIZE x TILE_SIZE cells, with one memory mapped file per tile, so only the part of the grid a fire has reached takes any
+	disk space.  Files are named by a hash of everything the interpolation depends on, split into the part that is fixed for the grid (geometry,
+	options, station locations), given to the constructor, and the part that changes with time (the station values), which is asked for through
+	the content function the first time a (time, interpolate_method) pair is used, plus the tile's index.  Any change to the inputs gives different
+	names, so stale files are never read; they're deleted once they're old enough or the directory is over its size cap.  Cell elevations aren't
+	in either hash, they're checked record by record.  Lookups only map files that already exist, and files are only created to store to, under
+	a temporary name that's then linked into place, so a file another process has mapped is never truncated or replaced.
+*/
+class WeatherDiskCache {
+public:
+	typedef std::function<std::uint64_t(const HSS_Time::WTime &time, std::uint64_t interpolate_method)> ContentHash;
+
+	WeatherDiskCache(const std::string &directory, std::uint64_t grid_hash, std::uint16_t x_size, std::uint16_t y_size, const ContentHash &content);
+	~WeatherDiskCache();
+
+	/**
+		Retrieves the weather stored for a cell.
+		\param	time	Time of the frame.
+		\param	interpolate_method	Interpolation options the weather was calculated with.
+		\param	x	Column of the cell.
+		\param	y	Row of the cell.
+		\param	elevation	Elevation of the cell, which must match what the weather was stored with.
+		\param	wx	Filled in with the stored weather.
+		\retval	true	The cell has been stored, by this run or an earlier one.
+		\retval	false	The cell hasn't been stored or its tile can't be opened.
+	*/
+	bool Retrieve(const HSS_Time::WTime &time, std::uint64_t interpolate_method, std::uint16_t x, std::uint16_t y, double elevation, IWXData *wx);
+	/**
+		Stores the weather for a cell.  Failures (e.g. the directory can't be written) are ignored, the cache is only an accelerator.
+		\param	time	Time of the frame.
+		\param	interpolate_method	Interpolation options the weather was calculated with.
+		\param	x	Column of the cell.
+		\param	y	Row of the cell.
+		\param	elevation	Elevation of the cell the weather was calculated for.
+		\param	wx	Weather to store.
+	*/
+	void Store(const HSS_Time::WTime &time, std::uint64_t interpolate_method, std::uint16_t x, std::uint16_t y, double elevation, const IWXData *wx);
+
+	static std::uint64_t Hash(std::uint64_t hash, const void *data, std::size_t size);
+	static std::uint64_t Hash(std::uint64_t hash, double value) { return Hash(hash, &value, sizeof(value)); }
+	static std::uint64_t Hash(std::uint64_t hash, std::uint64_t value) { return Hash(hash, &value, sizeof(value)); }
+	static std::uint64_t Hash(std::uint64_t hash, const IWXData &wx);
+	static const std::uint64_t HashSeed = 0xcbf29ce484222325ull;
+
+private:
+	struct Record {
+		std::uint64_t filled;
+		double elevation;			// the elevation isn't in the grid hash since it's only known cell by cell, as cells are first used
+		IWXData wx;
+	};
+
+	struct Tile {					// one file's worth of records
+		boost::iostreams::mapped_file *file;
+		const Record *records;			// nullptr if there's no file (yet), so it isn't looked for again for every cell
+		Record *writable;			// records, if the file is mapped for writing, nullptr until something is stored in the tile
+		bool failed;				// the file couldn't be created, so it isn't retried for every cell
+		std::uint64_t used;
+	};
+
+	struct Frame {
+		std::uint64_t time, interpolate_method;
+		std::uint64_t content;			// from the content function, names the frame's files along with the grid hash and tile index
+		std::unordered_map<std::uint32_t, Tile> tiles;	// the most recently used tiles, kept open
+		std::uint64_t touch;
+		std::uint64_t used;
+	};
+
+	struct Stripe {					// frames are spread over these by time and method, so workers on different hours don't wait on each other
+		CThreadSemaphore lock;
+		std::vector<Frame> frames;		// the most recently used frames, kept open
+		std::uint64_t used;
+	};
+
+	static constexpr std::uint16_t STRIPES = 8;
+	static constexpr std::uint16_t TILE_SIZE = 32;	// cells along each side of a tile file
+
+	std::string m_directory;
+	std::uint64_t m_gridHash;
+	std::uint16_t m_xsize, m_ysize;
+	std::uint16_t m_xtiles;
+	ContentHash m_content;
+	std::atomic<std::uint32_t> m_created;		// tile files this cache has made, so the directory is only pruned every so often
+
+	Stripe m_stripes[STRIPES];
+
+	Stripe *stripe(const HSS_Time::WTime &time, std::uint64_t interpolate_method);
+	Frame *frame(Stripe *s, const HSS_Time::WTime &time, std::uint64_t interpolate_method);
+	Tile *tile(Frame *f, std::uint32_t index);
+	bool writable(const Frame *f, std::uint32_t index, Tile *t);
+	std::string filename(const Frame *f, std::uint32_t index) const;
+	boost::iostreams::mapped_file *map(const std::string &filename, std::uint32_t index, bool writable);
+	bool create(const std::string &filename, std::uint32_t index);
+	std::uint32_t tileIndex(std::uint16_t x, std::uint16_t y) const { return ((std::uint32_t)(y / TILE_SIZE)) * m_xtiles + (x / TILE_SIZE); }
+	static std::size_t recordIndex(std::uint16_t x, std::uint16_t y) { return (std::size_t)(y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE); }
+	void prune();
+};
+
+#endif
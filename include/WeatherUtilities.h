@@ -27,6 +27,9 @@
 #include "objectcache_mt.h"
 #include "CoordinateConverter.h"
 #include <map>
+#include <cstring>
+#include <vector>
+#include <atomic>
 #include "CWFGM_LayerManager.h"
 
 #ifdef HSS_SHOULD_PRAGMA_PACK
@@ -44,13 +47,17 @@ struct WeatherKeyBase {
 };
 
 
+class WeatherLayerCache;
+
+
 struct WeatherKey {
-	WeatherKey(std::uint16_t _x, std::uint16_t _y, const HSS_Time::WTime &_time, std::uint64_t _interpolate_method, Layer * _layerThread) : time(_time)
-		{ x = _x; y = _y; interpolate_method = _interpolate_method; layerThread = _layerThread; }
+	WeatherKey(std::uint16_t _x, std::uint16_t _y, const HSS_Time::WTime &_time, std::uint64_t _interpolate_method, Layer * _layerThread, WeatherLayerCache *_cache = nullptr) : time(_time)
+		{ x = _x; y = _y; interpolate_method = _interpolate_method; layerThread = _layerThread; cache = _cache; }
 	std::uint16_t x, y;
 	std::uint64_t interpolate_method;
 	const HSS_Time::WTime time;
 	Layer *layerThread;
+	WeatherLayerCache *cache;		// if set, the layer's cache (from WeatherCache::Handle()) so it needn't be looked up again
 };
 
 
@@ -84,6 +91,18 @@ struct HDFWIData {
 };
 
 
+struct WeatherCacheStats {			// counts indexed by [WeatherData, HIWXData, HIFWIData, HDFWIData][day, noon, hour, second]
+	std::uint64_t hits[4][4], misses[4][4], stores[4][4];
+	std::uint64_t evictions;		// cells dropped to make room for others
+	std::uint64_t purges;			// cells dropped by PurgeOld()
+	std::uint64_t front[4];			// hits answered by the calling thread's front cache, which never reach the shards (so aren't in hits)
+
+	WeatherCacheStats() { Reset(); }
+	void Reset() { memset(hits, 0, sizeof(hits)); memset(misses, 0, sizeof(misses)); memset(stores, 0, sizeof(stores)); memset(front, 0, sizeof(front)); evictions = purges = 0; }
+	WeatherCacheStats &operator+=(const WeatherCacheStats &s);
+};
+
+
 class WeatherBaseCache {
 	ValueCacheTempl<WeatherKeyBase, WeatherData> m_cacheDay, m_cacheNoon, m_cacheHour, m_cacheSec;
 	ValueCacheTempl<WeatherKeyBase, HIWXData> m_iwxDay, m_iwxNoon, m_iwxHour, m_iwxSec;
@@ -96,10 +115,16 @@ class WeatherBaseCache {
 	ValueCacheTempl<WeatherKeyBase, HDFWIData> *getCacheDfwi(const HSS_Time::WTime &time, const WTimeManager *tm);
 
 public:
-	WeatherBaseCache() :	m_cacheDay(4), m_cacheNoon(4), m_cacheHour(28), m_cacheSec(8),
-				m_iwxDay(4), m_iwxNoon(4), m_iwxHour(28), m_iwxSec(8),
-				m_ifwiDay(4), m_ifwiNoon(4), m_ifwiHour(28), m_ifwiSec(8),
-				m_dfwiDay(4), m_dfwiNoon(4), m_dfwiHour(28), m_dfwiSec(8) { m_createdIndex = (std::uint32_t)-1; };
+	static constexpr std::uint16_t DAY_ENTRIES = 4, NOON_ENTRIES = 4, HOUR_ENTRIES = 28, SEC_ENTRIES = 8;	// default sizes of the day, noon, hour, and second caches
+	static constexpr std::uint16_t ENTRIES = DAY_ENTRIES + NOON_ENTRIES + HOUR_ENTRIES + SEC_ENTRIES;	// entries across all four, however they're split
+	static constexpr std::uint16_t TIER_DAY = 0, TIER_NOON = 1, TIER_HOUR = 2, TIER_SEC = 3;	// the caches TimeTier() picks between, also how WeatherCacheStats are indexed
+
+	WeatherBaseCache() : WeatherBaseCache(DAY_ENTRIES, NOON_ENTRIES, HOUR_ENTRIES, SEC_ENTRIES) { };
+	WeatherBaseCache(std::uint16_t day, std::uint16_t noon, std::uint16_t hour, std::uint16_t sec) :
+				m_cacheDay(day), m_cacheNoon(noon), m_cacheHour(hour), m_cacheSec(sec),
+				m_iwxDay(day), m_iwxNoon(noon), m_iwxHour(hour), m_iwxSec(sec),
+				m_ifwiDay(day), m_ifwiNoon(noon), m_ifwiHour(hour), m_ifwiSec(sec),
+				m_dfwiDay(day), m_dfwiNoon(noon), m_dfwiHour(hour), m_dfwiSec(sec) { m_createdIndex = (std::uint32_t)-1; m_bucket = 0; };
 
 	void Store(const WeatherKeyBase *_key, const WeatherData *_answer, const WTimeManager *tm);
 	void Store(const WeatherKeyBase *_key, const HIWXData *_answer, const WTimeManager *tm);
@@ -114,7 +139,10 @@ public:
 	void Clear();
 	bool Purge(const HSS_Time::WTime &time);
 
+	static std::uint16_t TimeTier(const HSS_Time::WTime &time);
+
 	std::uint32_t m_createdIndex;
+	std::uint64_t m_bucket;			// purge bucket of the latest time stored in this cell
 
 	DECLARE_OBJECT_CACHE_MT(WeatherBaseCache, WeatherBaseCache)
 };
@@ -122,23 +150,27 @@ public:
 
 class WeatherBaseCache_MT : WeatherBaseCache {
 	CThreadSemaphore m_lock;
+	WeatherCacheStats m_stats;			// always kept, since every call already takes m_lock
 
 public:
 	WeatherBaseCache_MT() = default;
 
-	void Store(const WeatherKeyBase *_key, const WeatherData *_answer, const WTimeManager *tm)	{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_lock.Unlock(); };
-	void Store(const WeatherKeyBase *_key, const HIWXData *_answer, const WTimeManager *tm)		{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_lock.Unlock(); };
-	void Store(const WeatherKeyBase *_key, const HIFWIData *_answer, const WTimeManager *tm)		{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_lock.Unlock(); };
-	void Store(const WeatherKeyBase *_key, const HDFWIData *_answer, const WTimeManager *tm)		{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_lock.Unlock(); };
+	void Store(const WeatherKeyBase *_key, const WeatherData *_answer, const WTimeManager *tm)	{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_stats.stores[0][TimeTier(_key->time)]++; m_lock.Unlock(); };
+	void Store(const WeatherKeyBase *_key, const HIWXData *_answer, const WTimeManager *tm)		{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_stats.stores[1][TimeTier(_key->time)]++; m_lock.Unlock(); };
+	void Store(const WeatherKeyBase *_key, const HIFWIData *_answer, const WTimeManager *tm)		{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_stats.stores[2][TimeTier(_key->time)]++; m_lock.Unlock(); };
+	void Store(const WeatherKeyBase *_key, const HDFWIData *_answer, const WTimeManager *tm)		{ m_lock.Lock(); WeatherBaseCache::Store(_key, _answer, tm); m_stats.stores[3][TimeTier(_key->time)]++; m_lock.Unlock(); };
 
-	WeatherData *Retrieve(const WeatherKeyBase *_key, WeatherData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); WeatherData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); m_lock.Unlock(); return wd; };
-	HIWXData *Retrieve(const WeatherKeyBase *_key, HIWXData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); HIWXData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); m_lock.Unlock(); return wd; };
-	HIFWIData *Retrieve(const WeatherKeyBase *_key, HIFWIData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); HIFWIData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); m_lock.Unlock(); return wd; };
-	HDFWIData *Retrieve(const WeatherKeyBase *_key, HDFWIData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); HDFWIData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); m_lock.Unlock(); return wd; };
+	WeatherData *Retrieve(const WeatherKeyBase *_key, WeatherData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); WeatherData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); ((wd) ? m_stats.hits : m_stats.misses)[0][TimeTier(_key->time)]++; m_lock.Unlock(); return wd; };
+	HIWXData *Retrieve(const WeatherKeyBase *_key, HIWXData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); HIWXData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); ((wd) ? m_stats.hits : m_stats.misses)[1][TimeTier(_key->time)]++; m_lock.Unlock(); return wd; };
+	HIFWIData *Retrieve(const WeatherKeyBase *_key, HIFWIData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); HIFWIData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); ((wd) ? m_stats.hits : m_stats.misses)[2][TimeTier(_key->time)]++; m_lock.Unlock(); return wd; };
+	HDFWIData *Retrieve(const WeatherKeyBase *_key, HDFWIData *_to_fill, const WTimeManager *tm)	{ m_lock.Lock(); HDFWIData *wd = WeatherBaseCache::Retrieve(_key, _to_fill, tm); ((wd) ? m_stats.hits : m_stats.misses)[3][TimeTier(_key->time)]++; m_lock.Unlock(); return wd; };
 	
 	void Clear()											{ m_lock.Lock(); WeatherBaseCache::Clear(); m_lock.Unlock(); };
 	bool Purge(const HSS_Time::WTime &time)									{ m_lock.Lock(); bool b = WeatherBaseCache::Purge(time); m_lock.Unlock(); return b; };
 
+	void Stats(WeatherCacheStats *stats)								{ m_lock.Lock(); *stats = m_stats; m_lock.Unlock(); };
+	void ResetStats()										{ m_lock.Lock(); m_stats.Reset(); m_lock.Unlock(); };
+
 	DECLARE_OBJECT_CACHE_MT(WeatherBaseCache_MT, WeatherBaseCache_MT)
 };
 
@@ -147,6 +179,64 @@ public:
 #endif
 
 
+class DailyFWIState {
+	struct Codes {
+		std::uint64_t day;			// start (noon LST) of the FWI day these codes are for, in microseconds, 0 when unset
+		bool valid;
+		double dFFMC, dDMC, dDC;
+	};
+
+	struct CellState {
+		CellState() { curr.day = prev.day = 0; }
+		Codes curr, prev;			// the two most recent days calculated for this cell
+	};
+
+	static constexpr std::uint16_t TILE_SIZE = 32;
+	static constexpr std::uint16_t METHODS = 4;		// interpolation methods kept at once, codes for any others aren't kept
+	static constexpr std::uint16_t LOCKS = 16;		// tiles are locked by their index modulo this
+	static constexpr std::uint64_t DEFAULT_BUDGET = 32 * 1024 * 1024;
+
+	struct Tile {
+		CellState cells[TILE_SIZE * TILE_SIZE];
+		bool referenced = true;			// used since evict() last passed it
+	};
+
+	struct Table {					// the tiles for one interpolation method, since codes depend on the temporal, spatial, etc. options
+		std::atomic<bool> used;
+		std::uint64_t method;
+		std::atomic<Tile *> *tiles;		// allocated as cells get touched, so a fire only pays for the area it burns
+	};
+
+private:
+	CThreadSemaphore m_tableLock;		// only to add tables, looking them up doesn't lock
+	Table m_tables[METHODS];
+	CThreadSemaphore m_locks[LOCKS];
+	std::uint16_t m_xsize, m_ysize;
+	std::uint16_t m_xtiles, m_ytiles;
+	std::atomic<std::uint32_t> m_tileCount;
+	std::uint32_t m_maxTiles;
+	std::atomic<std::uint64_t> m_hand;
+
+	std::uint32_t tileIndex(std::uint16_t x, std::uint16_t y) const { return ((std::uint32_t)(y / TILE_SIZE)) * m_xtiles + (x / TILE_SIZE); }
+	Table *table(std::uint64_t interpolate_method, bool add);
+	CellState *cell(Table *t, std::uint16_t x, std::uint16_t y, bool allocate);
+	void evict();
+
+public:
+	DailyFWIState(std::uint16_t x, std::uint16_t y);
+	~DailyFWIState();
+
+	static std::uint64_t TileBytes() { return sizeof(Tile); }
+	std::uint64_t TableBytes() const;
+	void SetBudget(std::uint64_t bytes);
+
+	bool Retrieve(std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, const HSS_Time::WTime &day, DFWIData *dfwi, bool *valid);
+	bool RetrieveBefore(std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, const HSS_Time::WTime &day, std::uint64_t *found, DFWIData *dfwi, bool *valid);
+	void Store(std::uint16_t x, std::uint16_t y, std::uint64_t interpolate_method, const HSS_Time::WTime &day, const DFWIData *dfwi, bool valid);
+	void Clear();
+};
+
+
 class WeatherLayerCache {
 	struct WEntry {
 		std::uint16_t x, y;
@@ -157,23 +247,74 @@ class WeatherLayerCache {
 
 	};
 
+	static constexpr std::uint16_t TILE_SIZE = 8;			// cells along each side of a tile, a tile is also the unit cells are spread across the shards by
+	static constexpr size_t TILE_BUDGET = 64 * 1024 * 1024;	// bytes of tiles allowed before the least recently used tile is dropped, without a budget
+	static constexpr std::uint16_t SHARDS = 16;			// independently locked partitions of the tiles
+	static constexpr std::uint64_t PURGE_BUCKET = 60ULL * 60ULL * 1000000ULL;	// microseconds of stored times per purge bucket
+	static constexpr std::uint32_t REBALANCE_STORES = 4096;		// stores to a shard between working out how its new cells split their entries between tiers
+	static constexpr std::uint16_t MIN_TIER_ENTRIES = 4;			// entries every tier gets, however few stores it sees
+
+	struct Tile {
+		WeatherBaseCache *cells[TILE_SIZE * TILE_SIZE];
+		std::uint32_t count;			// number of cells in this tile with a cache
+		std::uint32_t slot;			// where this tile is in its shard's list of tiles
+		std::uint64_t touched;			// when this tile was last used
+	};
+
+	struct Shard {					// owns the tiles that hash to it, with its own lock and creation order; the budgets are shared by all shards
+		CThreadSemaphore lock;
+		WEntry *created;
+		std::uint32_t begin, end, slots;	// 'slots' counts the creation order from end to begin, including cells since dropped
+		std::vector<std::uint32_t> tiles;	// indices of this shard's allocated tiles
+		std::uint64_t touch;
+		WeatherCacheStats stats;
+		std::map<std::uint64_t, std::vector<WEntry>> buckets;	// cells by the purge bucket of the latest time stored in them, may list cells since moved on or dropped
+		std::uint32_t tierStores[4], tierTotal;	// stores per tier (and in all) since the split was last worked out, decayed rather than reset
+		std::uint16_t tierEntries[4];		// how cells created in this shard split WeatherBaseCache::ENTRIES across the day, noon, hour, and second caches
+	};
+
 private:
-	CThreadSemaphore m_lock;
-	WeatherBaseCache **m_cacheArray;
-	WEntry *m_created;
+	Tile **m_tiles;				// allocated as cells get touched, so memory follows the fire rather than the landscape
+	Shard m_shards[SHARDS];
+	std::atomic<std::uint64_t> m_frontHits[4];	// WeatherCacheStats::front, counted outside of any shard
+	std::atomic<std::uint32_t> m_cellCount, m_tileCount;	// across all shards
+	std::atomic<std::uint64_t> *m_referenced;	// a bit per cell, set by hits since eviction last looked at the cell, kept out of the cells so that
+						// front cache hits, which don't lock a shard and may outlive the cell, can set it too
+	std::uint32_t m_maxCells, m_maxTiles;	// m_maxCells is also the size of each shard's creation order, so one busy shard can use the whole budget
 	std::uint16_t m_xsize, m_ysize;
-	std::uint32_t m_begin, m_end, m_max;
+	std::uint16_t m_xtiles, m_ytiles;
 
 
-	std::uint32_t arrayIndex(std::uint16_t x, std::uint16_t y) const {
+	std::uint32_t tileIndex(std::uint16_t x, std::uint16_t y) const {
 		weak_assert(x < m_xsize);
 		weak_assert(y < m_ysize);
-		return y * m_xsize + x;
+		return ((std::uint32_t)(y / TILE_SIZE)) * m_xtiles + (x / TILE_SIZE);
+	}
+	static std::uint32_t cellIndex(std::uint16_t x, std::uint16_t y) {
+		return (y % TILE_SIZE) * TILE_SIZE + (x % TILE_SIZE);
+	}
+	Shard *shard(std::uint32_t tile_index) { return &m_shards[((tile_index * 0x9e3779b1u) >> 16) % SHARDS]; }	// scatters neighbouring tiles, across rows and down columns
+	WeatherBaseCache *existing(std::uint16_t x, std::uint16_t y) {
+		Tile *t = m_tiles[tileIndex(x, y)];
+		return (t) ? t->cells[cellIndex(x, y)] : nullptr;
 	}
-	WeatherBaseCache *cache(std::uint16_t x, std::uint16_t y);
+	Tile *tile(Shard *s, std::uint32_t index, bool allocate);
+	void freeTile(Shard *s, std::uint32_t index);
+	void evictTile(Shard *s);
+	bool evictCell(Shard *s, const WeatherBaseCache *keep);
+	void reference(std::uint16_t x, std::uint16_t y);
+	bool unreference(std::uint16_t x, std::uint16_t y);
+	void removeCell(Shard *s, std::uint16_t x, std::uint16_t y);
+	WeatherBaseCache *cache(Shard *s, std::uint16_t x, std::uint16_t y);
+	WeatherBaseCache *lookup(Shard *s, std::uint16_t x, std::uint16_t y);
+	void bucket(Shard *s, WeatherBaseCache *c, std::uint16_t x, std::uint16_t y, const HSS_Time::WTime &time);
+	void tierStore(Shard *s, std::uint16_t tier);
 
 public:
-	WeatherLayerCache(std::uint16_t x, std::uint16_t y, std::uint32_t max_cache_entries, WTimeManager *tm);
+	WeatherLayerCache(std::uint16_t x, std::uint16_t y, std::uint32_t max_cache_entries, std::uint64_t budget, WTimeManager *tm);
+
+	static std::uint64_t CellBytes();
+	static std::uint32_t CellsForBudget(std::uint64_t bytes);
 	~WeatherLayerCache();
 
 	void Store(const WeatherKey *_key, const WeatherData *_answer, const WTimeManager *tm);
@@ -190,24 +331,54 @@ public:
 	void PurgeOld(const HSS_Time::WTime &time);
 	bool Exists(std::uint16_t x, std::uint16_t y);
 
+	void Stats(WeatherCacheStats *stats);
+	void ResetStats();
+
 	HSS_Time::WTime m_equilibriumTime;
+	DailyFWIState m_fwiState;
 
 	DECLARE_OBJECT_CACHE_MT(WeatherLayerCache, WeatherLayerCache)
 
 	std::atomic<std::uint32_t> m_refCount = 0;
+	std::uint16_t m_cacheIndex = 0;
+	std::uint16_t m_eviction = 0;		// one of the CWFGM_WEATHER_CACHE_EVICT_ values
+	bool m_statistics = false;		// whether to keep WeatherCacheStats
 };
 
 
 class WeatherCache {
 private:
+	struct LayerHandles {				// a slot keeps its layer once its caches are gone, so slots after it stay reachable
+		std::atomic<Layer *> layerThread;
+		std::atomic<WeatherLayerCache *> cache[2];
+	};
+
+	static constexpr std::uint16_t HANDLE_SLOTS = 64;	// layers with caches Handle() can find, any more are only found in the maps
+
 	std::map<Layer *, WeatherLayerCache *> m_weatherLayerMap[2];
+	LayerHandles m_handles[HANDLE_SLOTS];	// open addressed by layer, written by Add() and Remove() (which callers serialize), read by Handle() without locking
 
+	static std::uint16_t handleSlot(Layer *layerThread) { return (std::uint16_t)((((std::uint64_t)(std::uintptr_t)layerThread) * 0x9e3779b97f4a7c15ull) >> 58); }	// top 6 bits, for HANDLE_SLOTS
 	WeatherLayerCache *cache(Layer *layerThread, std::uint16_t cacheIndex);
+	void setHandle(Layer *layerThread, std::uint16_t cacheIndex, WeatherLayerCache *c);
+	WeatherLayerCache *cache(const WeatherKey *_key, std::uint16_t cacheIndex) {
+		if (_key->cache) {
+			weak_assert(_key->cache->m_cacheIndex == cacheIndex);
+			return _key->cache;
+		}
+		return cache(_key->layerThread, cacheIndex);
+	}
 
 	HSS_Time::WTimeManager *m_tm;
 
 public:
-	WeatherCache(HSS_Time::WTimeManager *_tm) { m_tm = _tm; };
+	WeatherCache(HSS_Time::WTimeManager *_tm) {
+		m_tm = _tm;
+		for (std::uint16_t i = 0; i < HANDLE_SLOTS; i++) {
+			m_handles[i].layerThread = nullptr;
+			m_handles[i].cache[0] = m_handles[i].cache[1] = nullptr;
+		}
+	};
 	~WeatherCache();
 
 	void Store(std::uint16_t cacheIndex, const WeatherKey *_key, const WeatherData *_answer, const WTimeManager *tm);
@@ -220,7 +391,24 @@ public:
 	HIFWIData *Retrieve(std::uint16_t cacheIndex, const WeatherKey *_key, HIFWIData *_to_fill, const WTimeManager *tm);
 	HDFWIData *Retrieve(std::uint16_t cacheIndex, const WeatherKey *_key, HDFWIData *_to_fill, const WTimeManager *tm);
 
-	void Add(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x_size, std::uint16_t y_size);
+	void Add(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x_size, std::uint16_t y_size, std::uint16_t eviction = 0, std::uint64_t budget = 0, bool statistics = false);
+	WeatherLayerCache *Handle(Layer *layerThread, std::uint16_t cacheIndex) {	// stays valid until Remove() for this layer, nullptr if it isn't in m_handles
+		if (!layerThread)
+			return nullptr;
+		std::uint16_t slot = handleSlot(layerThread);
+		for (std::uint16_t i = 0; i < HANDLE_SLOTS; i++, slot = (slot + 1) % HANDLE_SLOTS) {
+			Layer *l = m_handles[slot].layerThread.load(std::memory_order_acquire);
+			if (!l)
+				break;
+			if (l == layerThread) {
+				WeatherLayerCache *c = m_handles[slot].cache[cacheIndex].load(std::memory_order_acquire);
+				if (m_handles[slot].layerThread.load(std::memory_order_acquire) == layerThread)	// the slot wasn't handed to another layer while we read it
+					return c;
+				break;
+			}
+		}
+		return nullptr;
+	}
 	bool Exists(Layer *layerThread, std::uint16_t cacheIndex);
 	void Remove(Layer *layerThread, std::uint16_t cacheIndex);
 	void Clear(Layer *layerThread, std::uint16_t cacheIndex);
@@ -232,8 +420,11 @@ public:
 
 	void EquilibriumDepth(Layer *layerThread, std::uint16_t cacheIndex, const HSS_Time::WTime &time);
 	HSS_Time::WTime EquilibriumDepth(Layer *layerThread, std::uint16_t cacheIndex);
+	DailyFWIState *FWIState(Layer *layerThread, std::uint16_t cacheIndex);
 
-	std::uint32_t CacheEntries() const;
+	std::uint32_t CacheEntries() const;		// layers' caches of either index
+	bool Stats(Layer *layerThread, std::uint16_t cacheIndex, WeatherCacheStats *stats);
+	void ResetStats();
 
 	void SetTimeManager(WTimeManager* tm);
 };
@@ -242,19 +433,24 @@ public:
 class WeatherUtilities {
 public:
 	WeatherUtilities(WTimeManager *tm);
-	virtual HRESULT GetRawWxValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid) = 0;
-	virtual HRESULT GetRawDFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *dfwi, bool *wx_valid) = 0;
-	virtual HRESULT GetRawIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, IFWIData *ifwi, bool *wx_valid) = 0;
+	virtual HRESULT GetRawWxValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, bool *wx_valid) = 0;
+	virtual HRESULT GetRawDFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *dfwi, bool *wx_valid) = 0;
+	virtual HRESULT GetRawIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, IFWIData *ifwi, bool *wx_valid) = 0;
+
+	virtual HRESULT GetRawDailyRain(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &todayStart, const HSS_Time::WTime &yesterday, const XY_Point &pt, std::uint64_t interpolate_method, const IWXData *wx1, double *rain);
 
 	HRESULT GetCalculatedValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const XY_Point &pt, WeatherKey &key, WeatherData &data);
-	HRESULT GetCalculatedDFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, DFWIData *t_dfwi, DFWIData *p_dfwi = NULL);
-	HRESULT GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, IFWIData *ifwi);
+	HRESULT GetCalculatedDFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, DFWIData *t_dfwi, DFWIData *p_dfwi = NULL);
+	HRESULT GetCalculatedIFWIValues(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &time, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx, IFWIData *ifwi);
 
-	void AddCache(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x_size, std::uint16_t y_size);
+	void AddCache(Layer *layerThread, std::uint16_t cacheIndex, std::uint16_t x_size, std::uint16_t y_size, std::uint16_t eviction = 0, std::uint64_t budget = 0, bool statistics = false);
 	void RemoveCache(Layer *layerThread, std::uint16_t cacheIndex);
 	void ClearCache(Layer *layerThread, std::uint16_t cacheIndex);
 	void PurgeOldCache(Layer *layerThread, std::uint16_t cacheIndex, const HSS_Time::WTime &time);
 	bool CacheExists(Layer *layerThread, std::uint16_t cacheIndex);
+	WeatherLayerCache *CacheHandle(Layer *layerThread, std::uint64_t interpolate_method);
+	bool CacheStats(Layer *layerThread, std::uint16_t cacheIndex, WeatherCacheStats *stats);
+	void ResetCacheStats();
 
 	std::uint32_t IncrementCache(Layer* layerThread, std::uint16_t cacheIndex);
 	std::uint32_t DecrementCache(Layer* layerThread, std::uint16_t cacheIndex);
@@ -269,6 +465,11 @@ protected:
 	WTimeManager *m_tm;
 
 	WeatherCache m_cache;
+
+private:
+	HRESULT getDailyState(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &day, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, std::uint32_t WX_SpecifiedBits, DFWIData *dfwi, bool *wx_valid);
+	HRESULT calculateDailyCodes(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &todayStart, const HSS_Time::WTime &yesterday, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const IWXData *wx1, const DFWIData *p_dfwi, DFWIData *t_dfwi);
+	HRESULT stepDailyState(ICWFGM_GridEngine *gridEngine, Layer *layerThread, WeatherLayerCache *layerCache, const HSS_Time::WTime &equilibrium, const HSS_Time::WTime &day, const XY_Point &pt, double lat, double lon, std::uint64_t interpolate_method, const DFWIData *p_dfwi, DFWIData *t_dfwi, bool *t_valid);
 };
 
 
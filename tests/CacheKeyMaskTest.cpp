@@ -0,0 +1,182 @@
+/**
+ * WISE_Weather_Module: CacheKeyMaskTest.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// The weather layer cache drops some interpolate_method bits from its keys, so queries only differing in them share entries: the cache
+// selection bits (ALTERNATE_CACHE, IGNORE_CACHE) from every key, and CALCFWI and HISTORY from plain weather (HIWXData) keys.  This checks
+// that's safe, by asking the grid the same queries with and without each bit and comparing what comes back, and that the cache really does
+// share (and doesn't over-share) entries between them.
+
+#include "WeatherTestGrid.h"
+
+int g_testFailures = 0;
+
+
+static const std::uint64_t SPATIAL = (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL);
+static const std::uint64_t CALCFWI = (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_CALCFWI);
+static const std::uint64_t HISTORY = (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_HISTORY);
+static const std::uint64_t ALTERNATE = (1ull << CWFGM_SCENARIO_OPTION_WEATHER_ALTERNATE_CACHE);
+static const std::uint64_t IGNORE = (1ull << CWFGM_SCENARIO_OPTION_WEATHER_IGNORE_CACHE);
+
+
+struct Answer {
+	HRESULT hr;
+	IWXData wx;
+	IFWIData ifwi;
+	DFWIData dfwi;
+	bool wx_valid;
+};
+
+
+static Answer ask(TestWeatherGrid &test, const XY_Point &pt, const HSS_Time::WTime &time, std::uint64_t interpolate_method) {
+	Answer a;
+	memset(&a, 0, sizeof(a));
+	a.hr = test.m_grid->GetWeatherData(nullptr, pt, time, interpolate_method, &a.wx, &a.ifwi, &a.dfwi, &a.wx_valid, nullptr);
+	return a;
+}
+
+
+#define SAME(what, a, b)	TEST_CHECK((a) == (b), "%s, method %llx vs %llx, hour %.2f: %s %.17g != %.17g", what, (unsigned long long)m1, (unsigned long long)m2, hour, #a, (double)(a), (double)(b))
+
+static void sameWeather(const char *what, std::uint64_t m1, std::uint64_t m2, double hour, const IWXData &a, const IWXData &b) {
+	SAME(what, a.Temperature, b.Temperature);
+	SAME(what, a.DewPointTemperature, b.DewPointTemperature);
+	SAME(what, a.RH, b.RH);
+	SAME(what, a.Precipitation, b.Precipitation);
+	SAME(what, a.WindSpeed, b.WindSpeed);
+	SAME(what, a.WindGust, b.WindGust);
+	SAME(what, a.WindDirection, b.WindDirection);
+	SAME(what, a.SpecifiedBits, b.SpecifiedBits);
+}
+
+
+static void sameFWI(const char *what, std::uint64_t m1, std::uint64_t m2, double hour, const Answer &a, const Answer &b) {
+	SAME(what, a.ifwi.FFMC, b.ifwi.FFMC);
+	SAME(what, a.ifwi.ISI, b.ifwi.ISI);
+	SAME(what, a.ifwi.FWI, b.ifwi.FWI);
+	SAME(what, a.ifwi.SpecifiedBits, b.ifwi.SpecifiedBits);
+	SAME(what, a.dfwi.dFFMC, b.dfwi.dFFMC);
+	SAME(what, a.dfwi.dDMC, b.dfwi.dDMC);
+	SAME(what, a.dfwi.dDC, b.dfwi.dDC);
+	SAME(what, a.dfwi.dBUI, b.dfwi.dBUI);
+	SAME(what, a.dfwi.dISI, b.dfwi.dISI);
+	SAME(what, a.dfwi.dFWI, b.dfwi.dFWI);
+	SAME(what, a.dfwi.SpecifiedBits, b.dfwi.SpecifiedBits);
+}
+
+#undef SAME
+
+
+// the grid's answers with and without each masked bit: everything has to match for the cache selection bits, the weather for CALCFWI and HISTORY
+static void checkAnswers(TestWeatherGrid &test, const std::vector<XY_Point> &points, const std::vector<std::uint32_t> &minutes, std::uint64_t base) {
+	for (std::uint32_t minute : minutes) {
+		const HSS_Time::WTime time = test.m_start + HSS_Time::WTimeSpan(0, 0, minute, 0);
+		const double hour = minute / 60.0;
+		for (const XY_Point &pt : points) {
+			const Answer plain = ask(test, pt, time, base);
+			TEST_CHECK(SUCCEEDED(plain.hr), "method %llx, hour %.2f: failed with %08x", (unsigned long long)base, hour, (unsigned)plain.hr);
+
+			for (std::uint64_t bit : { ALTERNATE, IGNORE }) {
+				const Answer other = ask(test, pt, time, base | bit);
+				TEST_CHECK(plain.hr == other.hr, "method %llx vs %llx, hour %.2f: HRESULT %08x != %08x", (unsigned long long)base, (unsigned long long)(base | bit), hour, (unsigned)plain.hr, (unsigned)other.hr);
+				sameWeather("cache selection", base, base | bit, hour, plain.wx, other.wx);
+				sameFWI("cache selection", base, base | bit, hour, plain, other);
+			}
+			for (std::uint64_t bits : { CALCFWI, CALCFWI | HISTORY }) {
+				const std::uint64_t m = base ^ bits;		// toggled, since the base methods have them both on and off
+				const Answer other = ask(test, pt, time, m);
+				TEST_CHECK(plain.hr == other.hr, "method %llx vs %llx, hour %.2f: HRESULT %08x != %08x", (unsigned long long)base, (unsigned long long)m, hour, (unsigned)plain.hr, (unsigned)other.hr);
+				sameWeather("FWI options", base, m, hour, plain.wx, other.wx);
+			}
+		}
+	}
+}
+
+
+// an answer stored under one method has to come back for a method that only differs in masked bits, and not for one that differs in others
+static void checkSharing(TestWeatherGrid &test, const std::vector<XY_Point> &points, std::uint64_t base) {
+	WeatherLayerCache *cache = new WeatherLayerCache(test.m_engine->m_xsize, test.m_engine->m_ysize, 7500, 0, test.m_tm);
+	const HSS_Time::WTime time = test.m_start + HSS_Time::WTimeSpan(0, 30, 0, 0);
+
+	for (const XY_Point &pt : points) {
+		const Answer a = ask(test, pt, time, base | CALCFWI | HISTORY | ALTERNATE);
+		const std::uint16_t x = (std::uint16_t)((pt.x - test.m_engine->m_xll) / test.m_engine->m_resolution);
+		const std::uint16_t y = (std::uint16_t)((pt.y - test.m_engine->m_yll) / test.m_engine->m_resolution);
+
+		HIWXData iwx;
+		iwx.hr = a.hr;
+		iwx.wx = a.wx;
+		iwx.wx_valid = a.wx_valid;
+		WeatherKey stored(x, y, time, base | CALCFWI | HISTORY | ALTERNATE, nullptr, cache);
+		cache->Store(&stored, &iwx, test.m_tm);
+
+		HIWXData found;
+		WeatherKey plain(x, y, time, base | IGNORE, nullptr, cache);
+		TEST_CHECK(cache->Retrieve(&plain, &found, test.m_tm) != nullptr, "weather stored with CALCFWI, HISTORY, and ALTERNATE_CACHE isn't found without them");
+		sameWeather("shared entry", base | CALCFWI | HISTORY | ALTERNATE, base | IGNORE, 30.0, a.wx, found.wx);
+		sameWeather("shared entry", base, base | IGNORE, 30.0, ask(test, pt, time, base).wx, found.wx);
+
+		WeatherData data;
+		data.hr = a.hr;
+		data.wx = a.wx;
+		data.ifwi = a.ifwi;
+		data.dfwi = a.dfwi;
+		data.wx_valid = a.wx_valid;
+		cache->Store(&stored, &data, test.m_tm);
+		WeatherData dfound;
+		WeatherKey selection(x, y, time, base | CALCFWI | HISTORY, nullptr, cache);
+		TEST_CHECK(cache->Retrieve(&selection, &dfound, test.m_tm) != nullptr, "weather and FWI stored with ALTERNATE_CACHE isn't found without it");
+		WeatherKey nofwi(x, y, time, base, nullptr, cache);
+		TEST_CHECK(cache->Retrieve(&nofwi, &dfound, test.m_tm) == nullptr, "weather and FWI stored with CALCFWI and HISTORY is found without them");
+	}
+
+	cache->Clear();						// drops this cache's front cache entries before another cache can reuse its address
+	delete cache;
+}
+
+
+int main(int /*argc*/, char * /*argv*/[]) {
+	TestWeatherGrid test;
+
+	std::vector<XY_Point> points;
+	for (std::uint16_t y = 7; y < test.m_engine->m_ysize; y += 37)
+		for (std::uint16_t x = 11; x < test.m_engine->m_xsize; x += 41)
+			points.push_back(test.CellCentre(x, y));
+
+	std::vector<std::uint32_t> minutes;				// whole hours, noons and midnights (local), and times between hours
+	for (std::uint32_t hour = 0; hour < 72; hour += 5)
+		minutes.push_back(hour * 60);
+	for (std::uint32_t m : { 12u * 60u, 24u * 60u, 36u * 60u, 17u, 25u * 60u + 40u, 50u * 60u + 59u })
+		minutes.push_back(m);
+
+	const std::uint64_t methods[] = {
+		SPATIAL,
+		SPATIAL | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL),
+		SPATIAL | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH) | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND) |
+			(1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP),
+		SPATIAL | CALCFWI,
+		SPATIAL | CALCFWI | HISTORY | (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMPORAL),
+	};
+	for (std::uint64_t base : methods) {
+		checkAnswers(test, points, minutes, base);
+		checkSharing(test, points, base & ~(CALCFWI | HISTORY));
+	}
+
+	if (g_testFailures)
+		fprintf(stderr, "%d failures\n", g_testFailures);
+	return g_testFailures ? 1 : 0;
+}
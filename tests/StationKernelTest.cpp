@@ -0,0 +1,109 @@
+/**
+ * WISE_Weather_Module: StationKernelTest.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WeatherTestGrid.h"
+
+int g_testFailures = 0;
+
+
+// the kernels do the same operations in the same order as the generic loop, so every sum has to match exactly
+static void compareSums(std::uint32_t kernel, std::uint16_t x, std::uint16_t y, std::uint32_t hour, const IWXData &wx1, const GStationSums &s1, const IWXData &wx2, const GStationSums &s2) {
+#define SAME(a, b)	TEST_CHECK((a) == (b), "kernel %u, cell (%u, %u), hour %u: %s %.17g != %.17g", kernel, x, y, hour, #a, (double)(a), (double)(b))
+	SAME(wx1.Temperature, wx2.Temperature);
+	SAME(wx1.DewPointTemperature, wx2.DewPointTemperature);
+	SAME(wx1.Precipitation, wx2.Precipitation);
+	SAME(s1.wx__UALR, s2.wx__UALR);
+	SAME(s1.wx__SALR, s2.wx__SALR);
+	SAME(s1.wx_WindSpeed, s2.wx_WindSpeed);
+	SAME(s1.wx_WindGust, s2.wx_WindGust);
+	SAME(s1.weight_temp, s2.weight_temp);
+	SAME(s1.weight_ws, s2.weight_ws);
+	SAME(s1.weight_gust, s2.weight_gust);
+	SAME(s1.weight_precip, s2.weight_precip);
+	SAME(s1.wind_vector.x, s2.wind_vector.x);
+	SAME(s1.wind_vector.y, s2.wind_vector.y);
+	SAME(s1.gust_vector.x, s2.gust_vector.x);
+	SAME(s1.gust_vector.y, s2.gust_vector.y);
+	SAME(s1.wind_cnt, s2.wind_cnt);
+	SAME(s1.gust_cnt, s2.gust_cnt);
+	SAME(s1.nearest_d, s2.nearest_d);
+	SAME(s1.nearest_precip, s2.nearest_precip);
+	SAME(s1.nearest_wd, s2.nearest_wd);
+	SAME(s1.nearest_ws, s2.nearest_ws);
+	SAME(s1.nearest_gust, s2.nearest_gust);
+#undef SAME
+}
+
+
+// runs one exponent setting through all 16 kernels, over a spread of cells (including ones on top of stations) and two days of hours
+static void checkKernels(TestWeatherGrid &test) {
+	for (std::uint32_t kernel = 0; kernel < 16; kernel++) {
+		const std::uint64_t interpolate_method = (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_SPATIAL) |
+			((kernel & 0x1) ? (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_TEMP_RH) : 0) |
+			((kernel & 0x2) ? (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND) : 0) |
+			((kernel & 0x4) ? (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_WIND_VECTOR) : 0) |
+			((kernel & 0x8) ? (1ull << CWFGM_SCENARIO_OPTION_WEATHER_INTERPOLATE_PRECIP) : 0);
+
+		std::vector<XY_Point> points;
+		for (std::uint16_t y = 5; y < test.m_engine->m_ysize; y += 23)
+			for (std::uint16_t x = 3; x < test.m_engine->m_xsize; x += 19)
+				points.push_back(test.CellCentre(x, y));
+		for (auto &station : test.m_stations) {
+			XY_Point loc;
+			station->GetLocation(&loc);
+			points.push_back(loc);			// inside a metre of a station takes the fixed weight
+		}
+
+		for (std::uint32_t hour = 0; hour < 48; hour++) {
+			const HSS_Time::WTime time = test.m_start + HSS_Time::WTimeSpan(0, hour, 0, 0);
+			for (const XY_Point &pt : points) {
+				IWXData wx1, wx2;
+				GStationSums s1, s2;
+				memset(&wx1, 0, sizeof(wx1));
+				memset(&wx2, 0, sizeof(wx2));
+				HRESULT hr1 = WeatherGridTest::StationKernel(test.m_grid.get(), kernel, time, pt, interpolate_method, &wx1, &s1);
+				HRESULT hr2 = WeatherGridTest::StationGeneric(test.m_grid.get(), time, pt, interpolate_method, &wx2, &s2);
+				TEST_CHECK(hr1 == hr2, "kernel %u, hour %u: HRESULT %08x != %08x", kernel, hour, (unsigned)hr1, (unsigned)hr2);
+				TEST_CHECK(SUCCEEDED(hr1), "kernel %u, hour %u: failed with %08x", kernel, hour, (unsigned)hr1);
+				if (SUCCEEDED(hr1) && SUCCEEDED(hr2))
+					compareSums(kernel, (std::uint16_t)((pt.x - test.m_engine->m_xll) / test.m_engine->m_resolution),
+					    (std::uint16_t)((pt.y - test.m_engine->m_yll) / test.m_engine->m_resolution), hour, wx1, s1, wx2, s2);
+			}
+		}
+	}
+}
+
+
+int main(int /*argc*/, char * /*argv*/[]) {
+	TestWeatherGrid test;
+
+	checkKernels(test);				// the default exponents (2.0 everywhere) take the kernels' shortcut
+
+	test.m_grid->SetAttribute(CWFGM_WEATHER_OPTION_ADIABATIC_IDW_EXPONENT_TEMP, 3.0);
+	test.m_grid->SetAttribute(CWFGM_WEATHER_OPTION_IDW_EXPONENT_WS, 1.5);
+	test.m_grid->SetAttribute(CWFGM_WEATHER_OPTION_IDW_EXPONENT_PRECIP, 2.5);
+	checkKernels(test);				// and other exponents go through pow()
+
+	test.m_grid->SetAttribute(CWFGM_WEATHER_OPTION_IDW_EXPONENT_WS, 0.0);
+	test.m_grid->SetAttribute(CWFGM_WEATHER_OPTION_IDW_EXPONENT_PRECIP, 0.0);
+	checkKernels(test);				// and turning a value's interpolation off skips its sums
+
+	if (g_testFailures)
+		fprintf(stderr, "%d failures\n", g_testFailures);
+	return g_testFailures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * WISE_Weather_Module: TimeTierTest.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "WeatherTestGrid.h"
+
+int g_testFailures = 0;
+
+
+// the tier PurgeToDay() and PurgeToHour() say a time belongs in, which is what WeatherBaseCache::TimeTier() has to agree with
+static std::uint16_t purgedTier(const HSS_Time::WTime &time) {
+	HSS_Time::WTime pt(time);
+	pt.PurgeToDay(WTIME_FORMAT_AS_LOCAL);
+	if (time == pt)
+		return WeatherBaseCache::TIER_DAY;
+	if (time == pt + HSS_Time::WTimeSpan(0, 12, 0, 0))
+		return WeatherBaseCache::TIER_NOON;
+	pt = time;
+	pt.PurgeToHour(WTIME_FORMAT_AS_LOCAL);
+	if (time == pt)
+		return WeatherBaseCache::TIER_HOUR;
+	return WeatherBaseCache::TIER_SEC;
+}
+
+
+// a time manager for a location observing daylight savings from March 12 to November 5, 2023 (North American rules) if 'dst' is set
+static WTimeManager *zone(double latitude, double longitude, const HSS_Time::WTimeSpan &timezone, bool dst) {
+	WorldLocation loc;
+	loc.m_latitude(DEGREE_TO_RADIAN(latitude));
+	loc.m_longitude(DEGREE_TO_RADIAN(longitude));
+	loc.m_timezone(timezone);
+	if (dst) {
+		loc.m_startDST(HSS_Time::WTimeSpan(70, 2, 0, 0));	// days from January 1
+		loc.m_endDST(HSS_Time::WTimeSpan(308, 2, 0, 0));
+		loc.m_amtDST(HSS_Time::WTimeSpan(0, 1, 0, 0));
+	}
+	return new WTimeManager(loc);
+}
+
+
+// every 5 minutes (and a few odd seconds past them) for two days either side of 9am UTC on the date, switching between the zones on every time so the tier's
+// per thread offset has to follow the time manager
+static void checkAround(const std::vector<WTimeManager *> &zones, int year, unsigned month, unsigned day) {
+	for (std::int64_t offset = -48 * 60 * 60; offset <= 48 * 60 * 60; offset += 5 * 60)
+		for (std::int64_t extra : { 0LL, 1LL, 59LL, 30LL * 60LL }) {
+			for (WTimeManager *tm : zones) {
+				const HSS_Time::WTime centre = TestTime(year, month, day, 9, 0, 0, tm);	// 2 or 3am local in North America, afternoon in India
+				const HSS_Time::WTime time = centre + HSS_Time::WTimeSpan(offset + extra);
+				const std::uint16_t tier = WeatherBaseCache::TimeTier(time), expected = purgedTier(time);
+				TEST_CHECK(tier == expected, "UTC offset %lld min, %04d-%02u-%02u %+lld s: tier %u, PurgeToDay/PurgeToHour give %u",
+					(long long)(tm->m_worldLocation.m_timezone().GetTotalSeconds() / 60), year, month, day, (long long)(offset + extra), tier, expected);
+			}
+		}
+}
+
+
+int main(int /*argc*/, char * /*argv*/[]) {
+	std::vector<WTimeManager *> zones;
+	zones.push_back(zone(53.5, -113.5, HSS_Time::WTimeSpan(0, -7, 0, 0), true));		// Edmonton, MST/MDT
+	zones.push_back(zone(47.6, -52.7, HSS_Time::WTimeSpan(0, -3, -30, 0), true));		// St. John's, a half hour zone with DST
+	zones.push_back(zone(22.6, 88.4, HSS_Time::WTimeSpan(0, 5, 30, 0), false));		// Kolkata, east of UTC, a half hour and no DST
+
+	checkAround(zones, 2023, 3, 12);			// spring forward
+	checkAround(zones, 2023, 11, 5);			// fall back
+	checkAround(zones, 2023, 7, 1);				// the middle of summer time
+
+	zones[0]->m_worldLocation.m_timezone(HSS_Time::WTimeSpan(0, -6, 0, 0));	// the same manager moved to another zone has to be noticed too
+	checkAround(zones, 2023, 3, 12);
+
+	TEST_CHECK(WeatherBaseCache::TimeTier(TestTime(2023, 3, 12, 12, 0, 0, nullptr)) == WeatherBaseCache::TIER_NOON, "noon UTC without a time manager isn't in the noon tier");
+
+	for (WTimeManager *tm : zones)
+		delete tm;
+
+	if (g_testFailures)
+		fprintf(stderr, "%d failures\n", g_testFailures);
+	return g_testFailures ? 1 : 0;
+}
@@ -0,0 +1,267 @@
+/**
+ * WISE_Weather_Module: WeatherCacheBench.cpp
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures the weather layer cache three ways:
+//   - throughput of Retrieve/Store from 1 to 64 threads, for the sharded locks
+//   - hit rates of the FIFO and CLOCK eviction policies replaying a query trace
+//   - how much of a simulation's traffic the per-thread front caches keep away from the shards, from the cache statistics
+//
+// usage: WeatherCacheBench [trace]
+//   'trace' is a text file of queries, one "x y hour" per line (hours from the start of the weather), as recorded from a simulation.  Without
+//   one, a trace is made up from a fire growing out of an ignition, which re-asks for the cells around the ignition every time step.
+
+#include "WeatherTestGrid.h"
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+
+int g_testFailures = 0;
+
+
+struct TraceQuery {
+	std::uint16_t x, y;
+	std::uint32_t hour;
+};
+
+
+// a small, fast generator so the threads measure the cache rather than the random numbers
+static inline std::uint32_t xorshift(std::uint32_t *state) {
+	std::uint32_t s = *state;
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	return *state = s;
+}
+
+
+static void answer(std::uint32_t seed, HIWXData *wd) {
+	memset(wd, 0, sizeof(*wd));
+	wd->hr = S_OK;
+	wd->wx.Temperature = 20.0 + (seed % 100) * 0.1;
+	wd->wx.RH = 0.3;
+	wd->wx.WindSpeed = 10.0;
+	wd->wx_valid = true;
+}
+
+
+static double seconds(std::chrono::steady_clock::time_point from) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - from).count();
+}
+
+
+// a fixed number of queries spread over more and more threads, each asking for random cells of a 128 x 128 block over 4 hours, storing on a miss
+static void threadScaling(TestWeatherGrid &test) {
+	static constexpr std::uint16_t BLOCK = 128;
+	static constexpr std::uint32_t HOURS = 4;
+	static constexpr std::uint64_t QUERIES = 8 * 1024 * 1024;
+
+	printf("thread scaling, %u hardware threads\n  threads  Mqueries/s  speedup\n", std::thread::hardware_concurrency());
+	double base = 0.0;
+	for (std::uint32_t threads = 1; threads <= 64; threads *= 2) {
+		WeatherLayerCache *cache = new WeatherLayerCache(test.m_engine->m_xsize, test.m_engine->m_ysize, BLOCK * BLOCK + 1024, 0, test.m_tm);
+		for (std::uint16_t y = 0; y < BLOCK; y++)
+			for (std::uint16_t x = 0; x < BLOCK; x++)
+				for (std::uint32_t h = 0; h < HOURS; h++) {
+					WeatherKey key(x, y, test.m_start + HSS_Time::WTimeSpan(0, h, 0, 0), 0, nullptr, cache);
+					HIWXData wd;
+					answer(x + y + h, &wd);
+					cache->Store(&key, &wd, test.m_tm);
+				}
+
+		std::vector<std::thread> pool;
+		const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (std::uint32_t t = 0; t < threads; t++)
+			pool.emplace_back([&test, cache, t, threads]() {
+				std::uint32_t state = 0x9e3779b9u * (t + 1);
+				HIWXData wd;
+				for (std::uint64_t i = QUERIES / threads; i; i--) {
+					const std::uint32_t r = xorshift(&state);
+					const std::uint16_t x = (std::uint16_t)(r % BLOCK), y = (std::uint16_t)((r >> 8) % BLOCK);
+					WeatherKey key(x, y, test.m_start + HSS_Time::WTimeSpan(0, (r >> 16) % HOURS, 0, 0), 0, nullptr, cache);
+					if (!cache->Retrieve(&key, &wd, test.m_tm)) {
+						answer(r, &wd);
+						cache->Store(&key, &wd, test.m_tm);
+					}
+				}
+			});
+		for (std::thread &th : pool)
+			th.join();
+		const double rate = (double)QUERIES / seconds(start) / 1.0e6;
+		if (threads == 1)
+			base = rate;
+		printf("  %7u  %10.2f  %7.2f\n", threads, rate, rate / base);
+
+		cache->Clear();					// drops this cache's front cache entries before another cache can reuse its address
+		delete cache;
+	}
+}
+
+
+static bool readTrace(const char *path, std::vector<TraceQuery> *trace) {
+	std::ifstream in(path);
+	if (!in)
+		return false;
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream ls(line);
+		unsigned x, y, hour;
+		if (ls >> x >> y >> hour) {
+			TraceQuery q = { (std::uint16_t)x, (std::uint16_t)y, hour };
+			trace->push_back(q);
+		}
+	}
+	return !trace->empty();
+}
+
+
+// an elliptical fire growing downwind of an ignition in 10 minute steps for a day: every step asks for the cells along its perimeter, and for
+// the cells around the ignition (where the simulation keeps checking its ignition and statistics), so a few cells are asked for over and over
+static void makeTrace(std::uint16_t size, std::vector<TraceQuery> *trace) {
+	const double ix = size / 4.0, iy = size / 3.0;
+	for (std::uint32_t step = 0; step < 24 * 6; step++) {
+		const std::uint32_t hour = step / 6;
+		const double a = 2.0 + 0.5 * step, b = 1.0 + 0.25 * step;
+		const double cx = ix + 0.7 * a, cy = iy;
+		for (std::uint32_t i = 0; i < (std::uint32_t)(8.0 * a); i++) {
+			const double angle = DEGREE_TO_RADIAN(360.0) * i / (8.0 * a);
+			const int x = (int)(cx + a * cos(angle)), y = (int)(cy + b * sin(angle));
+			if ((x >= 0) && (y >= 0) && (x < size) && (y < size)) {
+				TraceQuery q = { (std::uint16_t)x, (std::uint16_t)y, hour };
+				trace->push_back(q);
+			}
+		}
+		for (int y = -2; y <= 2; y++)
+			for (int x = -2; x <= 2; x++) {
+				TraceQuery q = { (std::uint16_t)(ix + x), (std::uint16_t)(iy + y), hour };
+				trace->push_back(q);
+			}
+	}
+}
+
+
+// replays the trace against a cache small enough to have to evict, storing on every miss, once per eviction policy
+static void evictionHitRates(TestWeatherGrid &test, const std::vector<TraceQuery> &trace) {
+	static const char *policies[2] = { "FIFO", "CLOCK" };
+	static constexpr std::uint32_t CELLS = 512;
+
+	printf("eviction, %zu queries, %u cells\n  policy  hit rate  evictions\n", trace.size(), CELLS);
+	for (std::uint16_t policy = CWFGM_WEATHER_CACHE_EVICT_FIFO; policy <= CWFGM_WEATHER_CACHE_EVICT_CLOCK; policy++) {
+		WeatherLayerCache *cache = new WeatherLayerCache(test.m_engine->m_xsize, test.m_engine->m_ysize, CELLS, 0, test.m_tm);
+		cache->m_eviction = policy;
+		cache->m_statistics = true;
+
+		std::uint64_t hits = 0;
+		for (const TraceQuery &q : trace) {
+			if ((q.x >= test.m_engine->m_xsize) || (q.y >= test.m_engine->m_ysize))
+				continue;
+			WeatherKey key(q.x, q.y, test.m_start + HSS_Time::WTimeSpan(0, q.hour, 0, 0), 0, nullptr, cache);
+			HIWXData wd;
+			if (cache->Retrieve(&key, &wd, test.m_tm))
+				hits++;
+			else {
+				answer(q.x ^ q.y, &wd);
+				cache->Store(&key, &wd, test.m_tm);
+			}
+		}
+
+		WeatherCacheStats stats;
+		cache->Stats(&stats);
+		printf("  %-6s  %7.2f%%  %9llu\n", policies[policy], 100.0 * (double)hits / (double)trace.size(), (unsigned long long)stats.evictions);
+		cache->Clear();
+		delete cache;
+	}
+}
+
+
+// simulation worker threads each grow their own stretch of a fire front: every 2 minute time step asks for each vertex's cell four times (as the
+// growth calculations do), once for the weather and three times for the FWI values.  Anything the front caches answer never reaches a shard.
+static void frontCacheTraffic(TestWeatherGrid &test) {
+	static constexpr std::uint32_t THREADS = 8, VERTICES = 40, STEPS = 30 * 24;
+
+	WeatherLayerCache *cache = new WeatherLayerCache(test.m_engine->m_xsize, test.m_engine->m_ysize, 7500, 0, test.m_tm);
+	cache->m_statistics = true;
+
+	std::vector<std::thread> pool;
+	for (std::uint32_t t = 0; t < THREADS; t++)
+		pool.emplace_back([&test, cache, t]() {
+			for (std::uint32_t step = 0; step < STEPS; step++) {
+				const HSS_Time::WTime time = test.m_start + HSS_Time::WTimeSpan(0, 0, 2 * step, 0);
+				for (std::uint32_t v = 0; v < VERTICES; v++) {
+					const std::uint16_t x = (std::uint16_t)((20 + t * 20 + v / 2 + step / 30) % test.m_engine->m_xsize);
+					const std::uint16_t y = (std::uint16_t)((50 + v + step / 45) % test.m_engine->m_ysize);
+					WeatherKey key(x, y, time, 0, nullptr, cache);
+					HIWXData wd;
+					if (!cache->Retrieve(&key, &wd, test.m_tm)) {
+						answer(x + y, &wd);
+						cache->Store(&key, &wd, test.m_tm);
+					}
+					for (std::uint32_t i = 0; i < 3; i++) {
+						WeatherData data;
+						if (!cache->Retrieve(&key, &data, test.m_tm)) {
+							memset(&data, 0, sizeof(data));
+							data.hr = S_OK;
+							data.wx = wd.wx;
+							data.wx_valid = true;
+							cache->Store(&key, &data, test.m_tm);
+						}
+					}
+				}
+			}
+		});
+	for (std::thread &th : pool)
+		th.join();
+
+	WeatherCacheStats stats;
+	cache->Stats(&stats);
+	std::uint64_t front = 0, shard = 0;
+	for (std::uint16_t i = 0; i < 4; i++) {
+		front += stats.front[i];
+		for (std::uint16_t j = 0; j < 4; j++)
+			shard += stats.hits[i][j] + stats.misses[i][j] + stats.stores[i][j];
+	}
+	printf("front caches, %u threads\n  %llu front cache hits, %llu shard operations (hits, misses, stores)\n", THREADS, (unsigned long long)front, (unsigned long long)shard);
+	printf("  shard traffic cut by %.1f%% from %llu to %llu operations\n", 100.0 * (double)front / (double)(front + shard),
+		(unsigned long long)(front + shard), (unsigned long long)shard);
+	TEST_CHECK(front > 0, "no queries were answered by the front caches");
+
+	cache->Clear();
+	delete cache;
+}
+
+
+int main(int argc, char *argv[]) {
+	TestWeatherGrid test;
+
+	threadScaling(test);
+
+	std::vector<TraceQuery> trace;
+	if (argc > 1) {
+		if (!readTrace(argv[1], &trace)) {
+			fprintf(stderr, "can't read a trace from %s\n", argv[1]);
+			return 1;
+		}
+	}
+	else
+		makeTrace(test.m_engine->m_xsize, &trace);
+	evictionHitRates(test, trace);
+
+	frontCacheTraffic(test);
+
+	return g_testFailures ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/**
+ * WISE_Weather_Module: WeatherTestGrid.h
+ * Copyright (C) 2023  WISE
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "CWFGM_WeatherGrid.h"
+#include "CWFGM_WeatherStation.h"
+#include "CWFGM_WeatherStream.h"
+#include "GridCom_ext.h"
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+
+// what the tests report failures with, so every test reads the same way and ctest sees a non-zero exit
+#define TEST_CHECK(cond, ...)		do { if (!(cond)) { fprintf(stderr, "%s:%d: ", __FILE__, __LINE__); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); ++g_testFailures; } } while (0)
+
+extern int g_testFailures;
+
+
+// GMT time for a calendar date, counted from the same epoch (midnight January 1, 1600) WTime uses
+inline HSS_Time::WTime TestTime(int year, unsigned month, unsigned day, unsigned hour, unsigned minute, unsigned second, const WTimeManager *tm) {
+	year -= (month <= 2) ? 1 : 0;
+	const std::int64_t era = year / 400;
+	const std::uint32_t yoe = (std::uint32_t)(year - era * 400);
+	const std::uint32_t doy = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1;
+	const std::uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	const std::int64_t days = era * 146097 + (std::int64_t)doe - 60;			// days from March 1, 1600 to January 1, 1600 is 60 (leap year)
+	const std::uint64_t secs = (std::uint64_t)(days * 86400LL) + hour * 3600ull + minute * 60ull + second;
+	return HSS_Time::WTime(secs * 1000000ull, tm, false);
+}
+
+
+// stands in for the fuel grid under a weather grid: a flat, projected grid with elevation rising to the north east, and no weather of its own
+class TestGridEngine : public ICWFGM_GridEngine {
+public:
+	TestGridEngine(std::uint16_t xsize, std::uint16_t ysize, double resolution, WTimeManager *tm) :
+	    m_xsize(xsize), m_ysize(ysize), m_resolution(resolution), m_xll(480000.0), m_yll(5900000.0) {
+		m_data.m_timeManager = tm;
+	}
+
+	virtual NO_THROW HRESULT GetDimensions(Layer * /*layerThread*/, std::uint16_t *x_dim, std::uint16_t *y_dim) override {
+		*x_dim = m_xsize;
+		*y_dim = m_ysize;
+		return S_OK;
+	}
+
+	virtual NO_THROW HRESULT GetAttribute(Layer * /*layerThread*/, std::uint16_t option, PolymorphicAttribute *value) override {
+		switch (option) {
+			case CWFGM_GRID_ATTRIBUTE_PLOTRESOLUTION:	*value = m_resolution; return S_OK;
+			case CWFGM_GRID_ATTRIBUTE_XLLCORNER:		*value = m_xll; return S_OK;
+			case CWFGM_GRID_ATTRIBUTE_YLLCORNER:		*value = m_yll; return S_OK;
+			case CWFGM_GRID_ATTRIBUTE_SPATIALREFERENCE:	*value = std::string("+proj=utm +zone=12 +datum=WGS84 +units=m +no_defs"); return S_OK;
+		}
+		return E_INVALIDARG;
+	}
+
+	virtual NO_THROW HRESULT GetElevationData(Layer * /*layerThread*/, const XY_Point &pt, bool /*allow_defaults_returned*/, double *elevation, double *slope_factor, double *slope_azimuth,
+	    grid::TerrainValue *elev_valid, grid::TerrainValue *terrain_valid, XY_Rectangle * /*cache_bbox*/) override {
+		*elevation = 600.0 + 0.01 * (pt.x - m_xll) + 0.02 * (pt.y - m_yll);
+		*slope_factor = 0.0;
+		*slope_azimuth = 0.0;
+		*elev_valid = *terrain_valid = grid::TerrainValue::SET;
+		return S_OK;
+	}
+
+	virtual NO_THROW HRESULT GetWeatherData(Layer * /*layerThread*/, const XY_Point & /*pt*/, const HSS_Time::WTime & /*time*/, std::uint64_t /*interpolate_method*/,
+	    IWXData * /*wx*/, IFWIData * /*ifwi*/, DFWIData * /*dfwi*/, bool * /*wx_valid*/, XY_Rectangle * /*bbox_cache*/) override {
+		return E_NOTIMPL;
+	}
+
+	virtual NO_THROW HRESULT Valid(Layer * /*layerThread*/, const HSS_Time::WTime & /*start_time*/, const HSS_Time::WTimeSpan & /*duration*/, std::uint32_t /*option*/,
+	    std::vector<uint16_t> * /*application_count*/) override {
+		return ERROR_GRID_WEATHER_NOT_IMPLEMENTED;
+	}
+
+	virtual NO_THROW HRESULT GetCommonData(Layer * /*layerThread*/, ICWFGM_CommonData **pVal) override {
+		*pVal = &m_data;
+		return S_OK;
+	}
+
+	XY_Point CellCentre(std::uint16_t x, std::uint16_t y) const { return XY_Point(m_xll + ((double)x + 0.5) * m_resolution, m_yll + ((double)y + 0.5) * m_resolution); }
+
+	std::uint16_t m_xsize, m_ysize;
+	double m_resolution, m_xll, m_yll;
+	ICWFGM_CommonData m_data;
+};
+
+
+// a weather grid over a TestGridEngine with a fixed set of stations, each with a week of hourly weather that varies smoothly by station and
+// hour (and rains some afternoons) so every interpolation option has something to do
+class TestWeatherGrid {
+public:
+	static constexpr std::uint32_t DAYS = 7;
+
+	TestWeatherGrid(std::uint16_t size = 200, std::uint32_t stations = 7) : m_tm(nullptr), m_start(0ull, nullptr, false) {
+		WorldLocation loc;
+		loc.m_latitude(DEGREE_TO_RADIAN(53.5));
+		loc.m_longitude(DEGREE_TO_RADIAN(-113.5));
+		loc.m_timezone(HSS_Time::WTimeSpan(0, -7, 0, 0));
+		m_tm = new WTimeManager(loc);
+		m_start = TestTime(2023, 7, 1, 7, 0, 0, m_tm);			// local midnight, MST
+
+		m_engine = new TestGridEngine(size, size, 100.0, m_tm);
+		m_grid = new CCWFGM_WeatherGrid();
+		m_grid->PutCommonData(nullptr, &m_engine->m_data);
+		m_grid->PutGridEngine(nullptr, m_engine.get());
+
+		for (std::uint32_t i = 0; i < stations; i++)
+			addStation(i, stations);
+		m_grid->Valid(nullptr, m_start, HSS_Time::WTimeSpan(DAYS, 0, 0, 0), 0, nullptr);
+	}
+
+	~TestWeatherGrid() {
+		m_grid = nullptr;
+		m_streams.clear();
+		m_stations.clear();
+		m_engine = nullptr;
+		delete m_tm;
+	}
+
+	// the station values for one hour, a function of the station and the hour only so a test can re-create them
+	static void StationWeather(std::uint32_t station, std::uint32_t hour, IWXData *wx) {
+		const double diurnal = sin((double)((hour + 18) % 24) * DEGREE_TO_RADIAN(15.0));
+		wx->Temperature = 18.0 + 1.5 * station + 8.0 * diurnal;
+		wx->DewPointTemperature = wx->Temperature - 9.0 - 0.5 * station;
+		wx->RH = 0.35 + 0.04 * station - 0.15 * diurnal;
+		wx->Precipitation = (((hour / 24) + station) % 3 == 0) && ((hour % 24) >= 14) && ((hour % 24) < 17) ? 0.4 * (1 + station) : 0.0;
+		wx->WindSpeed = 8.0 + 2.0 * station + 4.0 * diurnal;
+		wx->WindGust = wx->WindSpeed * 1.6;
+		wx->WindDirection = fmod(0.3 + 0.7 * station + 0.05 * hour, DEGREE_TO_RADIAN(360.0));
+		wx->SpecifiedBits = IWXDATA_SPECIFIED_WINDGUST;
+	}
+
+	XY_Point CellCentre(std::uint16_t x, std::uint16_t y) const { return m_engine->CellCentre(x, y); }
+
+	WTimeManager *m_tm;
+	HSS_Time::WTime m_start;
+	boost::intrusive_ptr<TestGridEngine> m_engine;
+	boost::intrusive_ptr<CCWFGM_WeatherGrid> m_grid;
+	std::vector<boost::intrusive_ptr<CCWFGM_WeatherStation>> m_stations;
+	std::vector<boost::intrusive_ptr<CCWFGM_WeatherStream>> m_streams;
+
+private:
+	void addStation(std::uint32_t i, std::uint32_t count) {
+		boost::intrusive_ptr<CCWFGM_WeatherStation> station = new CCWFGM_WeatherStation();
+		station->put_GridEngine(m_engine.get());
+		const double angle = DEGREE_TO_RADIAN(360.0) * i / count;
+		const double radius = 0.45 * m_engine->m_xsize * m_engine->m_resolution * ((i & 1) ? 0.6 : 0.9);
+		const XY_Point centre = m_engine->CellCentre(m_engine->m_xsize / 2, m_engine->m_ysize / 2);
+		station->SetLocation(XY_Point(centre.x + radius * cos(angle), centre.y + radius * sin(angle)));
+		station->SetAttribute(CWFGM_GRID_ATTRIBUTE_DEFAULT_ELEVATION, 550.0 + 40.0 * i);
+
+		boost::intrusive_ptr<CCWFGM_WeatherStream> stream = new CCWFGM_WeatherStream();
+		station->AddStream(stream.get(), 0);
+		stream->put_CommonData(&m_engine->m_data);
+		stream->SetAttribute(CWFGM_WEATHER_OPTION_INITIAL_FFMC, 88.0 + 0.5 * i);
+		stream->SetAttribute(CWFGM_WEATHER_OPTION_INITIAL_DMC, 25.0 + i);
+		stream->SetAttribute(CWFGM_WEATHER_OPTION_INITIAL_DC, 250.0 + 10.0 * i);
+		stream->SetAttribute(CWFGM_WEATHER_OPTION_INITIAL_HFFMC, 85.0);
+		stream->SetAttribute(CWFGM_WEATHER_OPTION_INITIAL_HFFMCTIME, (std::int64_t)(13 * 60 * 60));
+		stream->SetValidTimeRange(m_start, HSS_Time::WTimeSpan(DAYS, 0, 0, 0), false);
+
+		for (std::uint32_t day = 0; day < DAYS; day++)
+			stream->MakeHourlyObservations(m_start + HSS_Time::WTimeSpan(day, 0, 0, 0));
+		for (std::uint32_t hour = 0; hour < DAYS * 24; hour++) {
+			IWXData wx;
+			StationWeather(i, hour, &wx);
+			stream->SetInstantaneousValues(m_start + HSS_Time::WTimeSpan(0, hour, 0, 0), &wx);
+		}
+
+		m_grid->AddStream(stream.get());
+		if (!i)
+			m_grid->put_PrimaryStream(stream.get());
+		m_stations.push_back(station);
+		m_streams.push_back(stream);
+	}
+};
+
+
+// reaches the grid's internals for the tests, CCWFGM_WeatherGrid names it as a friend
+class WeatherGridTest {
+public:
+	static HRESULT StationKernel(CCWFGM_WeatherGrid *grid, std::uint32_t kernel, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums) {
+		return (grid->*CCWFGM_WeatherGrid::m_stationKernels[kernel])(time, pt, interpolate_method, wx, sums);
+	}
+
+	static HRESULT StationGeneric(CCWFGM_WeatherGrid *grid, const HSS_Time::WTime &time, const XY_Point &pt, std::uint64_t interpolate_method, IWXData *wx, GStationSums *sums) {
+		return grid->accumulateStationsGeneric(time, pt, interpolate_method, wx, sums);
+	}
+};